@@ -1,20 +1,139 @@
 #pragma once
 #include <utility>
 #include <cmath>
+#include <type_traits>
 #include <Inc/jacoby/types.h>
+#include <Inc/jacoby/simd.h>
 
 #ifndef CORE_JACOBY
 #define CORE_JACOBY
 
 namespace jacoby
 {
+	template< typename PrecType >
+	class Vector3;
+
+	// generic counterpart of InverseSqrt(FLOAT)
+	template< typename PrecType >
+	PrecType InverseSqrt(const PrecType& value)
+	{
+		using std::sqrt;
+		return PrecType(1.0) / sqrt(value);
+	}
+
+	/*
+	* Base of lazy Vector3 arithmetic. Operators only build a tree of
+	* expression nodes, which is evaluated component by component when it
+	* is assigned to a Vector3, so a whole expression turns into three
+	* fused scalar expressions with no temporary vectors in between.
+	* Vectors are held by reference and inner nodes by value, an expression
+	* must not outlive the statement it was built in - do not keep one in
+	* an auto variable.
+	*/
+	template< typename Expr, typename PrecType >
+	class VectorExpression
+	{
+	public:
+		typedef PrecType ValueType;
+
+		constexpr const Expr& Self() const
+		{
+			return static_cast< const Expr& >(*this);
+		}
+
+		constexpr PrecType SquareMagnitude() const
+		{
+			return Self().X() * Self().X() + Self().Y() * Self().Y() + Self().Z() * Self().Z();
+		}
+
+		PrecType Magnitude() const
+		{
+			// unqualified, so that number types of their own are found too
+			using std::sqrt;
+			return sqrt(SquareMagnitude());
+		}
+	};
+
+	// vectors are kept by reference, expression nodes are cheap to copy
+	template< typename Expr >
+	struct VectorOperand
+	{
+		typedef const Expr type;
+	};
+
+	template< typename PrecType >
+	struct VectorOperand< Vector3< PrecType > >
+	{
+		typedef const Vector3< PrecType >& type;
+	};
+
+	struct VectorAdd
+	{
+		template< typename PrecType >
+		static constexpr PrecType Apply(const PrecType& lhs, const PrecType& rhs) { return lhs + rhs; }
+	};
+
+	struct VectorSubtract
+	{
+		template< typename PrecType >
+		static constexpr PrecType Apply(const PrecType& lhs, const PrecType& rhs) { return lhs - rhs; }
+	};
+
+	struct VectorMultiply
+	{
+		template< typename PrecType >
+		static constexpr PrecType Apply(const PrecType& lhs, const PrecType& rhs) { return lhs * rhs; }
+	};
+
+	struct VectorDivide
+	{
+		template< typename PrecType >
+		static constexpr PrecType Apply(const PrecType& lhs, const PrecType& rhs) { return lhs / rhs; }
+	};
+
+	// component-wise operation of two vectors
+	template< typename Lhs, typename Rhs, typename Op, typename PrecType >
+	class VectorBinary : public VectorExpression< VectorBinary< Lhs, Rhs, Op, PrecType >, PrecType >
+	{
+		typename VectorOperand< Lhs >::type m_lhs;
+		typename VectorOperand< Rhs >::type m_rhs;
+
+	public:
+		constexpr VectorBinary(const Lhs& lhs, const Rhs& rhs) :
+			m_lhs(lhs),
+			m_rhs(rhs)
+		{}
+
+		constexpr PrecType X() const { return Op::Apply(m_lhs.X(), m_rhs.X()); }
+		constexpr PrecType Y() const { return Op::Apply(m_lhs.Y(), m_rhs.Y()); }
+		constexpr PrecType Z() const { return Op::Apply(m_lhs.Z(), m_rhs.Z()); }
+	};
+
+	// operation of every component with one number
+	template< typename Expr, typename Op, typename PrecType >
+	class VectorScalar : public VectorExpression< VectorScalar< Expr, Op, PrecType >, PrecType >
+	{
+		typename VectorOperand< Expr >::type m_vec;
+		PrecType m_val;
+
+	public:
+		constexpr VectorScalar(const Expr& vec, const PrecType& val) :
+			m_vec(vec),
+			m_val(val)
+		{}
+
+		constexpr PrecType X() const { return Op::Apply(m_vec.X(), m_val); }
+		constexpr PrecType Y() const { return Op::Apply(m_vec.Y(), m_val); }
+		constexpr PrecType Z() const { return Op::Apply(m_vec.Z(), m_val); }
+	};
+
 	template< typename PrecType = FLOAT>
-	class Vector3
+	class Vector3 : public VectorExpression< Vector3< PrecType >, PrecType >
 	{
 		PrecType x, y, z, pad;
 	public:
 		// default constructor
-		Vector3() :
+		constexpr Vector3() :
 			x(PrecType(0)),
 			y(PrecType(0)),
 			z(PrecType(0)),
@@ -22,21 +141,23 @@ namespace jacoby
 		{};
 
 		// constructor from PrecType
-		Vector3(const PrecType& x_, const PrecType& y_, const PrecType& z_):
+		constexpr Vector3(const PrecType& x_, const PrecType& y_, const PrecType& z_):
 			x(x_),
 			y(y_),
-			z(z_)
+			z(z_),
+			pad(PrecType(0))
 		{}
 
 		// move constructor from PrecType
-		Vector3(PrecType&& x_, PrecType&& y_, PrecType&& z_) :
+		constexpr Vector3(PrecType&& x_, PrecType&& y_, PrecType&& z_) :
 			x(std::move(x_)),
 			y(std::move(y_)),
-			z(std::move(z_))
+			z(std::move(z_)),
+			pad(PrecType(0))
 		{}
 
 		// copy constructor
-		Vector3(Vector3< PrecType>& rVec) :
+		constexpr Vector3(Vector3< PrecType>& rVec) :
 			x(rVec.x),
 			y(rVec.y),
 			z(rVec.z),
@@ -44,7 +165,7 @@ namespace jacoby
 		{};
 
 		// copy constructor
-		Vector3(const Vector3< PrecType> & rVec) :
+		constexpr Vector3(const Vector3< PrecType> & rVec) :
 			x(rVec.x),
 			y(rVec.y),
 			z(rVec.z),
@@ -52,84 +173,82 @@ namespace jacoby
 		{};
 
 		// move constructor
-		Vector3(Vector3< PrecType>&& rVec) :
+		constexpr Vector3(Vector3< PrecType>&& rVec) :
 			x(std::move(rVec.x)),
 			y(std::move(rVec.y)),
-			z(std::move(rVec.z))
+			z(std::move(rVec.z)),
+			pad(std::move(rVec.pad))
 		{};
 
+		// evaluates an expression
+		template< typename Expr >
+		constexpr Vector3(const VectorExpression< Expr, PrecType >& rExpr) :
+			x(rExpr.Self().X()),
+			y(rExpr.Self().Y()),
+			z(rExpr.Self().Z()),
+			pad(PrecType(0))
+		{}
+
 		// =========== Operators ===============
 		// assignment operator
-		Vector3< PrecType >& operator = (Vector3< PrecType >& rVec)
+		constexpr Vector3< PrecType >& operator = (Vector3< PrecType >& rVec)
 		{
 			x = rVec.x;
 			y = rVec.y;
 			z = rVec.z;
+			pad = rVec.pad;
 			return *this;
 		}
 
-		Vector3< PrecType >& operator = (const Vector3< PrecType >& rVec)
+		constexpr Vector3< PrecType >& operator = (const Vector3< PrecType >& rVec)
 		{
 			x = rVec.x;
 			y = rVec.y;
 			z = rVec.z;
+			pad = rVec.pad;
 			return *this;
 		}
 
 		// move assignment operator
-		Vector3< PrecType >& operator = (Vector3< PrecType >&& rVec)
+		constexpr Vector3< PrecType >& operator = (Vector3< PrecType >&& rVec)
 		{
 			x = std::move(rVec.x);
 			y = std::move(rVec.y);
 			z = std::move(rVec.z);
+			pad = std::move(rVec.pad);
 			return *this;
 		}
 
-		// addition
-		Vector3< PrecType > operator + (const Vector3< PrecType >& rVec) const
+		// evaluates an expression, it may refer to this vector
+		template< typename Expr >
+		constexpr Vector3< PrecType >& operator = (const VectorExpression< Expr, PrecType >& rExpr)
 		{
-			PrecType xOut = x + rVec.x;
-			PrecType yOut = y + rVec.y;
-			PrecType zOut = z + rVec.z;
-			return Vector3< PrecType >(xOut, yOut, zOut);
-		}
-
-		Vector3< PrecType >& operator += (const Vector3< PrecType >& rVec)
-		{
-			x += rVec.x;
-			y += rVec.y;
-			z += rVec.z;
+			const PrecType xOut = rExpr.Self().X();
+			const PrecType yOut = rExpr.Self().Y();
+			const PrecType zOut = rExpr.Self().Z();
+			x = xOut;
+			y = yOut;
+			z = zOut;
+			pad = PrecType(0);
 			return *this;
 		}
 
-		// subtraction
-		Vector3< PrecType > operator - (const Vector3< PrecType >& rVec) const
+		// addition
+		template< typename Expr >
+		constexpr Vector3< PrecType >& operator += (const VectorExpression< Expr, PrecType >& rExpr)
 		{
-			PrecType xOut = x - rVec.x;
-			PrecType yOut = y - rVec.y;
-			PrecType zOut = z - rVec.z;
-			return Vector3< PrecType >(xOut, yOut, zOut);
+			return *this = *this + rExpr;
 		}
 
-		Vector3< PrecType >& operator -= (const Vector3< PrecType >& rVec)
+		// subtraction
+		template< typename Expr >
+		constexpr Vector3< PrecType >& operator -= (const VectorExpression< Expr, PrecType >& rExpr)
 		{
-			x -= rVec.x;
-			y -= rVec.y;
-			z -= rVec.z;
-			pad -= rVec.pad;
-			return *this;
+			return *this = *this - rExpr;
 		}
 
 		// multiplication by number
-		Vector3< PrecType > operator * (const PrecType& rVal) const
-		{
-			PrecType xOut = x * rVal;
-			PrecType yOut = y * rVal;
-			PrecType zOut = z * rVal;
-			return Vector3< PrecType >(xOut, yOut, zOut);
-		}
-
-		Vector3< PrecType >& operator *= (const PrecType& rVal)
+		constexpr Vector3< PrecType >& operator *= (const PrecType& rVal)
 		{
 			x *= rVal;
 			y *= rVal;
@@ -138,15 +257,7 @@ namespace jacoby
 		}
 
 		// division by number
-		Vector3< PrecType > operator / (const PrecType& rVal) const
-		{
-			PrecType xOut = x / rVal;
-			PrecType yOut = y / rVal;
-			PrecType zOut = z / rVal;
-			return Vector3< PrecType >(xOut, yOut, zOut);
-		}
-
-		Vector3< PrecType >& operator /= (const PrecType& rVal)
+		constexpr Vector3< PrecType >& operator /= (const PrecType& rVal)
 		{
 			x /= rVal;
 			y /= rVal;
@@ -154,40 +265,41 @@ namespace jacoby
 			return *this;
 		}
 
-		// scalar product
-		PrecType operator * (const Vector3< PrecType >& rVec)
+		template< typename Expr >
+		constexpr void operator %= (const VectorExpression< Expr, PrecType >& rExpr)
 		{
-			return x * rVec.x + y * rVec.y + z * rVec.z;
+			*this = *this % rExpr;
 		}
 
-		// vector product
-		Vector3< PrecType > operator % (const Vector3<PrecType>& rVec) const
+		friend BOOL operator == (const Vector3<PrecType>& rVec, const Vector3<PrecType>& lVec)
 		{
-			return Vector3<PrecType>(
-				y * rVec.z - z * rVec.y,
-				z * rVec.x - x * rVec.z,
-				x * rVec.y - y * rVec.x
-				);
+			return (rVec.x== lVec.x && rVec.y== lVec.y & rVec.z== lVec.z );
 		}
 
-		void operator %= (const Vector3<PrecType>& rVec)
+		BOOL operator != (const Vector3<PrecType>& rVec)
 		{
-			*this = VectorProduct(*this, rVec);
+			return !(*this == rVec);
 		}
 
-		friend BOOL operator == (const Vector3<PrecType>& rVec, const Vector3<PrecType>& lVec)
+		// components by value, the leaves of expressions
+		constexpr PrecType X() const
 		{
-			return (rVec.x== lVec.x && rVec.y== lVec.y & rVec.z== lVec.z );
+			return x;
 		}
 
-		BOOL operator != (const Vector3<PrecType>& rVec)
+		constexpr PrecType Y() const
 		{
-			return !(*this == rVec);
+			return y;
+		}
+
+		constexpr PrecType Z() const
+		{
+			return z;
 		}
 
 		// =========== Methods ===============
 		// invert
-		void Invert()
+		constexpr void Invert()
 		{
 			x = -x;
 			y = -y;
@@ -196,43 +308,46 @@ namespace jacoby
 
 		PrecType Magnitude() const
 		{
-			return std::sqrt(x * x + y * y + z * z);
+			using std::sqrt;
+			return sqrt(x * x + y * y + z * z);
 		}
 
-		PrecType SquareMagnitude() const
+		constexpr PrecType SquareMagnitude() const
 		{
 			return x * x + y * y + z * z;
 		}
 
-		void Normalize()
+		/*
+		* Returns the length before normalization, so that callers needing
+		* both pay for one square root. Floating point types multiply by an
+		* exact inverse square root, fixed point divides, a reciprocal would
+		* cost it too much precision.
+		*/
+		PrecType Normalize()
 		{
-			PrecType norm = Magnitude();
-			if (norm > 0)
-			{
-				x /= norm;
-				y /= norm;
-				z /= norm;
-			}
+			PrecType length2 = SquareMagnitude();
+			if (!(length2 > 0))
+				return PrecType(0);
+			return ScaleToUnit(length2, std::is_floating_point< PrecType >());
 		}
 
-		void AddScaledVector(const Vector3< PrecType >& rVec, const PrecType& rVal)
+		template< typename Expr >
+		constexpr void AddScaledVector(const VectorExpression< Expr, PrecType >& rExpr, const PrecType& rVal)
 		{
-			x += rVec.x * rVal;
-			y += rVec.y * rVal;
-			z += rVec.z * rVal;
+			*this = *this + rExpr * rVal;
 		}
 
-		static PrecType ScalarProduct(const Vector3<PrecType>& lVec, const Vector3<PrecType>& rVec)
+		static constexpr PrecType ScalarProduct(const Vector3<PrecType>& lVec, const Vector3<PrecType>& rVec)
 		{
 			return lVec.x * rVec.x + lVec.y * rVec.y + lVec.z * rVec.z;
 		}
 
-		static Vector3< PrecType > ComponentProduct(const Vector3<PrecType>& lVec, const Vector3<PrecType>& rVec)
+		static constexpr Vector3< PrecType > ComponentProduct(const Vector3<PrecType>& lVec, const Vector3<PrecType>& rVec)
 		{
 			return Vector3< PrecType >(lVec.x * rVec.x, lVec.y * rVec.y, lVec.z * rVec.z);
 		}
 
-		static Vector3< PrecType > VectorProduct(const Vector3<PrecType>& lVec, const Vector3<PrecType>& rVec)
+		static constexpr Vector3< PrecType > VectorProduct(const Vector3<PrecType>& lVec, const Vector3<PrecType>& rVec)
 		{
 			return Vector3<PrecType>(
 				lVec.y * rVec.z - lVec.z * rVec.y,
@@ -266,13 +381,92 @@ namespace jacoby
 			return z;
 		}
 
-		void clear()
+		constexpr void clear()
+		{
+			x = PrecType(0);
+			y = PrecType(0);
+			z = PrecType(0);
+		}
+
+	private:
+		PrecType ScaleToUnit(const PrecType& length2, std::true_type)
 		{
-			x = 0.0f;
-			y = 0.0f;
-			z = 0.0f;
+			PrecType inverse = InverseSqrt(length2);
+			x *= inverse;
+			y *= inverse;
+			z *= inverse;
+			return length2 * inverse;
+		}
+
+		PrecType ScaleToUnit(const PrecType& length2, std::false_type)
+		{
+			using std::sqrt;
+			PrecType length = sqrt(length2);
+			x /= length;
+			y /= length;
+			z /= length;
+			return length;
 		}
 	};
+
+	// =========== Expression operators ===============
+	template< typename Lhs, typename Rhs, typename PrecType >
+	constexpr VectorBinary< Lhs, Rhs, VectorAdd, PrecType > operator + (const VectorExpression< Lhs, PrecType >& lhs, const VectorExpression< Rhs, PrecType >& rhs)
+	{
+		return VectorBinary< Lhs, Rhs, VectorAdd, PrecType >(lhs.Self(), rhs.Self());
+	}
+
+	template< typename Lhs, typename Rhs, typename PrecType >
+	constexpr VectorBinary< Lhs, Rhs, VectorSubtract, PrecType > operator - (const VectorExpression< Lhs, PrecType >& lhs, const VectorExpression< Rhs, PrecType >& rhs)
+	{
+		return VectorBinary< Lhs, Rhs, VectorSubtract, PrecType >(lhs.Self(), rhs.Self());
+	}
+
+	template< typename Expr, typename PrecType >
+	constexpr VectorScalar< Expr, VectorMultiply, PrecType > operator - (const VectorExpression< Expr, PrecType >& vec)
+	{
+		return VectorScalar< Expr, VectorMultiply, PrecType >(vec.Self(), PrecType(-1));
+	}
+
+	// multiplication by number, the number is not deduced so that any arithmetic type converts
+	template< typename Expr, typename PrecType >
+	constexpr VectorScalar< Expr, VectorMultiply, PrecType > operator * (const VectorExpression< Expr, PrecType >& vec, const typename VectorExpression< Expr, PrecType >::ValueType& val)
+	{
+		return VectorScalar< Expr, VectorMultiply, PrecType >(vec.Self(), val);
+	}
+
+	template< typename Expr, typename PrecType >
+	constexpr VectorScalar< Expr, VectorMultiply, PrecType > operator * (const typename VectorExpression< Expr, PrecType >::ValueType& val, const VectorExpression< Expr, PrecType >& vec)
+	{
+		return VectorScalar< Expr, VectorMultiply, PrecType >(vec.Self(), val);
+	}
+
+	// division by number
+	template< typename Expr, typename PrecType >
+	constexpr VectorScalar< Expr, VectorDivide, PrecType > operator / (const VectorExpression< Expr, PrecType >& vec, const typename VectorExpression< Expr, PrecType >::ValueType& val)
+	{
+		return VectorScalar< Expr, VectorDivide, PrecType >(vec.Self(), val);
+	}
+
+	// scalar product
+	template< typename Lhs, typename Rhs, typename PrecType >
+	constexpr PrecType operator * (const VectorExpression< Lhs, PrecType >& lhs, const VectorExpression< Rhs, PrecType >& rhs)
+	{
+		return lhs.Self().X() * rhs.Self().X() + lhs.Self().Y() * rhs.Self().Y() + lhs.Self().Z() * rhs.Self().Z();
+	}
+
+	// vector product, evaluated at once - every component of the operands is read twice
+	template< typename Lhs, typename Rhs, typename PrecType >
+	constexpr Vector3< PrecType > operator % (const VectorExpression< Lhs, PrecType >& lhs, const VectorExpression< Rhs, PrecType >& rhs)
+	{
+		const Vector3< PrecType > l(lhs);
+		const Vector3< PrecType > r(rhs);
+		return Vector3< PrecType >(
+			l.Y() * r.Z() - l.Z() * r.Y(),
+			l.Z() * r.X() - l.X() * r.Z(),
+			l.X() * r.Y() - l.Y() * r.X()
+			);
+	}
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,319 @@
+#pragma once
+
+#ifndef FIXED_JACOBY
+#define FIXED_JACOBY
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/simd.h>
+#include <limits>
+
+namespace jacoby
+{
+	/*
+	* Integer helpers of the fixed point types. All of them are exact
+	* integer arithmetic, so that every machine computes the same bits;
+	* the 128 bit intermediates use the compiler type where there is one
+	* and 32 bit limbs otherwise, both give identical results.
+	*/
+
+	// floor(a * b / 2^shift), wrapped to 64 bits, shift < 64
+	inline LLONG FixedMulShift(LLONG a, LLONG b, unsigned shift)
+	{
+#if defined(__SIZEOF_INT128__)
+		return LLONG((__int128(a) * b) >> shift);
+#else
+		ULLONG ua = ULLONG(a), ub = ULLONG(b);
+		ULLONG a0 = ua & 0xffffffffull, a1 = ua >> 32;
+		ULLONG b0 = ub & 0xffffffffull, b1 = ub >> 32;
+		ULLONG p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+		ULLONG mid = (p00 >> 32) + (p01 & 0xffffffffull) + (p10 & 0xffffffffull);
+		ULLONG lo = (p00 & 0xffffffffull) | (mid << 32);
+		ULLONG hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+
+		// two's complement correction of the unsigned product
+		if (a < 0)
+			hi -= ub;
+		if (b < 0)
+			hi -= ua;
+
+		return shift == 0 ? LLONG(lo) : LLONG((lo >> shift) | (hi << (64 - shift)));
+#endif
+	}
+
+	// a * 2^shift / b rounded towards zero, saturated to 64 bits, also on b == 0
+	LLONG FixedDivShift(LLONG a, LLONG b, unsigned shift);
+
+	// floor(sqrt(value * 2^shift)), shift even, value * 2^shift below 2^96
+	ULLONG FixedSqrtShift(ULLONG value, unsigned shift);
+
+	// Q32.32 kernels behind the functions below, table driven
+	LLONG FixedSinQ32(LLONG angle);
+	LLONG FixedCosQ32(LLONG angle);
+	LLONG FixedExp2Q32(LLONG value);
+	LLONG FixedExpQ32(LLONG value);
+	LLONG FixedLog2Q32(LLONG value);
+
+	/*
+	* Signed fixed point number with FRACTION_BITS fraction bits, a
+	* deterministic stand-in for FLOAT as PrecType of Vector3, Particle
+	* and the force generators. Lockstep simulations on different CPUs
+	* stay bit-identical, as long as the inputs are.
+	* Converts implicitly from int and double (constants, setup), but
+	* never implicitly back, so that mixed expressions stay fixed point.
+	* Multiplication rounds down and wraps on overflow, division rounds
+	* towards zero and saturates, also on division by zero.
+	*/
+	template< typename IntType, unsigned FRACTION_BITS >
+	class FixedPoint
+	{
+		static_assert(FRACTION_BITS <= 32, "fixed point kernels work in Q32.32");
+
+	protected:
+		IntType m_raw;
+
+		// product and quotient at this width
+		static IntType Mul(IntType a, IntType b);
+		static IntType Div(IntType a, IntType b);
+
+	public:
+		typedef IntType RawType;
+
+		static constexpr unsigned Fraction() { return FRACTION_BITS; }
+
+		static constexpr IntType One() { return IntType(1) << FRACTION_BITS; }
+
+		constexpr FixedPoint() : m_raw(0) {}
+
+		constexpr FixedPoint(int value) : m_raw(IntType(value) * One()) {}
+
+		// rounds to nearest, only exact for IEEE doubles - fine for constants
+		constexpr FixedPoint(double value) :
+			m_raw(IntType(value * double(One()) + (value >= 0.0 ? 0.5 : -0.5)))
+		{}
+
+		static constexpr FixedPoint FromRaw(IntType raw)
+		{
+			FixedPoint out;
+			out.m_raw = raw;
+			return out;
+		}
+
+		constexpr IntType Raw() const { return m_raw; }
+
+		explicit constexpr operator double() const { return double(m_raw) / double(One()); }
+
+		constexpr FLOAT ToFloat() const { return FLOAT(double(*this)); }
+
+		// value in Q32.32, the format of the table kernels
+		constexpr LLONG ToQ32() const { return LLONG(m_raw) * (1ll << (32 - FRACTION_BITS)); }
+
+		// saturates what does not fit
+		static FixedPoint FromQ32(LLONG q)
+		{
+			LLONG raw = q >> (32 - FRACTION_BITS);
+			const LLONG high = std::numeric_limits< IntType >::max();
+			const LLONG low = std::numeric_limits< IntType >::min();
+			return FromRaw(IntType(raw > high ? high : raw < low ? low : raw));
+		}
+
+		FixedPoint operator - () const { return FromRaw(IntType(0) - m_raw); }
+
+		FixedPoint& operator += (const FixedPoint& r) { m_raw += r.m_raw; return *this; }
+		FixedPoint& operator -= (const FixedPoint& r) { m_raw -= r.m_raw; return *this; }
+		FixedPoint& operator *= (const FixedPoint& r) { m_raw = Mul(m_raw, r.m_raw); return *this; }
+		FixedPoint& operator /= (const FixedPoint& r) { m_raw = Div(m_raw, r.m_raw); return *this; }
+
+		friend FixedPoint operator + (const FixedPoint& l, const FixedPoint& r) { return FromRaw(l.m_raw + r.m_raw); }
+		friend FixedPoint operator - (const FixedPoint& l, const FixedPoint& r) { return FromRaw(l.m_raw - r.m_raw); }
+		friend FixedPoint operator * (const FixedPoint& l, const FixedPoint& r) { return FromRaw(Mul(l.m_raw, r.m_raw)); }
+		friend FixedPoint operator / (const FixedPoint& l, const FixedPoint& r) { return FromRaw(Div(l.m_raw, r.m_raw)); }
+
+		friend constexpr BOOL operator == (const FixedPoint& l, const FixedPoint& r) { return l.m_raw == r.m_raw; }
+		friend constexpr BOOL operator != (const FixedPoint& l, const FixedPoint& r) { return l.m_raw != r.m_raw; }
+		friend constexpr BOOL operator < (const FixedPoint& l, const FixedPoint& r) { return l.m_raw < r.m_raw; }
+		friend constexpr BOOL operator <= (const FixedPoint& l, const FixedPoint& r) { return l.m_raw <= r.m_raw; }
+		friend constexpr BOOL operator > (const FixedPoint& l, const FixedPoint& r) { return l.m_raw > r.m_raw; }
+		friend constexpr BOOL operator >= (const FixedPoint& l, const FixedPoint& r) { return l.m_raw >= r.m_raw; }
+	};
+
+	template<>
+	inline INT FixedPoint< INT, 16 >::Mul(INT a, INT b)
+	{
+		return INT((LLONG(a) * b) >> 16);
+	}
+
+	template<>
+	inline INT FixedPoint< INT, 16 >::Div(INT a, INT b)
+	{
+		LLONG quotient = FixedDivShift(a, b, 16);
+		return quotient > std::numeric_limits< INT >::max() ? std::numeric_limits< INT >::max()
+			: quotient < std::numeric_limits< INT >::min() ? std::numeric_limits< INT >::min() : INT(quotient);
+	}
+
+	template<>
+	inline LLONG FixedPoint< LLONG, 32 >::Mul(LLONG a, LLONG b)
+	{
+		return FixedMulShift(a, b, 32);
+	}
+
+	template<>
+	inline LLONG FixedPoint< LLONG, 32 >::Div(LLONG a, LLONG b)
+	{
+		return FixedDivShift(a, b, 32);
+	}
+
+	// Q16.16, range +-32768 - small scenes, SIMD friendly
+	typedef FixedPoint< INT, 16 > Fixed32;
+
+	// Q32.32, range +-2^31
+	typedef FixedPoint< LLONG, 32 > Fixed64;
+
+	/*
+	* Math functions picked up by argument dependent lookup, generic code
+	* calls them unqualified after using std::sqrt and friends.
+	* Trigonometry and exponentials interpolate tables, relative error
+	* is around 1e-7, far below the Fixed32 resolution.
+	*/
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > abs(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		return x < FixedPoint< IntType, FRACTION_BITS >() ? -x : x;
+	}
+
+	// negative values give zero
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > sqrt(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		if (x.Raw() <= 0)
+			return FixedPoint< IntType, FRACTION_BITS >();
+		return FixedPoint< IntType, FRACTION_BITS >::FromRaw(IntType(FixedSqrtShift(ULLONG(x.Raw()), FRACTION_BITS)));
+	}
+
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > sin(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		return FixedPoint< IntType, FRACTION_BITS >::FromQ32(FixedSinQ32(x.ToQ32()));
+	}
+
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > cos(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		return FixedPoint< IntType, FRACTION_BITS >::FromQ32(FixedCosQ32(x.ToQ32()));
+	}
+
+	// saturates on overflow
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > exp(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		return FixedPoint< IntType, FRACTION_BITS >::FromQ32(FixedExpQ32(x.ToQ32()));
+	}
+
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > exp2(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		return FixedPoint< IntType, FRACTION_BITS >::FromQ32(FixedExp2Q32(x.ToQ32()));
+	}
+
+	// non-positive values give the lowest representable value
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > log2(const FixedPoint< IntType, FRACTION_BITS >& x)
+	{
+		return FixedPoint< IntType, FRACTION_BITS >::FromQ32(FixedLog2Q32(x.ToQ32()));
+	}
+
+	// base has to be positive, zero gives zero
+	template< typename IntType, unsigned FRACTION_BITS >
+	FixedPoint< IntType, FRACTION_BITS > pow(const FixedPoint< IntType, FRACTION_BITS >& base, const FixedPoint< IntType, FRACTION_BITS >& exponent)
+	{
+		LLONG b = base.ToQ32();
+		if (b <= 0)
+			return FixedPoint< IntType, FRACTION_BITS >();
+		return FixedPoint< IntType, FRACTION_BITS >::FromQ32(FixedExp2Q32(FixedMulShift(exponent.ToQ32(), FixedLog2Q32(b), 32)));
+	}
+
+	/*
+	* Four Fixed32 lanes, the integer counterpart of Float4. The SSE2 path
+	* and the plain one produce the same bits as scalar Fixed32 math, so
+	* batched kernels may mix both freely without breaking lockstep.
+	*/
+	struct Fixed32x4
+	{
+#ifdef JACOBY_SSE
+		__m128i v;
+
+		Fixed32x4() : v(_mm_setzero_si128()) {}
+		Fixed32x4(__m128i v_) : v(v_) {}
+		explicit Fixed32x4(Fixed32 s) : v(_mm_set1_epi32(s.Raw())) {}
+
+		static Fixed32x4 Load(const Fixed32* p) { return Fixed32x4(_mm_loadu_si128(reinterpret_cast< const __m128i* >(p))); }
+		void Store(Fixed32* p) const { _mm_storeu_si128(reinterpret_cast< __m128i* >(p), v); }
+
+		Fixed32x4 operator + (const Fixed32x4& r) const { return Fixed32x4(_mm_add_epi32(v, r.v)); }
+		Fixed32x4 operator - (const Fixed32x4& r) const { return Fixed32x4(_mm_sub_epi32(v, r.v)); }
+
+		// bits 16..47 of the signed 64 bit products, SSE2 only has the unsigned multiply
+		Fixed32x4 operator * (const Fixed32x4& r) const
+		{
+			__m128i even = _mm_mul_epu32(v, r.v);
+			__m128i odd = _mm_mul_epu32(_mm_srli_epi64(v, 32), _mm_srli_epi64(r.v, 32));
+			__m128i fix = _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(v, 31), r.v), _mm_and_si128(_mm_srai_epi32(r.v, 31), v));
+			even = _mm_sub_epi32(even, _mm_slli_epi64(fix, 32));
+			odd = _mm_sub_epi32(odd, _mm_and_si128(fix, _mm_set_epi32(-1, 0, -1, 0)));
+			even = _mm_and_si128(_mm_srli_epi64(even, 16), _mm_set_epi32(0, -1, 0, -1));
+			odd = _mm_slli_epi64(_mm_srli_epi64(odd, 16), 32);
+			return Fixed32x4(_mm_or_si128(even, odd));
+		}
+
+		// division by two rounding towards zero, as Fixed32 / 2 does
+		Fixed32x4 Half() const
+		{
+			return Fixed32x4(_mm_srai_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 31)), 1));
+		}
+#else
+		INT v[4];
+
+		Fixed32x4() { v[0] = v[1] = v[2] = v[3] = 0; }
+		explicit Fixed32x4(Fixed32 s) { v[0] = v[1] = v[2] = v[3] = s.Raw(); }
+
+		static Fixed32x4 Load(const Fixed32* p)
+		{
+			Fixed32x4 out;
+			for (unsigned i = 0; i < 4; ++i)
+				out.v[i] = p[i].Raw();
+			return out;
+		}
+
+		void Store(Fixed32* p) const
+		{
+			for (unsigned i = 0; i < 4; ++i)
+				p[i] = Fixed32::FromRaw(v[i]);
+		}
+
+		template< typename Op >
+		static Fixed32x4 Apply(const Fixed32x4& a, const Fixed32x4& b, Op op)
+		{
+			Fixed32x4 out;
+			for (unsigned i = 0; i < 4; ++i)
+				out.v[i] = op(Fixed32::FromRaw(a.v[i]), Fixed32::FromRaw(b.v[i])).Raw();
+			return out;
+		}
+
+		Fixed32x4 operator + (const Fixed32x4& r) const { return Apply(*this, r, [](Fixed32 a, Fixed32 b) { return a + b; }); }
+		Fixed32x4 operator - (const Fixed32x4& r) const { return Apply(*this, r, [](Fixed32 a, Fixed32 b) { return a - b; }); }
+		Fixed32x4 operator * (const Fixed32x4& r) const { return Apply(*this, r, [](Fixed32 a, Fixed32 b) { return a * b; }); }
+
+		Fixed32x4 Half() const { return Apply(*this, *this, [](Fixed32 a, Fixed32) { return a / Fixed32(2); }); }
+#endif
+	};
+
+	/*
+	* Particle::Integrate over SoA Fixed32 arrays, four particles at a
+	* time: x += v dT + a dT^2 / 2, v = (v + a dT) * damping. damping is
+	* pow(particle damping, dT), shared by the batch. Bit-identical to
+	* Particle< Fixed32 >::Integrate with the same acceleration.
+	*/
+	void IntegrateFixed(Fixed32* position, Fixed32* velocity, const Fixed32* acceleration, unsigned count,
+		Fixed32 dT, Fixed32 damping);
+}
+
+#endif
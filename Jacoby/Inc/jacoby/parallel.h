@@ -0,0 +1,99 @@
+#ifndef PARALLEL_JACOBY
+#define PARALLEL_JACOBY
+
+#include <Inc/jacoby/types.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace jacoby
+{
+	typedef std::function< void(unsigned, unsigned) > RangeFunction;
+
+	/*
+	* Pool of worker threads shared by all parallel stages.
+	* Work is split into chunks of at most grain indices, which
+	* the calling thread and the workers take from a common counter.
+	* Nested calls from inside a job and calls with a single chunk
+	* run serially on the calling thread.
+	*/
+	class ThreadPool
+	{
+		std::vector< std::thread > m_workers;
+
+		std::mutex m_mutex;
+
+		std::mutex m_runMutex;
+
+		std::condition_variable m_wake;
+
+		std::condition_variable m_done;
+
+		const RangeFunction* m_body;
+
+		std::atomic< unsigned > m_next;
+
+		unsigned m_end;
+
+		unsigned m_grain;
+
+		unsigned m_generation;
+
+		unsigned m_busy;
+
+		BOOL m_stop;
+
+		void WorkerLoop(unsigned seenGeneration);
+
+		void Work();
+
+		void Start(unsigned workerCount);
+
+		void Stop();
+
+	public:
+		ThreadPool(unsigned threadCount);
+
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator = (const ThreadPool&) = delete;
+
+		// shared pool using all hardware threads
+		static ThreadPool& Instance();
+
+		// number of threads taking part in a job, including the caller
+		unsigned ThreadCount() const;
+
+		// 1 makes every job run serially
+		void SetThreadCount(unsigned threadCount);
+
+		// calls body(chunkBegin, chunkEnd) for chunks covering [begin, end)
+		void Run(unsigned begin, unsigned end, unsigned grain, const RangeFunction& body);
+	};
+
+	// calls func(i) for every i in [begin, end) using the shared pool
+	template< typename Func >
+	void ParallelFor(unsigned begin, unsigned end, unsigned grain, Func func)
+	{
+		RangeFunction body = [&func](unsigned chunkBegin, unsigned chunkEnd)
+		{
+			for (unsigned i = chunkBegin; i < chunkEnd; ++i)
+				func(i);
+		};
+		ThreadPool::Instance().Run(begin, end, grain, body);
+	}
+
+	// calls func(chunkBegin, chunkEnd) using the shared pool
+	template< typename Func >
+	void ParallelForRange(unsigned begin, unsigned end, unsigned grain, Func func)
+	{
+		RangeFunction body = func;
+		ThreadPool::Instance().Run(begin, end, grain, body);
+	}
+}
+
+#endif //PARALLEL_JACOBY
@@ -6,12 +6,43 @@
 #include <iostream>
 #include <Inc/jacoby/types.h>
 #include <Inc/jacoby/core.h>
+#include <Inc/jacoby/simd.h>
 
 #ifndef PARTICLE_JACOBY
 #define PARTICLE_JACOBY
 
 namespace jacoby
 {
+	/*
+	* Category of a particle
+	* Dynamic - integrated every step from accumulated forces
+	* Kinematic - moves with prescribed velocity, ignores forces
+	* Static - never moves
+	* Kinematic and static particles have zero inverse mass, so contact
+	* resolution treats them as infinitely heavy.
+	*/
+	enum class ParticleCategory
+	{
+		Dynamic,
+		Kinematic,
+		Static
+	};
+
+	/*
+	* Bits of the world fields a particle opts out of,
+	* see ParticleForceFields. Particles start with none set.
+	*/
+	struct ParticleField
+	{
+		enum : UINT
+		{
+			Gravity = 1 << 0,
+			Drag = 1 << 1,
+			Wind = 1 << 2,
+			All = Gravity | Drag | Wind
+		};
+	};
+
 	template< typename PrecType = FLOAT>
 	class Particle
 	{
@@ -27,6 +58,11 @@ namespace jacoby
 		PrecType m_damping;
 
 		VectorType m_forceAccumulator;
+
+		ParticleCategory m_category;
+
+		// ParticleField bits
+		UINT m_fieldOptOut;
 	public:
 		// default constructor
 		Particle() :
@@ -34,33 +70,26 @@ namespace jacoby
 			m_velocity(VectorType()),
 			m_acceleration(VectorType()),
 			m_inverseMass(PrecType(1.0)),
-			m_damping(PrecType(0.999))
+			m_damping(PrecType(0.999)),
+			m_category(ParticleCategory::Dynamic),
+			m_fieldOptOut(0)
 		{};
 
 		// constructor from PrecType
 		Particle(const VectorType& pos_,
 			const VectorType& vel_ = VectorType(),
 			const VectorType& acc_ = VectorType(),
-			const FLOAT& invM_ = PrecType(1.0),
-			const FLOAT& damp_ = PrecType(0.999)
+			const PrecType& invM_ = PrecType(1.0),
+			const PrecType& damp_ = PrecType(0.999)
 		) :
 			m_position(pos_),
 			m_velocity(vel_),
-			m_acceleration(acc_)
+			m_acceleration(acc_),
+			m_fieldOptOut(0)
 		{
-			if (invM_ != PrecType(0.0))
-			{
-				m_inverseMass = invM_;
-			}
-			else
-			{
-				if (sizeof(PrecType) == 32)
-					m_inverseMass = PrecType(std::nextafterf(0.0, 1.0));
-				else if (sizeof(PrecType) == 64)
-					m_inverseMass = std::nextafter(0.0, 1.0);
-				else
-					throw;
-			}
+			// zero inverse mass means infinite mass - such particle is kinematic
+			m_inverseMass = invM_;
+			m_category = (invM_ != PrecType(0.0)) ? ParticleCategory::Dynamic : ParticleCategory::Kinematic;
 			if (damp_ < PrecType(1.0) && damp_ > PrecType(0.0))
 			{
 				m_damping = damp_;
@@ -75,26 +104,17 @@ namespace jacoby
 		Particle(const VectorType&& pos_,
 			const VectorType&& vel_ = VectorType(),
 			const VectorType&& acc_ = VectorType(),
-			const FLOAT&& invM_ = 1.0,
-			const FLOAT&& damp_ = 0.999
+			const PrecType&& invM_ = PrecType(1.0),
+			const PrecType&& damp_ = PrecType(0.999)
 		) :
 			m_position(std::move(pos_)),
 			m_velocity(std::move(vel_)),
-			m_acceleration(std::move(acc_))
+			m_acceleration(std::move(acc_)),
+			m_fieldOptOut(0)
 		{
-			if (invM_ != PrecType(0.0))
-			{
-				m_inverseMass = std::move(invM_);
-			}
-			else
-			{
-				if (sizeof(PrecType) == 32)
-					m_inverseMass = PrecType(std::nextafterf(0.0, 1.0));
-				else if (sizeof(PrecType) == 64)
-					m_inverseMass = std::nextafter(0.0, 1.0);
-				else
-					throw std::_Xruntime_error("Wrong size of FLOAT");
-			}
+			// zero inverse mass means infinite mass - such particle is kinematic
+			m_inverseMass = std::move(invM_);
+			m_category = (invM_ != PrecType(0.0)) ? ParticleCategory::Dynamic : ParticleCategory::Kinematic;
 			if (damp_ < PrecType(1.0) && damp_ > PrecType(0.0))
 			{
 				m_damping = (std::move(damp_));
@@ -195,6 +215,20 @@ namespace jacoby
 		VectorType Integrate(const PrecType& dT)
 		{
 			assert(dT > 0);
+			if (m_category != ParticleCategory::Dynamic)
+				return IntegrateKinematic(dT);
+
+			using std::pow;
+			return Integrate(dT, pow(m_damping, dT));
+		}
+
+		// dampingFactor is pow(damping, dT), for callers that compute it in batches
+		VectorType Integrate(const PrecType& dT, const PrecType& dampingFactor)
+		{
+			assert(dT > 0);
+			if (m_category != ParticleCategory::Dynamic)
+				return IntegrateKinematic(dT);
+
 			if (UpdateAcceleration())
 			{
 				m_position += m_velocity * dT + m_acceleration * dT * dT / PrecType(2.0);
@@ -204,7 +238,18 @@ namespace jacoby
 			{
 				m_position += m_velocity * dT;
 			}
-			m_velocity = m_velocity * std::powf(m_damping, dT);
+			m_velocity = m_velocity * dampingFactor;
+
+			ClearAccumulator();
+
+			return m_position;
+		}
+
+		// kinematic and static particles only follow their velocity
+		VectorType IntegrateKinematic(const PrecType& dT)
+		{
+			if (m_category == ParticleCategory::Kinematic)
+				m_position.AddScaledVector(m_velocity, dT);
 
 			ClearAccumulator();
 
@@ -216,7 +261,7 @@ namespace jacoby
 			return PrecType(1.) / m_inverseMass;
 		}
 
-		PrecType SetMass(const PrecType& newMass) const
+		PrecType SetMass(const PrecType& newMass)
 		{
 			if (newMass != PrecType(0.0))
 			{
@@ -235,23 +280,65 @@ namespace jacoby
 			return m_inverseMass;
 		}
 
-		PrecType SetInverseMass(const PrecType& newInvMass) const
+		// zero inverse mass turns a dynamic particle into a kinematic one
+		PrecType SetInverseMass(const PrecType& newInvMass)
 		{
-			if (newInvMass != PrecType(0.0))
-			{
-				m_inverseMass = newInvMass;
-				return m_inverseMass;
-			}
-			else
-			{
-				if (sizeof(PrecType) == 32)
-					m_inverseMass = PrecType(std::nextafterf(0.0, 1.0));
-				else if (sizeof(PrecType) == 64)
-					m_inverseMass = std::nextafter(0.0, 1.0);
-				else
-					throw std::_Xruntime_error("Wrong size of FLOAT");
+			m_inverseMass = newInvMass;
+			if (newInvMass == PrecType(0.0) && m_category == ParticleCategory::Dynamic)
+				m_category = ParticleCategory::Kinematic;
+			return m_inverseMass;
+		}
 
-			}
+		// category
+		ParticleCategory Category() const
+		{
+			return m_category;
+		}
+
+		BOOL IsDynamic() const
+		{
+			return m_category == ParticleCategory::Dynamic;
+		}
+
+		// particle that never moves and has infinite mass
+		void MakeStatic()
+		{
+			m_category = ParticleCategory::Static;
+			m_inverseMass = PrecType(0.0);
+			m_velocity.clear();
+			m_acceleration.clear();
+			ClearAccumulator();
+		}
+
+		// particle with infinite mass that moves with given velocity
+		void MakeKinematic(const VectorType& vel)
+		{
+			m_category = ParticleCategory::Kinematic;
+			m_inverseMass = PrecType(0.0);
+			m_velocity = vel;
+			m_acceleration.clear();
+			ClearAccumulator();
+		}
+
+		void MakeDynamic(const PrecType& invMass)
+		{
+			if (invMass <= PrecType(0.0))
+				throw std::_Xruntime_error("Dynamic particle needs positive inverse mass");
+
+			m_category = ParticleCategory::Dynamic;
+			m_inverseMass = invMass;
+		}
+
+		// world fields this particle ignores, ParticleField bits
+		UINT FieldOptOut() const
+		{
+			return m_fieldOptOut;
+		}
+
+		UINT SetFieldOptOut(UINT fields)
+		{
+			m_fieldOptOut = fields;
+			return m_fieldOptOut;
 		}
 
 		PrecType& GetInverseMass()
@@ -284,6 +371,11 @@ namespace jacoby
 			return m_damping;
 		}
 
+		const VectorType& GetForceAccumulator() const
+		{
+			return m_forceAccumulator;
+		}
+
 		void ClearAccumulator()
 		{
 			m_forceAccumulator.clear();
@@ -294,6 +386,68 @@ namespace jacoby
 			m_forceAccumulator += forceToAdd;
 		}
 	};
+
+	/*
+	* pow(damping, dT) of count particles, zero for damping <= 0.
+	* FLOAT particles go through the SIMD Pow four at a time, runs of
+	* particles sharing the damping of the last batch reuse its factor.
+	*/
+	template< typename PrecType >
+	void DampingFactors(const Particle< PrecType >* particles, unsigned count, const PrecType& dT, PrecType* factors)
+	{
+		using std::pow;
+		for (unsigned i = 0; i < count; ++i)
+			factors[i] = particles[i].Damping() > PrecType(0.0) ? pow(particles[i].Damping(), dT) : PrecType(0.0);
+	}
+
+	template<>
+	inline void DampingFactors(const Particle< FLOAT >* particles, unsigned count, const FLOAT& dT, FLOAT* factors)
+	{
+		const Float4 exponent(dT);
+		FLOAT lastDamping = 0.0f;
+		FLOAT lastFactor = 0.0f;
+		for (unsigned i = 0; i < count; i += 4)
+		{
+			// the tail is padded with the first lane
+			const unsigned lanes = count - i < 4 ? count - i : 4;
+			FLOAT damping[4];
+			for (unsigned j = 0; j < 4; ++j)
+				damping[j] = particles[i + (j < lanes ? j : 0)].Damping();
+
+			const BOOL uniform = damping[1] == damping[0] && damping[2] == damping[0] && damping[3] == damping[0];
+			if (!uniform || damping[0] != lastDamping)
+			{
+				Float4 base = Float4::Load(damping);
+				FLOAT out[4];
+				Select(base > Float4(0.0f), Pow(base, exponent), Float4()).Store(out);
+				if (!uniform)
+				{
+					for (unsigned j = 0; j < lanes; ++j)
+						factors[i + j] = out[j];
+					continue;
+				}
+				lastDamping = damping[0];
+				lastFactor = out[0];
+			}
+			for (unsigned j = 0; j < lanes; ++j)
+				factors[i + j] = lastFactor;
+		}
+	}
+
+	// Particle::Integrate over an array, damping factors are batched
+	template< typename PrecType >
+	void IntegrateParticles(Particle< PrecType >* particles, unsigned count, const PrecType& dT)
+	{
+		const unsigned BATCH = 64;
+		PrecType factors[BATCH];
+		for (unsigned first = 0; first < count; first += BATCH)
+		{
+			const unsigned size = count - first < BATCH ? count - first : BATCH;
+			DampingFactors(particles + first, size, dT, factors);
+			for (unsigned i = 0; i < size; ++i)
+				particles[first + i].Integrate(dT, factors[i]);
+		}
+	}
 }
 
 #endif //PARTICLE_JACOBY
\ No newline at end of file
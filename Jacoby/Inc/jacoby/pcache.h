@@ -0,0 +1,66 @@
+#ifndef PARTICLE_CONTACT_CACHE
+#define PARTICLE_CONTACT_CACHE
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/pcontacts.h>
+#include <Inc/jacoby/ppool.h>
+#include <vector>
+
+namespace jacoby
+{
+	/*
+	* Remembers impulses of the last resolution, keyed by particle pair,
+	* generator and feature, and hands them to the matching contacts of the next
+	* step as a warm start. Resting contacts then start close to their
+	* solution and the resolver only has to correct what changed.
+	* The cache is rebuilt from scratch by every Store(), so contacts that
+	* disappeared for one step are forgotten.
+	*/
+	class ParticleContactCache
+	{
+	protected:
+		struct Entry
+		{
+			ParticleType* p_particle[2];
+			unsigned generator;
+			unsigned feature;
+			FLOAT impulse;
+			VectorType normal;
+		};
+
+		std::vector< Entry > m_entries;
+
+		// fraction of the cached impulse used as a warm start
+		FLOAT m_warmFactor;
+
+		// minimal cosine between the cached and the current normal
+		FLOAT m_normalTolerance;
+
+		unsigned m_hits;
+
+		static BOOL Less(const Entry& lhs, const Entry& rhs);
+
+	public:
+		ParticleContactCache(FLOAT warmFactor = 1.0f, FLOAT normalTolerance = 0.95f);
+
+		void SetWarmFactor(FLOAT warmFactor);
+
+		// sets m_warmImpulse of all contacts, returns number of contacts found in the cache
+		unsigned WarmStart(ParticleContact* contacts, unsigned count);
+
+		// replaces cached impulses with the ones from just resolved contacts
+		void Store(const ParticleContact* contacts, unsigned count);
+
+		// keeps keys valid while a pool compacts, entries of killed particles are dropped
+		void Relocate(const ParticleRelocationMap< FLOAT >& relocations);
+
+		void Clear();
+
+		unsigned Size() const;
+
+		// contacts matched by the last WarmStart
+		unsigned Hits() const;
+	};
+}
+
+#endif //PARTICLE_CONTACT_CACHE
@@ -0,0 +1,98 @@
+#ifndef PARTICLE_CCD
+#define PARTICLE_CCD
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pcontacts.h>
+#include <Inc/jacoby/pcollide.h>
+#include <Inc/jacoby/world.h>
+#include <vector>
+
+namespace jacoby
+{
+	/*
+	* Continuous collision of fast particles against static geometry.
+	* Positions are recorded before integration, particles that moved
+	* further than the threshold are swept from the recorded position
+	* to the integrated one by conservative advancement on the shapes'
+	* sweep queries, which leave out features the particle slides along
+	* or moves away from, so a particle resting on a floor is still
+	* stopped by a wall. A particle that hits something is put back at its
+	* time of impact, the rest of its step is dropped, and a contact with
+	* the hit shape is generated there. Slow particles are left to the
+	* discrete generators, so the step size only has to suit them.
+	* Sweeping has to happen before the discrete generators gather
+	* positions, Attach() takes care of that.
+	*/
+	class ParticleSweptContacts : public ParticleContactGenerator
+	{
+	protected:
+		struct Hit
+		{
+			unsigned particle;
+			VectorType normal;
+			FLOAT penetration;
+			FLOAT restitution;
+
+			// contact key of the hit shape, so that swept and discrete contacts share warm starts
+			unsigned generator;
+			unsigned feature;
+		};
+
+		std::vector< ParticleType >* m_particles;
+
+		std::vector< ParticleStaticContacts* > m_shapes;
+
+		std::vector< VectorType > m_previous;
+
+		std::vector< Hit > m_hits;
+
+		FLOAT m_radius;
+
+		// squared displacement per step above which a particle is swept
+		FLOAT m_threshold2;
+
+		unsigned m_maxIterations;
+
+		unsigned m_swept;
+
+		/*
+		* Earliest time of impact along from -> to as a fraction of the path,
+		* false if the sphere gets through. Features it touches at the start
+		* are left to the discrete contacts. Running out of iterations counts
+		* as a hit at the point reached.
+		*/
+		BOOL Sweep(const VectorType& from, const VectorType& to, FLOAT& toi, Hit& hit);
+
+	public:
+		// threshold 0 sweeps particles that moved further than their radius
+		ParticleSweptContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT threshold = 0.0f);
+
+		void AddShapes(ParticleStaticContacts* shapes);
+
+		void RemoveShapes(ParticleStaticContacts* shapes);
+
+		void SetThreshold(FLOAT threshold);
+
+		// limit of advancement steps per particle, grazing paths take the most
+		void SetMaxIterations(unsigned iterations);
+
+		// positions at the start of the step
+		void Record();
+
+		// moves particles that hit something back to their time of impact
+		void SweepAll();
+
+		// records after forces, sweeps after integration, generates with the world's contacts
+		void Attach(World& world);
+
+		virtual unsigned AddContact(ParticleContact* contact, unsigned limit);
+
+		// particles swept and particles stopped in the last step
+		unsigned SweptCount() const;
+
+		unsigned HitCount() const;
+	};
+}
+
+#endif //PARTICLE_CCD
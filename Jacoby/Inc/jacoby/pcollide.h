@@ -0,0 +1,173 @@
+#ifndef PARTICLE_COLLIDE
+#define PARTICLE_COLLIDE
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pcontacts.h>
+#include <vector>
+
+namespace jacoby
+{
+	// sphere moving along a straight path, see ParticleStaticContacts::SweepStep
+	struct SweepQuery
+	{
+		VectorType start;		// where the path starts
+		VectorType point;		// current position on the path
+		VectorType direction;	// unit direction of the path
+		FLOAT radius;
+		FLOAT tolerance;		// features closer than this to start are left out
+	};
+
+	struct SweepResult
+	{
+		// how far the sphere can move from point, lowered by every query
+		FLOAT step;
+
+		// gap, outward normal and feature of the feature that set step
+		FLOAT gap;
+		VectorType normal;
+		unsigned feature;
+		BOOL limited;
+
+		SweepResult(FLOAT maxStep) : step(maxStep), gap(MAX_FLOAT), feature(0), limited(false) {}
+
+		/*
+		* Path length before the sphere can touch a convex feature with the
+		* given gap and outward normal at point, MAX_FLOAT if it moves along
+		* or away from it. The feature lies behind its supporting plane at
+		* the closest point, which the sphere reaches after gap / approach.
+		*/
+		static FLOAT Advance(const SweepQuery& query, FLOAT gap, const VectorType& normal)
+		{
+			const FLOAT approach = -(normal * query.direction);
+			if (approach <= 0.0f)
+				return MAX_FLOAT;
+			return gap > 0.0f ? gap / approach : 0.0f;
+		}
+
+		void Limit(FLOAT advance, FLOAT limitGap, const VectorType& limitNormal, unsigned limitFeature)
+		{
+			step = advance;
+			gap = limitGap;
+			normal = limitNormal;
+			feature = limitFeature;
+			limited = true;
+		}
+	};
+
+	/*
+	* Shared part of generators testing a whole particle array against
+	* static geometry. Particles are spheres of one radius, positions are
+	* gathered into padded SoA arrays so that shapes are tested four
+	* particles at a time, and the bounds of the array let whole shapes be
+	* skipped. Particles with infinite mass are left out.
+	* Contacts go against ParticleContact::Immovable().
+	*/
+	class ParticleStaticContacts : public ParticleContactGenerator
+	{
+	protected:
+		std::vector< ParticleType >* m_particles;
+
+		FLOAT m_radius;
+
+		FLOAT m_restitution;
+
+		std::vector< FLOAT > m_x;
+		std::vector< FLOAT > m_y;
+		std::vector< FLOAT > m_z;
+
+		// bounds of gathered positions, not expanded by the radius
+		VectorType m_min;
+		VectorType m_max;
+
+		// returns the padded size, zero if there is nothing to test
+		unsigned Gather();
+
+		void WriteContact(ParticleContact& contact, unsigned particle, VectorType normal, FLOAT penetration, unsigned shape);
+
+	public:
+		ParticleStaticContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT restitution);
+
+		void SetRadius(FLOAT radius);
+
+		void SetRestitution(FLOAT restitution);
+
+		FLOAT GetRestitution() const;
+
+		/*
+		* Conservative advancement step of continuous collision. Lowers
+		* result.step to the path length the sphere can move before it may
+		* touch a feature, judged per feature with SweepResult::Advance, so
+		* that features it slides along or moves away from do not hold it
+		* back. Features within query.tolerance of the path start are left
+		* to the discrete contacts.
+		*/
+		virtual void SweepStep(const SweepQuery& query, SweepResult& result) = 0;
+	};
+
+	/*
+	* Half-spaces n * x <= offset are solid, n has to be normalized.
+	*/
+	class ParticlePlaneContacts : public ParticleStaticContacts
+	{
+	protected:
+		struct Plane
+		{
+			VectorType normal;
+			FLOAT offset;
+		};
+
+		std::vector< Plane > m_planes;
+
+	public:
+		ParticlePlaneContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT restitution = 0.0f);
+
+		// returns index of the plane, used as its contact feature
+		unsigned AddPlane(const VectorType& normal, FLOAT offset);
+
+		void Clear();
+
+		virtual unsigned AddContact(ParticleContact* contact, unsigned limit);
+
+		virtual void SweepStep(const SweepQuery& query, SweepResult& result);
+	};
+
+	/*
+	* Solid boxes, axis-aligned or oriented by three orthonormal axes.
+	*/
+	class ParticleBoxContacts : public ParticleStaticContacts
+	{
+	protected:
+		struct Box
+		{
+			VectorType center;
+			VectorType axis[3];
+			FLOAT halfSize[3];
+
+			// half size of the world-space bounding box
+			VectorType extent;
+		};
+
+		std::vector< Box > m_boxes;
+
+		// signed distance of point to the box surface and the outward normal there
+		static FLOAT BoxDistance(const Box& box, const VectorType& point, VectorType& normal);
+
+	public:
+		ParticleBoxContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT restitution = 0.0f);
+
+		// returns index of the box, used as its contact feature
+		unsigned AddBox(const VectorType& center, const VectorType& halfSize);
+
+		unsigned AddOrientedBox(const VectorType& center, const VectorType& halfSize,
+			const VectorType& axisX, const VectorType& axisY, const VectorType& axisZ);
+
+		void Clear();
+
+		virtual unsigned AddContact(ParticleContact* contact, unsigned limit);
+
+		virtual void SweepStep(const SweepQuery& query, SweepResult& result);
+	};
+}
+
+#endif //PARTICLE_COLLIDE
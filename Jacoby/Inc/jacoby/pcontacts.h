@@ -5,47 +5,166 @@
 
 namespace jacoby
 {
-	typedef Particle<FLOAT> ParticleType;
-	typedef Vector3< FLOAT > VectorType;
-
-	class ParticleContact
+	/*
+	* Contacts and the resolver are templates on precision, instantiated
+	* for FLOAT and DOUBLE in pcontacts.cpp. The FLOAT ones keep their plain
+	* names through the typedefs at the end of this file.
+	*/
+	template< typename PrecType >
+	class BasicParticleContactResolver;
+
+	template< typename PrecType = FLOAT >
+	class BasicParticleContact
 	{
 	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+
+		// contacts against the world should use Immovable() as the second
+		// particle instead of nullptr - resolver normalizes nullptr to it
 		ParticleType* m_particle[2];
 
-		FLOAT m_restitution;
+		PrecType m_restitution;
 
 		VectorType m_contactNormal;
 
+		// depth along the normal, non-positive values need no separation
+		PrecType m_penetration;
+
+		// GeneratorId() of the generator that wrote the contact, every
+		// generator should set it, the contact cache keys on it
+		unsigned m_generator;
+
+		// distinguishes several contacts of the same pair (e.g. plane index)
+		// within one generator, generators producing more than one contact
+		// per pair should set it
+		unsigned m_feature;
+
+		// impulse applied before iterating, the resolver may take it back
+		// if it turns out too large and consumes it afterwards
+		PrecType m_warmImpulse;
+
+		// total impulse applied by the last resolution (warm start included)
+		PrecType m_accumulatedImpulse;
+
+		BasicParticleContact();
+
+		// shared static particle with infinite mass
+		static ParticleType* Immovable();
+
 	protected:
-		void Resolve(FLOAT dT);
+		void Resolve(PrecType dT);
 
-		FLOAT CalculateSeparatingVelocity() const;
+		PrecType CalculateSeparatingVelocity() const;
 
 	private:
-		void ResolveVelocity(FLOAT dT);
+		// movement applied by the last interpenetration resolution
+		VectorType m_particleMovement[2];
 
-		FLOAT m_penetration;
+		void ResolveVelocity(PrecType dT);
 
-		void ResolveInterpenetration(FLOAT dT);
+		void ResolveInterpenetration(PrecType dT);
 
-		friend class ParticleContactResolver;
+		// applies m_warmImpulse before the resolver iterates
+		void ApplyWarmImpulse();
+
+		// changes velocities along the normal and accumulates the impulse
+		void ApplyImpulse(PrecType impulse);
+
+		friend class BasicParticleContactResolver< PrecType >;
 	};
 
-	class ParticleContactResolver
+	// distinct for every call, never 0
+	unsigned NextContactGeneratorId();
+
+	/*
+	* Interface for anything that detects contacts,
+	* writes at most limit contacts and returns how many were written.
+	* Every instance, copies included, gets its own id, so that feature
+	* numbers of different generators never mix up in the contact cache.
+	*/
+	template< typename PrecType = FLOAT >
+	class BasicParticleContactGenerator
 	{
+	protected:
+		unsigned m_generatorId;
+
+	public:
+		BasicParticleContactGenerator() : m_generatorId(NextContactGeneratorId()) {}
+
+		BasicParticleContactGenerator(const BasicParticleContactGenerator&) : m_generatorId(NextContactGeneratorId()) {}
+
+		BasicParticleContactGenerator& operator = (const BasicParticleContactGenerator&) { return *this; }
+
+		unsigned GeneratorId() const { return m_generatorId; }
+
+		virtual unsigned AddContact(BasicParticleContact< PrecType >* contact, unsigned limit) = 0;
+	};
+
+	/*
+	* Resolves contacts one at a time, always the worst one first.
+	* Stops after the iteration limit, when no contact violates the
+	* tolerances anymore, or when the time budget runs out - whichever
+	* comes first. What is left unresolved is reported as the residual.
+	*/
+	template< typename PrecType = FLOAT >
+	class BasicParticleContactResolver
+	{
+	public:
+		typedef BasicParticleContact< PrecType > ContactType;
+
 	protected:
 		unsigned m_iter;
 
 		unsigned m_iterUsed;
 
+		// violations up to these are treated as resolved
+		PrecType m_velocityTolerance;
+
+		PrecType m_penetrationTolerance;
+
+		// seconds of wall time per ResolveContacts, non-positive means no limit
+		PrecType m_timeBudget;
+
+		// worst approaching velocity and penetration left after the last resolution
+		PrecType m_velocityResidual;
+
+		PrecType m_penetrationResidual;
+
+		BOOL m_budgetExceeded;
+
+		void MeasureResidual(ContactType* contactArray, unsigned numContacts);
+
 	public:
-		ParticleContactResolver(unsigned iter);
+		BasicParticleContactResolver(unsigned iter);
 
 		void SetIterations(unsigned iter);
 
-		void ResolveContacts(ParticleContact* contactArray,
+		unsigned IterationsUsed() const;
+
+		void SetTolerance(PrecType velocityTolerance, PrecType penetrationTolerance);
+
+		void SetTimeBudget(PrecType seconds);
+
+		PrecType VelocityResidual() const;
+
+		PrecType PenetrationResidual() const;
+
+		// true if all contacts are within tolerances after the last resolution
+		BOOL Converged() const;
+
+		// true if the last resolution was cut short by the time budget
+		BOOL BudgetExceeded() const;
+
+		void ResolveContacts(ContactType* contactArray,
 			unsigned numContacts,
-			FLOAT dT);
+			PrecType dT);
 	};
-}
\ No newline at end of file
+
+	typedef Particle<FLOAT> ParticleType;
+	typedef Vector3< FLOAT > VectorType;
+
+	typedef BasicParticleContact< FLOAT > ParticleContact;
+	typedef BasicParticleContactGenerator< FLOAT > ParticleContactGenerator;
+	typedef BasicParticleContactResolver< FLOAT > ParticleContactResolver;
+}
@@ -0,0 +1,79 @@
+#ifndef PARTICLE_EMITTER
+#define PARTICLE_EMITTER
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/ppool.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+#include <random>
+
+namespace jacoby
+{
+	/*
+	* Spawns particles into a pool, continuously (rate) or in bursts.
+	* Aging and compaction of the pool are left to its owner, so that
+	* several emitters can share one pool. Force generators added to the
+	* emitter are registered for every spawned particle - the force manager
+	* should Track() the pool to keep these registrations valid.
+	*/
+	class ParticleEmitter
+	{
+	protected:
+		ParticlePool< FLOAT >* m_pool;
+
+		ParticleForceManager* m_forceManager;
+
+		std::vector< ParticleForceGenerator* > m_generators;
+
+		ParticleType m_prototype;
+
+		VectorType m_position;
+
+		VectorType m_positionSpread;
+
+		VectorType m_velocity;
+
+		VectorType m_velocitySpread;
+
+		FLOAT m_lifetime;
+
+		FLOAT m_lifetimeSpread;
+
+		// particles per second and fraction of particle left from last update
+		FLOAT m_rate;
+
+		FLOAT m_carry;
+
+		std::mt19937 m_random;
+
+	public:
+		ParticleEmitter(ParticlePool< FLOAT >* pool, ParticleForceManager* forceManager = nullptr);
+
+		void SetPrototype(const ParticleType& prototype);
+
+		void SetPosition(const VectorType& position, const VectorType& spread = VectorType());
+
+		void SetVelocity(const VectorType& velocity, const VectorType& spread = VectorType());
+
+		/*
+		* Lifetime of every particle is drawn from lifetime +- spread and
+		* kept above 1% of lifetime, so that a spread as large as the
+		* lifetime never yields the pool's non-positive "lives forever".
+		* Non-positive lifetime emits immortal particles, spread is ignored.
+		*/
+		void SetLifetime(FLOAT lifetime, FLOAT spread = 0.0f);
+
+		void SetRate(FLOAT rate);
+
+		void AddForce(ParticleForceGenerator* fg);
+
+		// spawns up to count particles at once, returns number spawned
+		unsigned Emit(unsigned count);
+
+		// spawns particles according to the rate
+		unsigned Update(FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_EMITTER
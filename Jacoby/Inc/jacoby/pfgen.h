@@ -3,20 +3,47 @@
 
 #include <Inc/jacoby/types.h>
 #include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/ppool.h>
 #include <vector>
+#include <functional>
 
 namespace jacoby
 {
-	typedef Particle<FLOAT> ParticleType;
-	typedef Vector3< FLOAT > VectorType;
+	/*
+	* Force generators and their manager are templates on precision,
+	* instantiated for FLOAT and DOUBLE in pfgen.cpp. The FLOAT ones keep
+	* their plain names through the typedefs at the end of this file.
+	*/
 
 	/*
 	* Template for different force types
 	*/
-	class ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleForceGenerator
 	{
 	public:
-		virtual void UpdateForce(ParticleType*, FLOAT) = 0;
+		typedef Particle< PrecType > ParticleType;
+		typedef ParticleRelocationMap< PrecType > RelocationMapType;
+
+		virtual void UpdateForce(ParticleType*, PrecType) = 0;
+
+		// generators that keep pointers to other particles fix them up here
+		// (once per relocation batch),
+		// returning false when a particle they depend on was killed
+		virtual BOOL Relocate(const RelocationMapType&) { return true; }
+	};
+
+	/*
+	* Template for forces computed for a whole array of particles at once,
+	* e.g. long-range interactions where every particle depends on all others
+	*/
+	template< typename PrecType = FLOAT >
+	class BasicParticleBatchForceGenerator
+	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, PrecType dT) = 0;
 	};
 
 	/*
@@ -24,143 +51,258 @@ namespace jacoby
 	* on which they act
 	TODO - make it a singleton
 	*/
-	class ParticleForceManager
+	template< typename PrecType = FLOAT >
+	class BasicParticleForceManager
 	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef ParticleRelocationMap< PrecType > RelocationMapType;
+		typedef BasicParticleForceGenerator< PrecType > GeneratorType;
+		typedef BasicParticleBatchForceGenerator< PrecType > BatchGeneratorType;
+
 	protected:
 		struct ParticleForceRegistration
 		{
 			ParticleType* p_particle;
-			ParticleForceGenerator* p_fg;
+			GeneratorType* p_fg;
 		};
 
 		typedef std::vector<ParticleForceRegistration> RegistryType;
 		RegistryType m_registry;
 
+		// batch generators act on the whole vector, whatever its current size
+		struct ParticleBatchRegistration
+		{
+			std::vector< ParticleType >* p_particles;
+			BatchGeneratorType* p_fg;
+		};
+
+		typedef std::vector<ParticleBatchRegistration> BatchRegistryType;
+		BatchRegistryType m_batchRegistry;
+
 	public:
-		void Add(ParticleType* particle, ParticleForceGenerator* fg);
+		void Add(ParticleType* particle, GeneratorType* fg);
+
+		void Remove(ParticleType* particle, GeneratorType* fg);
 
-		void Remove(ParticleType* particle, ParticleForceGenerator* fg);
+		void AddBatch(std::vector< ParticleType >* particles, BatchGeneratorType* fg);
+
+		void RemoveBatch(std::vector< ParticleType >* particles, BatchGeneratorType* fg);
 
 		void Clear();
 
-		void UpdateForces(FLOAT dT);
+		typedef std::function< PrecType(const ParticleType*) > StepFunction;
+
+		void UpdateForces(PrecType dT);
+
+		// per particle generators only, each registration is updated with
+		// the step of its particle, particles with zero step are skipped
+		void UpdateForces(const StepFunction& stepOf);
+
+		// batch generators only
+		void UpdateBatchForces(PrecType dT);
+
+		// applies a batch of address changes in one pass over the registry,
+		// registrations of killed particles are dropped
+		void Relocate(const RelocationMapType& relocations);
+
+		// keeps registrations valid while the pool compacts
+		void Track(ParticlePool< PrecType >* pool);
 	};
 
-	class ParticleGravity : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleGravity : public BasicParticleForceGenerator< PrecType >
 	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+
+	protected:
 		VectorType m_gravity;
 
 	public:
-		ParticleGravity(const VectorType& gravity);
+		BasicParticleGravity(const VectorType& gravity);
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
 	};
 
-	class ParticleDrag : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleDrag : public BasicParticleForceGenerator< PrecType >
 	{
-		FLOAT m_k1, m_k2;
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+
+	protected:
+		PrecType m_k1, m_k2;
 
 	public:
-		ParticleDrag(FLOAT k1, FLOAT k2) : m_k1(k1), m_k2(k2) {};
+		BasicParticleDrag(PrecType k1, PrecType k2) : m_k1(k1), m_k2(k2) {};
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
 	};
 
-	class ParticleSpring : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleSpring : public BasicParticleForceGenerator< PrecType >
 	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+		typedef ParticleRelocationMap< PrecType > RelocationMapType;
+
+	protected:
 		ParticleType* m_other;
 
-		FLOAT m_springConstant;
+		PrecType m_springConstant;
 
-		FLOAT m_restLength;
+		PrecType m_restLength;
 
 	public:
-		ParticleSpring(ParticleType* other, FLOAT springConstant, FLOAT restLength) :
+		BasicParticleSpring(ParticleType* other, PrecType springConstant, PrecType restLength) :
 			m_other(other),
 			m_springConstant(springConstant),
 			m_restLength(restLength)
 		{}
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
+
+		virtual BOOL Relocate(const RelocationMapType& relocations);
 	};
 
-	class ParticleAnchoredSpring : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleAnchoredSpring : public BasicParticleForceGenerator< PrecType >
 	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+
 	protected:
 		VectorType* m_anchor;
 
-		FLOAT m_springConstant;
+		PrecType m_springConstant;
 
-		FLOAT m_restLength;
+		PrecType m_restLength;
 
 	public:
 
-		ParticleAnchoredSpring(VectorType* anchor, FLOAT springConstant, FLOAT restLength) :
+		BasicParticleAnchoredSpring(VectorType* anchor, PrecType springConstant, PrecType restLength) :
 			m_anchor(anchor),
 			m_springConstant(springConstant),
 			m_restLength(restLength)
 		{}
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
 
 	};
 
-	class ParticleBungee : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleBungee : public BasicParticleForceGenerator< PrecType >
 	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+		typedef ParticleRelocationMap< PrecType > RelocationMapType;
+
+	protected:
 		ParticleType* m_other;
 
-		FLOAT m_springConstant;
+		PrecType m_springConstant;
 
-		FLOAT m_restLength;
+		PrecType m_restLength;
 
 	public:
-		ParticleBungee(ParticleType* other, FLOAT springConstant, FLOAT restLength) :
+		BasicParticleBungee(ParticleType* other, PrecType springConstant, PrecType restLength) :
 			m_other(other),
 			m_springConstant(springConstant),
 			m_restLength(restLength)
 		{}
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
+
+		virtual BOOL Relocate(const RelocationMapType& relocations);
 	};
 
-	class ParticleBuoyancy : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleBuoyancy : public BasicParticleForceGenerator< PrecType >
 	{
-		FLOAT m_maxDepth;
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
 
-		FLOAT m_volume;
+	protected:
+		PrecType m_maxDepth;
+
+		PrecType m_volume;
 
-		FLOAT m_waterHeight;
+		PrecType m_waterHeight;
 
-		FLOAT m_liquidDensity;
+		PrecType m_liquidDensity;
 
 	public:
-		ParticleBuoyancy(FLOAT maxDepth, FLOAT volume, FLOAT waterHeight, FLOAT liquidDensity) :
+		BasicParticleBuoyancy(PrecType maxDepth, PrecType volume, PrecType waterHeight, PrecType liquidDensity) :
 			m_maxDepth(maxDepth),
 			m_volume(volume),
 			m_waterHeight(waterHeight),
 			m_liquidDensity(liquidDensity)
 		{}
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
 	};
 
-	class ParticleFakeSpring : public ParticleForceGenerator
+	template< typename PrecType = FLOAT >
+	class BasicParticleFakeSpring : public BasicParticleForceGenerator< PrecType >
 	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+
+	protected:
 		VectorType* m_anchor;
 
-		FLOAT m_springConstant;
+		PrecType m_springConstant;
+
+		PrecType m_damping;
 
-		FLOAT m_damping;
+		/*
+		* Everything transcendental depends only on the constants and dT,
+		* so it is computed once per step length instead of per particle.
+		*/
+		PrecType m_gamma;
+		PrecType m_cachedStep;
+		PrecType m_cosine;
+		PrecType m_sine;
+		PrecType m_decay;
 
-		ParticleFakeSpring(VectorType* anchor, FLOAT springConstant, FLOAT damping) :
+		void UpdateCache(PrecType dT);
+
+		BasicParticleFakeSpring(VectorType* anchor, PrecType springConstant, PrecType damping) :
 			m_anchor(anchor),
 			m_springConstant(springConstant),
-			m_damping(damping)
+			m_damping(damping),
+			m_gamma(0),
+			m_cachedStep(0),
+			m_cosine(1),
+			m_sine(0),
+			m_decay(1)
 		{}
 
-		virtual void UpdateForce(ParticleType* particle, FLOAT dT);
+		virtual void UpdateForce(ParticleType* particle, PrecType dT);
 	};
 
+	typedef Particle<FLOAT> ParticleType;
+	typedef Vector3< FLOAT > VectorType;
+	typedef ParticleRelocationMap< FLOAT > RelocationMapType;
+
+	typedef BasicParticleForceGenerator< FLOAT > ParticleForceGenerator;
+	typedef BasicParticleBatchForceGenerator< FLOAT > ParticleBatchForceGenerator;
+	typedef BasicParticleForceManager< FLOAT > ParticleForceManager;
+	typedef BasicParticleGravity< FLOAT > ParticleGravity;
+	typedef BasicParticleDrag< FLOAT > ParticleDrag;
+	typedef BasicParticleSpring< FLOAT > ParticleSpring;
+	typedef BasicParticleAnchoredSpring< FLOAT > ParticleAnchoredSpring;
+	typedef BasicParticleBungee< FLOAT > ParticleBungee;
+	typedef BasicParticleBuoyancy< FLOAT > ParticleBuoyancy;
+	typedef BasicParticleFakeSpring< FLOAT > ParticleFakeSpring;
 }
 
-#endif //PARTICLE_FORCE_GENERATOR
\ No newline at end of file
+#endif //PARTICLE_FORCE_GENERATOR
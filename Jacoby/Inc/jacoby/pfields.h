@@ -0,0 +1,53 @@
+#ifndef PARTICLE_FORCE_FIELDS
+#define PARTICLE_FORCE_FIELDS
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+
+namespace jacoby
+{
+	/*
+	* Uniform fields acting on every particle of a batch: gravity,
+	* linear and quadratic drag, and wind. Replaces one ParticleGravity
+	* and one ParticleDrag registration per particle with a single pass
+	* over the array, without registry entries or virtual calls.
+	* Wind is the velocity of the surrounding air, drag acts on the
+	* velocity relative to it, so wind has no effect without drag.
+	* Particles leave out single fields through ParticleField bits set
+	* with Particle::SetFieldOptOut, infinite mass ones get no gravity.
+	*/
+	class ParticleForceFields : public ParticleBatchForceGenerator
+	{
+	protected:
+		VectorType m_gravity;
+
+		FLOAT m_k1, m_k2;
+
+		VectorType m_wind;
+
+	public:
+		// all fields start switched off
+		ParticleForceFields();
+
+		// acceleration, the force is scaled by the mass of each particle
+		void SetGravity(const VectorType& gravity);
+
+		// force of k1 * speed + k2 * speed^2 against the relative velocity
+		void SetDrag(FLOAT k1, FLOAT k2);
+
+		void SetWind(const VectorType& wind);
+
+		const VectorType& Gravity() const;
+
+		FLOAT LinearDrag() const;
+
+		FLOAT QuadraticDrag() const;
+
+		const VectorType& Wind() const;
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_FORCE_FIELDS
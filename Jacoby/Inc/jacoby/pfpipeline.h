@@ -0,0 +1,224 @@
+#ifndef PARTICLE_FORCE_PIPELINE
+#define PARTICLE_FORCE_PIPELINE
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+namespace jacoby
+{
+	/*
+	* Force terms are plain classes known at compile time, a pipeline of
+	* them replaces per particle ParticleForceGenerator registrations.
+	* Every term provides
+	*	void Prepare(ParticleType* particles, unsigned count, FLOAT dT);
+	*	void Apply(ParticleType* particles, unsigned index, VectorType& force, FLOAT dT) const;
+	* Apply adds the term's force on particles[index] to force.
+	* ForceTerm supplies an empty Prepare.
+	*/
+	class ForceTerm
+	{
+	public:
+		void Prepare(ParticleType*, unsigned, FLOAT) {}
+	};
+
+	class GravityTerm : public ForceTerm
+	{
+		VectorType m_gravity;
+
+	public:
+		GravityTerm(const VectorType& gravity) : m_gravity(gravity) {}
+
+		void Apply(ParticleType* particles, unsigned index, VectorType& force, FLOAT) const
+		{
+			force.AddScaledVector(m_gravity, particles[index].Mass());
+		}
+	};
+
+	// k1 * |v| + k2 * |v|^2 against the velocity
+	class DragTerm : public ForceTerm
+	{
+		FLOAT m_k1, m_k2;
+
+	public:
+		DragTerm(FLOAT k1, FLOAT k2) : m_k1(k1), m_k2(k2) {}
+
+		void Apply(ParticleType* particles, unsigned index, VectorType& force, FLOAT) const
+		{
+			ParticleType& particle = particles[index];
+			VectorType& velocity = particle.GetVelocity();
+			const FLOAT speed = velocity.Magnitude();
+			if (speed > 0.0f)
+				force.AddScaledVector(velocity, -(m_k1 + m_k2 * speed));
+		}
+	};
+
+	/*
+	* Springs between particles of the same array, by index. Every spring
+	* acts on both its ends, following Hooke's law both ways. Springs are
+	* kept per particle in one compressed array, rebuilt in Prepare after
+	* the set of springs changed.
+	*/
+	class SpringNetworkTerm : public ForceTerm
+	{
+	protected:
+		struct Spring
+		{
+			unsigned a, b;
+			FLOAT springConstant;
+			FLOAT restLength;
+		};
+
+		struct Link
+		{
+			unsigned other;
+			FLOAT springConstant;
+			FLOAT restLength;
+		};
+
+		std::vector< Spring > m_springs;
+
+		// links of particle i are m_links[m_first[i] .. m_first[i + 1])
+		std::vector< unsigned > m_first;
+
+		std::vector< Link > m_links;
+
+		BOOL m_dirty;
+
+	public:
+		SpringNetworkTerm() : m_dirty(true) {}
+
+		void AddSpring(unsigned a, unsigned b, FLOAT springConstant, FLOAT restLength)
+		{
+			Spring spring = { a, b, springConstant, restLength };
+			m_springs.push_back(spring);
+			m_dirty = true;
+		}
+
+		void Clear()
+		{
+			m_springs.clear();
+			m_dirty = true;
+		}
+
+		unsigned SpringCount() const
+		{
+			return unsigned(m_springs.size());
+		}
+
+		void Prepare(ParticleType*, unsigned count, FLOAT)
+		{
+			if (!m_dirty && m_first.size() == count + 1)
+				return;
+
+			m_first.assign(count + 1, 0);
+			for (const Spring& spring : m_springs)
+			{
+				if (spring.a < count && spring.b < count)
+				{
+					++m_first[spring.a + 1];
+					++m_first[spring.b + 1];
+				}
+			}
+			for (unsigned i = 0; i < count; ++i)
+				m_first[i + 1] += m_first[i];
+
+			std::vector< unsigned > next(m_first.begin(), m_first.end() - 1);
+			m_links.resize(m_first[count]);
+			for (const Spring& spring : m_springs)
+			{
+				if (spring.a < count && spring.b < count)
+				{
+					Link toB = { spring.b, spring.springConstant, spring.restLength };
+					Link toA = { spring.a, spring.springConstant, spring.restLength };
+					m_links[next[spring.a]++] = toB;
+					m_links[next[spring.b]++] = toA;
+				}
+			}
+			m_dirty = false;
+		}
+
+		void Apply(ParticleType* particles, unsigned index, VectorType& force, FLOAT) const
+		{
+			ParticleType& particle = particles[index];
+			for (unsigned l = m_first[index]; l < m_first[index + 1]; ++l)
+			{
+				const Link& link = m_links[l];
+				ParticleType& other = particles[link.other];
+				VectorType d = particle.GetPosition() - other.GetPosition();
+				const FLOAT length2 = d.SquareMagnitude();
+				if (length2 > 0.0f)
+				{
+					const FLOAT inverse = InverseSqrt(length2);
+					force.AddScaledVector(d, link.springConstant * (link.restLength * inverse - 1.0f));
+				}
+			}
+		}
+	};
+
+	/*
+	* Fixed set of force terms fused into a single pass over an array,
+	* registered with ParticleForceManager::AddBatch. The calls to the
+	* terms are resolved at compile time and inlined, the force of every
+	* particle is summed in a local and added to its accumulator once.
+	* Particles with infinite mass are skipped.
+	*/
+	template< typename... Terms >
+	class ForcePipeline : public ParticleBatchForceGenerator
+	{
+	protected:
+		std::tuple< Terms... > m_terms;
+
+		template< std::size_t... I >
+		void Prepare(ParticleType* particles, unsigned count, FLOAT dT, std::index_sequence< I... >)
+		{
+			using expand = int[];
+			(void)expand { 0, (std::get< I >(m_terms).Prepare(particles, count, dT), 0)... };
+		}
+
+		template< std::size_t... I >
+		void Apply(ParticleType* particles, unsigned index, VectorType& force, FLOAT dT, std::index_sequence< I... >) const
+		{
+			using expand = int[];
+			(void)expand { 0, (std::get< I >(m_terms).Apply(particles, index, force, dT), 0)... };
+		}
+
+	public:
+		ForcePipeline(Terms... terms) :
+			m_terms(std::move(terms)...)
+		{}
+
+		template< std::size_t I >
+		typename std::tuple_element< I, std::tuple< Terms... > >::type& Term()
+		{
+			return std::get< I >(m_terms);
+		}
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+		{
+			Prepare(particles, count, dT, std::index_sequence_for< Terms... >());
+
+			for (unsigned i = 0; i < count; ++i)
+			{
+				if (particles[i].GetInverseMass() <= 0.0f)
+					continue;
+
+				VectorType force;
+				Apply(particles, i, force, dT, std::index_sequence_for< Terms... >());
+				particles[i].AddForce(force);
+			}
+		}
+	};
+
+	template< typename... Terms >
+	ForcePipeline< Terms... > MakeForcePipeline(Terms... terms)
+	{
+		return ForcePipeline< Terms... >(std::move(terms)...);
+	}
+}
+
+#endif //PARTICLE_FORCE_PIPELINE
@@ -0,0 +1,147 @@
+#ifndef PARTICLE_INTEGRATOR
+#define PARTICLE_INTEGRATOR
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+#include <functional>
+
+namespace jacoby
+{
+	/*
+	* Integration schemes for a whole particle array, in place of
+	* Particle::Integrate. When Integrate is called the accumulators hold
+	* forces of the current state, schemes that need more force
+	* evaluations put the particles into the intermediate states and call
+	* evaluate, which has to leave forces of that state in the accumulators.
+	* Accumulators are cleared and accelerations updated afterwards, as
+	* Particle::Integrate does. Damping is applied once per (sub)step.
+	*/
+	class ParticleIntegrator
+	{
+	public:
+		typedef std::function< void(FLOAT) > ForceEvaluation;
+
+		virtual ~ParticleIntegrator() {}
+
+		virtual void Integrate(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT dT) = 0;
+
+		// force evaluations in the last Integrate
+		virtual unsigned Evaluations() const = 0;
+	};
+
+	/*
+	* Velocity Verlet with a single force evaluation per step. Positions
+	* are advanced as usual, x += v * dT + a * dT^2 / 2, the velocity
+	* gets the whole a * dT and its missing half of (a_next - a) * dT is
+	* added in the next step, once forces of the new positions are known.
+	* Velocities between steps are therefore first order, positions and
+	* energy behave as with the full scheme.
+	*/
+	class ParticleVelocityVerlet : public ParticleIntegrator
+	{
+	protected:
+		std::vector< VectorType > m_lastAcceleration;
+
+		std::vector< FLOAT > m_lastStep;
+
+		std::vector< FLOAT > m_dampingFactors;
+
+	public:
+		virtual void Integrate(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT dT);
+
+		virtual unsigned Evaluations() const;
+
+		// after particles were reordered, added or removed
+		void Reset();
+	};
+
+	/*
+	* Shared part of explicit Runge-Kutta schemes, particles are a second
+	* order system, x' = v, v' = F(x, v) / m.
+	*/
+	class ParticleRungeKutta : public ParticleIntegrator
+	{
+	public:
+		static const unsigned MAX_STAGES = 6;
+
+	protected:
+		std::vector< VectorType > m_x0;
+		std::vector< VectorType > m_v0;
+
+		// stage derivatives, velocities and accelerations
+		std::vector< VectorType > m_kx[MAX_STAGES];
+		std::vector< VectorType > m_kv[MAX_STAGES];
+
+		unsigned m_evaluations;
+
+		std::vector< FLOAT > m_dampingFactors;
+
+		void Begin(std::vector< ParticleType >& particles);
+
+		// derivatives of the current particle state from the accumulators
+		void Derivative(std::vector< ParticleType >& particles, unsigned stage);
+
+		// puts particles to x0 + h * sum(weight[s] * k[s]) over the first stages
+		void Combine(std::vector< ParticleType >& particles, FLOAT h, const FLOAT* weight, unsigned stages);
+
+		/*
+		* Stages 1 .. stages - 1 of the tableau, stage 0 has to be in
+		* place already. a is the lower triangle, row s holds weights of
+		* stages 0 .. s - 1.
+		*/
+		void Stages(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT h,
+			const FLOAT a[][MAX_STAGES], unsigned stages);
+
+		void Finish(std::vector< ParticleType >& particles, FLOAT h);
+
+	public:
+		ParticleRungeKutta();
+
+		virtual unsigned Evaluations() const;
+	};
+
+	// classic fourth order, four force evaluations per step
+	class ParticleRK4 : public ParticleRungeKutta
+	{
+	public:
+		virtual void Integrate(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT dT);
+	};
+
+	/*
+	* Runge-Kutta-Fehlberg 4(5). The step is covered by substeps whose size
+	* follows the difference between the embedded fourth and fifth order
+	* solutions, the fifth order one is kept. The error is the largest
+	* position difference plus velocity difference times the substep, over
+	* all particles. The substep size carries over between steps.
+	*/
+	class ParticleRKF45 : public ParticleRungeKutta
+	{
+	protected:
+		FLOAT m_tolerance;
+
+		FLOAT m_minStep;
+
+		FLOAT m_step;
+
+		unsigned m_rejected;
+
+		FLOAT Error(FLOAT h) const;
+
+	public:
+		ParticleRKF45(FLOAT tolerance = 1e-4f, FLOAT minStep = 1e-5f);
+
+		void SetTolerance(FLOAT tolerance);
+
+		virtual void Integrate(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT dT);
+
+		// substep size the next step starts with
+		FLOAT StepSize() const;
+
+		// substeps rejected in the last Integrate
+		unsigned Rejected() const;
+	};
+}
+
+#endif //PARTICLE_INTEGRATOR
@@ -0,0 +1,151 @@
+#ifndef PARTICLE_MESH
+#define PARTICLE_MESH
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pcontacts.h>
+#include <Inc/jacoby/pcollide.h>
+#include <vector>
+#include <string>
+
+namespace jacoby
+{
+	/*
+	* Indexed triangle soup, three indices per triangle.
+	* Loaders throw std::runtime_error on unreadable or malformed files.
+	*/
+	class TriangleMesh
+	{
+	protected:
+		std::vector< VectorType > m_vertices;
+
+		std::vector< UINT > m_indices;
+
+	public:
+		unsigned AddVertex(const VectorType& vertex);
+
+		void AddTriangle(UINT a, UINT b, UINT c);
+
+		// Wavefront OBJ, only v and f records are used, polygons are fanned
+		void LoadOBJ(const std::string& path);
+
+		// PLY in ascii or binary_little_endian format
+		void LoadPLY(const std::string& path);
+
+		void Clear();
+
+		unsigned VertexCount() const;
+
+		unsigned TriangleCount() const;
+
+		const VectorType& Vertex(unsigned index) const;
+
+		const UINT* Triangle(unsigned index) const;
+	};
+
+	/*
+	* Bounding volume hierarchy over a static mesh, built with binned SAH.
+	* Nodes are stored depth-first in one array, the left child directly
+	* follows its parent, and triangles are copied in leaf order, so that
+	* a traversal walks memory mostly forwards.
+	*/
+	class TriangleBVH
+	{
+	public:
+		static const UINT INVALID_TRIANGLE = ~UINT(0);
+
+	protected:
+		// 32 bytes, two per cache line
+		struct Node
+		{
+			FLOAT min[3];
+			UINT rightOrFirst;	// right child of inner nodes, first triangle of leaves
+			FLOAT max[3];
+			UINT count;			// 0 for inner nodes
+		};
+
+		struct Triangle
+		{
+			VectorType vertex[3];
+		};
+
+		std::vector< Node > m_nodes;
+
+		std::vector< Triangle > m_triangles;
+
+		// index of every leaf-ordered triangle in the source mesh
+		std::vector< UINT > m_sourceIndex;
+
+		// unit normals by source index, for contacts right on a triangle
+		std::vector< VectorType > m_faceNormals;
+
+		unsigned m_maxLeafSize;
+
+		// deepest level of the tree, traversal stacks are sized from it
+		unsigned m_depth;
+
+		unsigned BuildNode(std::vector< UINT >& order, const std::vector< VectorType >& centroids,
+			const std::vector< Triangle >& source, unsigned first, unsigned count, unsigned depth);
+
+	public:
+		TriangleBVH(unsigned maxLeafSize = 4);
+
+		void Build(const TriangleMesh& mesh);
+
+		BOOL Empty() const;
+
+		unsigned NodeCount() const;
+
+		// bounds of the whole mesh
+		void Bounds(VectorType& min, VectorType& max) const;
+
+		/*
+		* Finds the triangle closest to point within radius, returns
+		* INVALID_TRIANGLE if there is none, otherwise the source triangle
+		* index with its closest point and squared distance.
+		*/
+		UINT Closest(const VectorType& point, FLOAT radius, VectorType& closest, FLOAT& distance2) const;
+
+		/*
+		* Sweep query of ParticleStaticContacts::SweepStep against the
+		* triangles, features are source triangle indices.
+		*/
+		void SweepStep(const SweepQuery& query, SweepResult& result) const;
+
+		// normal of a triangle by its source index
+		VectorType FaceNormal(UINT sourceTriangle) const;
+	};
+
+	/*
+	* Contacts of particles (spheres) against a static mesh, at most one per
+	* particle - against the closest triangle. Queries run in parallel over
+	* particles, contacts are written in particle order.
+	*/
+	class ParticleMeshContacts : public ParticleStaticContacts
+	{
+	protected:
+		const TriangleBVH* m_bvh;
+
+		// per particle results of the parallel pass
+		std::vector< UINT > m_hitTriangle;
+
+		std::vector< VectorType > m_hitNormal;
+
+		std::vector< FLOAT > m_hitPenetration;
+
+		BOOL m_parallel;
+
+	public:
+		// contact features are source triangle indices
+		ParticleMeshContacts(std::vector< ParticleType >* particles, const TriangleBVH* bvh,
+			FLOAT radius, FLOAT restitution = 0.0f, BOOL parallel = true);
+
+		void SetParallel(BOOL parallel);
+
+		virtual unsigned AddContact(ParticleContact* contact, unsigned limit);
+
+		virtual void SweepStep(const SweepQuery& query, SweepResult& result);
+	};
+}
+
+#endif //PARTICLE_MESH
@@ -0,0 +1,83 @@
+#ifndef PARTICLE_MESH_FORCE
+#define PARTICLE_MESH_FORCE
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+#include <complex>
+
+namespace jacoby
+{
+	/*
+	* Particle-mesh gravity in a periodic cubic box.
+	* Mass is deposited onto a grid with cloud-in-cell weights,
+	* the Poisson equation is solved with a 3D FFT and accelerations
+	* are interpolated back with the same weights. Cost is
+	* O(N + M log M) for N particles and M grid cells, every phase
+	* runs in parallel. Suited for uniform distributions, where
+	* a tree code gains little. Particles with infinite mass are ignored.
+	*/
+	class ParticleMeshGravity : public ParticleBatchForceGenerator
+	{
+	protected:
+		typedef std::complex< FLOAT > ComplexType;
+
+		FLOAT m_gravitationalConstant;
+
+		// cells per axis, power of 2
+		unsigned m_cells;
+
+		FLOAT m_boxSize;
+
+		FLOAT m_cellSize;
+
+		FLOAT m_origin[3];
+
+		// density, then potential after the inverse transform
+		std::vector< ComplexType > m_grid;
+
+		// green's function including the inverse FFT normalization
+		std::vector< FLOAT > m_greens;
+
+		// acceleration on the grid
+		std::vector< FLOAT > m_acc[3];
+
+		std::vector< ComplexType > m_twiddles;
+
+		std::vector< UINT > m_bitReverse;
+
+		// particles sorted by x slab, so that deposition can run
+		// over even and odd slabs without write conflicts
+		std::vector< UINT > m_slabStart;
+
+		std::vector< UINT > m_slabParticles;
+
+		std::vector< UINT > m_cellIndex;
+
+		std::vector< FLOAT > m_weights;
+
+		void ComputeWeights(ParticleType* particles, unsigned count);
+
+		void Deposit(ParticleType* particles);
+
+		void Transform(BOOL inverse);
+
+		void TransformLine(ComplexType* line, BOOL inverse) const;
+
+		void SolvePoisson();
+
+		void ComputeGradient();
+
+		void Interpolate(ParticleType* particles, unsigned count);
+
+	public:
+		ParticleMeshGravity(FLOAT gravitationalConstant, const VectorType& origin, FLOAT boxSize, unsigned cells);
+
+		unsigned Cells() const;
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_MESH_FORCE
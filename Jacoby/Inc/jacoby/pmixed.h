@@ -0,0 +1,45 @@
+#ifndef PARTICLE_MIXED_PRECISION
+#define PARTICLE_MIXED_PRECISION
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+
+namespace jacoby
+{
+	typedef Particle< DOUBLE > ParticleTypeD;
+	typedef Vector3< DOUBLE > VectorTypeD;
+
+	/*
+	* Mixed precision forces: particles keep DOUBLE positions, a FLOAT
+	* batch generator (the SIMD n-body, mesh gravity or SPH) computes the
+	* forces. Positions are copied into a FLOAT shadow array relative to
+	* the center of their bounds, so that large world coordinates lose
+	* nothing that matters for the interactions, forces are added back in
+	* DOUBLE. Integration and contacts stay in DOUBLE.
+	*/
+	class ParticleMixedPrecisionForces : public BasicParticleBatchForceGenerator< DOUBLE >
+	{
+	public:
+		// the base class' ParticleType is the DOUBLE one
+		typedef Particle< FLOAT > ShadowType;
+
+	protected:
+		ParticleBatchForceGenerator* m_generator;
+
+		std::vector< ShadowType > m_shadow;
+
+		VectorTypeD m_origin;
+
+	public:
+		ParticleMixedPrecisionForces(ParticleBatchForceGenerator* generator);
+
+		virtual void UpdateForces(ParticleTypeD* particles, unsigned count, DOUBLE dT);
+
+		// origin of the shadow positions in the last update
+		const VectorTypeD& Origin() const;
+	};
+}
+
+#endif //PARTICLE_MIXED_PRECISION
@@ -0,0 +1,101 @@
+#ifndef PARTICLE_MULTI_RATE
+#define PARTICLE_MULTI_RATE
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+
+namespace jacoby
+{
+	/*
+	* Multi-rate stepping of one particle array. Every coarse step dT each
+	* particle is put on a level L and advanced with 2^L substeps of
+	* dT / 2^L, the smallest level at which its velocity and acceleration
+	* do not move it further than the allowed displacement per substep and
+	* the substep stays stable. Stability is judged by the stiffness the
+	* particle felt over the last coarse step, omega^2 ~ |da| / |dx|, the
+	* substep has to keep h * omega under the stability factor. Particles
+	* with no history yet start on the finest level. Levels are walked in
+	* ticks of the finest step, a level is due every 2^(maxLevel - L) ticks
+	* and only due particles get their forces evaluated and are integrated.
+	* All levels meet again at the end of the coarse step.
+	* Batch generators see the whole array at once, they run once per coarse
+	* step and their forces are held over the substeps. So is whatever the
+	* accumulators held before and anything added between BeginStep and
+	* FinishStep, e.g. forces of world hooks.
+	*/
+	class ParticleMultiRateStepper
+	{
+	public:
+		static const unsigned MAX_LEVELS = 8;
+
+	protected:
+		std::vector< ParticleType >* m_particles;
+
+		ParticleForceManager* m_forces;
+
+		unsigned m_maxLevel;
+
+		FLOAT m_maxDisplacement;
+
+		FLOAT m_stability;
+
+		// positions the accelerations of the last two coarse steps were
+		// evaluated at, with the older acceleration, for the stiffness estimate
+		std::vector< VectorType > m_evalPosition;
+
+		std::vector< VectorType > m_lastEvalPosition;
+
+		std::vector< VectorType > m_lastAcceleration;
+
+		std::vector< unsigned char > m_level;
+
+		// particle indices from the finest level down, a level is due only
+		// when all finer ones are, so the due particles are always a prefix
+		std::vector< unsigned > m_order;
+
+		// forces of batch generators, held for the whole coarse step
+		std::vector< VectorType > m_heldForce;
+
+		unsigned m_levelCount[MAX_LEVELS];
+
+		unsigned m_integrations;
+
+		void AssignLevels(FLOAT dT);
+
+	public:
+		ParticleMultiRateStepper(std::vector< ParticleType >* particles, ParticleForceManager* forces,
+			unsigned maxLevel = 3, FLOAT maxDisplacement = 0.1f, FLOAT stability = 0.25f);
+
+		// levels above MAX_LEVELS - 1 are clamped
+		void SetMaxLevel(unsigned maxLevel);
+
+		void SetMaxDisplacement(FLOAT maxDisplacement);
+
+		// largest h * omega allowed, explicit integration is stable below 2
+		void SetStabilityFactor(FLOAT stability);
+
+		// forgets the stiffness history, e.g. after particles were added or moved
+		void Reset();
+
+		// forces and integration of all particles over one coarse step
+		void Step(FLOAT dT);
+
+		// assigns levels and adds batch forces to the accumulators
+		void BeginStep(FLOAT dT);
+
+		// holds the accumulated forces and runs the substeps
+		void FinishStep(FLOAT dT);
+
+		unsigned Level(unsigned particle) const;
+
+		// particles on the level in the last step
+		unsigned LevelCount(unsigned level) const;
+
+		// particle integrations in the last step, n * 2^maxLevel for a single fine rate
+		unsigned Integrations() const;
+	};
+}
+
+#endif //PARTICLE_MULTI_RATE
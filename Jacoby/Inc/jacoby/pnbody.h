@@ -0,0 +1,93 @@
+#ifndef PARTICLE_NBODY
+#define PARTICLE_NBODY
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+
+namespace jacoby
+{
+	/*
+	* Mutual gravitation of all particles in a batch, evaluated with
+	* a Barnes-Hut octree rebuilt every step. A node is treated as a
+	* single body when size / distance < theta, which brings the cost
+	* from O(N^2) down to O(N log N). Particles with infinite mass
+	* neither attract nor are attracted.
+	* Inverse square forces like electrostatics follow the same scheme,
+	* a negative constant gives repulsion.
+	*/
+	class ParticleNBodyGravity : public ParticleBatchForceGenerator
+	{
+	public:
+		// children of a node are stored next to each other,
+		// particles of a node occupy [first, first + count) in sorted order
+		struct Node
+		{
+			FLOAT com[3];
+			FLOAT mass;
+			FLOAT size;
+			UINT firstChild;
+			UINT childCount;
+			UINT first;
+			UINT count;
+		};
+
+	protected:
+		// morton keys use 21 bits per axis, the first two levels
+		// of the tree are split into 64 buckets built in parallel
+		static const unsigned MAX_LEVEL = 21;
+		static const unsigned BUCKET_COUNT = 64;
+
+		typedef std::pair< ULLONG, UINT > KeyType;
+
+		FLOAT m_gravitationalConstant;
+
+		FLOAT m_theta;
+
+		FLOAT m_softening;
+
+		unsigned m_leafSize;
+
+		FLOAT m_rootSize;
+
+		FLOAT m_rootMin[3];
+
+		ParticleType* m_particles;
+
+		// scratch storage kept between steps to avoid allocations
+		std::vector< UINT > m_active;
+		std::vector< KeyType > m_keys;
+		std::vector< KeyType > m_sorted;
+		std::vector< FLOAT > m_px, m_py, m_pz, m_mass;
+		std::vector< FLOAT > m_fx, m_fy, m_fz;
+		std::vector< Node > m_nodes;
+		std::vector< std::vector< Node > > m_subtrees;
+		UINT m_bucketStart[BUCKET_COUNT + 1];
+
+		void ComputeBounds(ParticleType* particles);
+
+		void SortByKey(ParticleType* particles);
+
+		void BuildTree();
+
+		void BuildNode(std::vector< Node >& nodes, UINT nodeIndex, UINT first, UINT count, unsigned level) const;
+
+		void SumChildren(Node& node) const;
+
+		void ComputeForce(UINT i);
+
+	public:
+		ParticleNBodyGravity(FLOAT gravitationalConstant, FLOAT theta = 0.5f, FLOAT softening = 0.01f, unsigned leafSize = 8);
+
+		void SetTheta(FLOAT theta);
+
+		void SetSoftening(FLOAT softening);
+
+		const std::vector< Node >& Nodes() const;
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_NBODY
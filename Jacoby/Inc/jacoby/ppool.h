@@ -0,0 +1,314 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+
+#ifndef PARTICLE_POOL_JACOBY
+#define PARTICLE_POOL_JACOBY
+
+namespace jacoby
+{
+	/*
+	* Batch of particle address changes produced by pool compaction.
+	* Maps old address of a particle to its new address,
+	* nullptr as the new address means that the particle was killed.
+	*/
+	template< typename PrecType = FLOAT>
+	class ParticleRelocationMap
+	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef std::pair< ParticleType*, ParticleType* > EntryType;
+
+	private:
+		std::vector< EntryType > m_entries;
+
+	public:
+		void Clear()
+		{
+			m_entries.clear();
+		}
+
+		void Add(ParticleType* from, ParticleType* to)
+		{
+			m_entries.push_back(EntryType(from, to));
+		}
+
+		// has to be called after all Add calls and before any Lookup
+		void Finalize()
+		{
+			std::sort(m_entries.begin(), m_entries.end(),
+				[](const EntryType& lhs, const EntryType& rhs) { return lhs.first < rhs.first; });
+		}
+
+		BOOL Empty() const
+		{
+			return m_entries.empty();
+		}
+
+		// returns true if the particle was affected and sets its new address
+		BOOL Lookup(ParticleType* particle, ParticleType*& newAddress) const
+		{
+			auto it = std::lower_bound(m_entries.begin(), m_entries.end(), particle,
+				[](const EntryType& entry, ParticleType* value) { return entry.first < value; });
+			if (it == m_entries.end() || it->first != particle)
+				return false;
+
+			newAddress = it->second;
+			return true;
+		}
+	};
+
+	/*
+	* Fixed capacity storage of short-lived particles.
+	* Live particles are kept dense at the front of the storage, killing
+	* swaps the last live particle into the freed slot. Handles are stable
+	* identifiers recycled through a free-list, dense indices are not.
+	* Storage never reallocates, so addresses only change on Compact(),
+	* which reports them to relocation listeners in one batch.
+	*/
+	template< typename PrecType = FLOAT>
+	class ParticlePool
+	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef ParticleRelocationMap< PrecType > RelocationMapType;
+		typedef std::function< void(const RelocationMapType&) > RelocationListener;
+
+		static const UINT INVALID_INDEX = ~UINT(0);
+
+	private:
+		unsigned m_capacity;
+
+		// dense arrays, indexed by dense index
+		std::vector< ParticleType > m_particles;
+		std::vector< PrecType > m_age;
+		std::vector< PrecType > m_lifetime;
+		std::vector< UINT > m_denseToHandle;
+
+		// sparse arrays, indexed by handle
+		std::vector< UINT > m_handleToDense;
+		std::vector< UINT > m_freeHandles;
+
+		std::vector< UINT > m_killList;
+		std::vector< UINT > m_originalIndex;
+		std::vector< UINT > m_movedHandles;
+		RelocationMapType m_relocations;
+		std::vector< RelocationListener > m_listeners;
+
+	public:
+		ParticlePool(unsigned capacity) :
+			m_capacity(capacity)
+		{
+			m_particles.reserve(capacity);
+			m_age.reserve(capacity);
+			m_lifetime.reserve(capacity);
+			m_denseToHandle.reserve(capacity);
+			m_handleToDense.assign(capacity, INVALID_INDEX);
+			m_originalIndex.assign(capacity, INVALID_INDEX);
+			m_killList.reserve(capacity);
+			m_movedHandles.reserve(capacity);
+
+			m_freeHandles.resize(capacity);
+			for (unsigned i = 0; i < capacity; ++i)
+				m_freeHandles[i] = capacity - 1 - i;
+		}
+
+		// pool owns addresses of its particles, so it cannot be copied
+		ParticlePool(const ParticlePool&) = delete;
+		ParticlePool& operator = (const ParticlePool&) = delete;
+
+		unsigned Capacity() const
+		{
+			return m_capacity;
+		}
+
+		unsigned Size() const
+		{
+			return unsigned(m_particles.size());
+		}
+
+		unsigned Available() const
+		{
+			return unsigned(m_freeHandles.size());
+		}
+
+		ParticleType* Data()
+		{
+			return m_particles.data();
+		}
+
+		std::vector< ParticleType >& Particles()
+		{
+			return m_particles;
+		}
+
+		ParticleType& operator [] (unsigned denseIndex)
+		{
+			return m_particles[denseIndex];
+		}
+
+		PrecType Age(unsigned denseIndex) const
+		{
+			return m_age[denseIndex];
+		}
+
+		PrecType& GetLifetime(unsigned denseIndex)
+		{
+			return m_lifetime[denseIndex];
+		}
+
+		UINT Handle(unsigned denseIndex) const
+		{
+			return m_denseToHandle[denseIndex];
+		}
+
+		// returns nullptr for handles of dead particles
+		ParticleType* Find(UINT handle)
+		{
+			if (handle >= m_capacity || m_handleToDense[handle] == INVALID_INDEX)
+				return nullptr;
+			return &m_particles[m_handleToDense[handle]];
+		}
+
+		// called once per Compact() that moved or killed anything
+		void AddRelocationListener(const RelocationListener& listener)
+		{
+			m_listeners.push_back(listener);
+		}
+
+		/*
+		* Spawns up to count copies of the prototype with given lifetime
+		* (non-positive lifetime means the particle lives until killed).
+		* New particles occupy dense indices [returned first, Size()).
+		*/
+		unsigned Spawn(unsigned count, const ParticleType& prototype, const PrecType& lifetime, unsigned& first)
+		{
+			first = Size();
+			count = std::min(count, Available());
+			for (unsigned i = 0; i < count; ++i)
+			{
+				UINT handle = m_freeHandles.back();
+				m_freeHandles.pop_back();
+
+				m_handleToDense[handle] = UINT(m_particles.size());
+				m_denseToHandle.push_back(handle);
+				m_particles.push_back(prototype);
+				m_age.push_back(PrecType(0.0));
+				m_lifetime.push_back(lifetime);
+			}
+			return count;
+		}
+
+		// killing is deferred until Compact()
+		void Kill(UINT handle)
+		{
+			if (handle < m_capacity && m_handleToDense[handle] != INVALID_INDEX)
+				m_killList.push_back(m_handleToDense[handle]);
+		}
+
+		void KillDense(unsigned denseIndex)
+		{
+			if (denseIndex < Size())
+				m_killList.push_back(denseIndex);
+		}
+
+		void KillAll()
+		{
+			for (unsigned i = 0; i < Size(); ++i)
+				m_killList.push_back(i);
+		}
+
+		// advances age and queues expired particles for killing
+		void Advance(const PrecType& dT)
+		{
+			const unsigned size = Size();
+			for (unsigned i = 0; i < size; ++i)
+			{
+				m_age[i] += dT;
+				if (m_lifetime[i] > PrecType(0.0) && m_age[i] >= m_lifetime[i])
+					m_killList.push_back(i);
+			}
+		}
+
+		void Integrate(const PrecType& dT)
+		{
+			IntegrateParticles(m_particles.data(), unsigned(m_particles.size()), dT);
+		}
+
+		/*
+		* Removes all queued particles by swapping the last live particle
+		* into each freed slot. Returns number of killed particles.
+		*/
+		unsigned Compact()
+		{
+			if (m_killList.empty())
+				return 0;
+
+			// going from the highest index guarantees that the particle moved
+			// into a freed slot is alive and that killed ones were never moved
+			std::sort(m_killList.begin(), m_killList.end(), std::greater< UINT >());
+			m_killList.erase(std::unique(m_killList.begin(), m_killList.end()), m_killList.end());
+
+			ParticleType* base = m_particles.data();
+			m_relocations.Clear();
+			m_movedHandles.clear();
+
+			for (UINT index : m_killList)
+			{
+				UINT last = UINT(m_particles.size()) - 1;
+				UINT killedHandle = m_denseToHandle[index];
+
+				m_relocations.Add(base + index, nullptr);
+				m_handleToDense[killedHandle] = INVALID_INDEX;
+				m_freeHandles.push_back(killedHandle);
+
+				if (index != last)
+				{
+					// a particle may be moved several times,
+					// listeners only need its original address
+					UINT movedHandle = m_denseToHandle[last];
+					if (m_originalIndex[movedHandle] == INVALID_INDEX)
+					{
+						m_originalIndex[movedHandle] = last;
+						m_movedHandles.push_back(movedHandle);
+					}
+
+					m_particles[index] = std::move(m_particles[last]);
+					m_age[index] = m_age[last];
+					m_lifetime[index] = m_lifetime[last];
+					m_denseToHandle[index] = movedHandle;
+					m_handleToDense[movedHandle] = index;
+				}
+
+				m_particles.pop_back();
+				m_age.pop_back();
+				m_lifetime.pop_back();
+				m_denseToHandle.pop_back();
+			}
+
+			for (UINT handle : m_movedHandles)
+			{
+				m_relocations.Add(base + m_originalIndex[handle], base + m_handleToDense[handle]);
+				m_originalIndex[handle] = INVALID_INDEX;
+			}
+			m_relocations.Finalize();
+
+			unsigned killed = unsigned(m_killList.size());
+			m_killList.clear();
+
+			for (auto& listener : m_listeners)
+				listener(m_relocations);
+
+			return killed;
+		}
+	};
+
+	template< typename PrecType>
+	const UINT ParticlePool< PrecType >::INVALID_INDEX;
+}
+
+#endif //PARTICLE_POOL_JACOBY
@@ -0,0 +1,119 @@
+#pragma once
+#include <vector>
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+
+#ifndef PARTICLE_SET_JACOBY
+#define PARTICLE_SET_JACOBY
+
+namespace jacoby
+{
+	/*
+	* Container that keeps particles partitioned by category.
+	* Only the dynamic partition goes through force integration,
+	* kinematic particles are advanced along their velocity and
+	* static ones are never touched after insertion.
+	* Pointers returned by Add* stay valid as long as the partition
+	* does not grow past its reserved capacity.
+	*/
+	template< typename PrecType = FLOAT>
+	class ParticleSet
+	{
+	public:
+		typedef Particle< PrecType > ParticleType;
+		typedef Vector3< PrecType > VectorType;
+		typedef std::vector< ParticleType > PartitionType;
+
+	private:
+		PartitionType m_dynamic;
+		PartitionType m_kinematic;
+		PartitionType m_static;
+
+	public:
+		void Reserve(unsigned dynamicCount, unsigned kinematicCount, unsigned staticCount)
+		{
+			m_dynamic.reserve(dynamicCount);
+			m_kinematic.reserve(kinematicCount);
+			m_static.reserve(staticCount);
+		}
+
+		// puts the particle into the partition matching its category
+		ParticleType* Add(const ParticleType& particle)
+		{
+			PartitionType& partition = GetPartition(particle.Category());
+			partition.push_back(particle);
+			return &partition.back();
+		}
+
+		ParticleType* AddStatic(const VectorType& position)
+		{
+			m_static.push_back(ParticleType(position));
+			m_static.back().MakeStatic();
+			return &m_static.back();
+		}
+
+		ParticleType* AddKinematic(const VectorType& position, const VectorType& velocity)
+		{
+			m_kinematic.push_back(ParticleType(position));
+			m_kinematic.back().MakeKinematic(velocity);
+			return &m_kinematic.back();
+		}
+
+		PartitionType& GetPartition(ParticleCategory category)
+		{
+			switch (category)
+			{
+			case ParticleCategory::Kinematic:
+				return m_kinematic;
+			case ParticleCategory::Static:
+				return m_static;
+			default:
+				return m_dynamic;
+			}
+		}
+
+		PartitionType& Dynamic()
+		{
+			return m_dynamic;
+		}
+
+		PartitionType& Kinematic()
+		{
+			return m_kinematic;
+		}
+
+		PartitionType& Static()
+		{
+			return m_static;
+		}
+
+		unsigned Size() const
+		{
+			return unsigned(m_dynamic.size() + m_kinematic.size() + m_static.size());
+		}
+
+		// static partition is skipped entirely
+		void Integrate(const PrecType& dT)
+		{
+			IntegrateParticles(m_dynamic.data(), unsigned(m_dynamic.size()), dT);
+
+			IntegrateKinematic(dT);
+		}
+
+		// for when the dynamic partition is stepped elsewhere
+		void IntegrateKinematic(const PrecType& dT)
+		{
+			for (ParticleType& particle : m_kinematic)
+				particle.IntegrateKinematic(dT);
+		}
+
+		void Clear()
+		{
+			m_dynamic.clear();
+			m_kinematic.clear();
+			m_static.clear();
+		}
+	};
+}
+
+#endif //PARTICLE_SET_JACOBY
@@ -0,0 +1,78 @@
+#ifndef PARTICLE_SPH
+#define PARTICLE_SPH
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+
+namespace jacoby
+{
+	/*
+	* Smoothed-particle hydrodynamics fluid acting on a whole batch.
+	* Neighbours are found with a hashed uniform grid of smoothing radius
+	* sized cells. A density pass (poly6 kernel) is followed by a pressure
+	* and viscosity pass (spiky and viscosity kernels), both evaluating four
+	* neighbours at once. Particles with infinite mass do not take part.
+	*/
+	class ParticleSPH : public ParticleBatchForceGenerator
+	{
+	protected:
+		FLOAT m_smoothingRadius;
+
+		FLOAT m_restDensity;
+
+		FLOAT m_stiffness;
+
+		FLOAT m_viscosity;
+
+		BOOL m_parallel;
+
+		// kernel normalization constants, depend on smoothing radius only
+		FLOAT m_poly6;
+
+		FLOAT m_spikyGradient;
+
+		FLOAT m_viscosityLaplacian;
+
+		// particles sorted by grid cell, padded for 4-wide loads
+		std::vector< UINT > m_order;
+
+		// inverse of m_order by particle index, ~0 for particles left out
+		std::vector< UINT > m_slotOfParticle;
+		std::vector< FLOAT > m_px, m_py, m_pz;
+		std::vector< FLOAT > m_vx, m_vy, m_vz;
+		std::vector< FLOAT > m_mass;
+		std::vector< FLOAT > m_density;
+		std::vector< FLOAT > m_pressure;
+
+		std::vector< UINT > m_cellOfParticle;
+		std::vector< UINT > m_cellStart;
+		UINT m_tableMask;
+
+		void BuildGrid(ParticleType* particles, unsigned count);
+
+		UINT HashCell(INT x, INT y, INT z) const;
+
+		// distinct hash buckets of the 27 cells around the particle
+		unsigned NeighbourBuckets(UINT i, UINT* buckets) const;
+
+		void ComputeDensity(UINT i);
+
+		void ComputeForce(UINT i, ParticleType* particles);
+
+	public:
+		ParticleSPH(FLOAT smoothingRadius, FLOAT restDensity, FLOAT stiffness, FLOAT viscosity, BOOL parallel = true);
+
+		void SetSmoothingRadius(FLOAT smoothingRadius);
+
+		void SetParallel(BOOL parallel);
+
+		// densities of the last step, indexed like the particle array
+		FLOAT Density(unsigned particleIndex) const;
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_SPH
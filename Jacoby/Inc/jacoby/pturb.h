@@ -0,0 +1,106 @@
+#ifndef PARTICLE_TURBULENCE
+#define PARTICLE_TURBULENCE
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <Inc/jacoby/simd.h>
+#include <Inc/jacoby/world.h>
+#include <vector>
+
+namespace jacoby
+{
+	/*
+	* Procedural turbulence force, divergence-free curl noise evaluated on
+	* the fly at particle positions, so large domains need no grid.
+	* The noise is a sum of random transverse waves c cos(k.p + phase) with
+	* c perpendicular to k. Each wave is the curl of a sine potential, which
+	* keeps the sum divergence-free, and its derivative needs no lattice
+	* lookups, so four particles are evaluated at once with the Float4 Cos.
+	* Every octave multiplies the frequency by lacunarity and the amplitude
+	* by gain. Amplitude is the RMS magnitude of the force.
+	* With a non-zero speed the phases advance with time, finer octaves
+	* change faster. The field only changes through Advance or SetTime,
+	* never in UpdateForces, so every force evaluation of a multi-stage
+	* integrator within one step sees the same field. Waves are drawn from
+	* the seed, the same seed gives the same waves on every platform.
+	*/
+	class ParticleTurbulence : public ParticleBatchForceGenerator
+	{
+	public:
+		static const unsigned WAVES_PER_OCTAVE = 8;
+
+	protected:
+		FLOAT m_amplitude;
+
+		FLOAT m_frequency;
+
+		unsigned m_octaves;
+
+		FLOAT m_lacunarity;
+
+		FLOAT m_gain;
+
+		FLOAT m_speed;
+
+		UINT m_seed;
+
+		BOOL m_parallel;
+
+		DOUBLE m_time;
+
+		// waves, wave vectors include frequency, directions include amplitude
+		std::vector< FLOAT > m_kx, m_ky, m_kz;
+		std::vector< FLOAT > m_cx, m_cy, m_cz;
+		std::vector< FLOAT > m_basePhase;
+		std::vector< FLOAT > m_phaseRate;
+
+		// phases at m_time, wrapped to [0, 2 pi)
+		std::vector< FLOAT > m_phase;
+
+		void BuildWaves();
+
+		void UpdatePhases();
+
+		void Evaluate(const Float4& x, const Float4& y, const Float4& z, Float4& fx, Float4& fy, Float4& fz) const;
+
+	public:
+		ParticleTurbulence(FLOAT amplitude, FLOAT frequency, unsigned octaves = 3, UINT seed = 1, BOOL parallel = true);
+
+		void SetAmplitude(FLOAT amplitude);
+
+		// spatial frequency of the first octave, one over its wavelength
+		void SetFrequency(FLOAT frequency);
+
+		void SetOctaves(unsigned octaves);
+
+		// frequency and amplitude factors between octaves, 2 and 0.5 by default
+		void SetLacunarity(FLOAT lacunarity);
+
+		void SetGain(FLOAT gain);
+
+		// phase change of the first octave in radians per second
+		void SetSpeed(FLOAT speed);
+
+		void SetSeed(UINT seed);
+
+		void SetParallel(BOOL parallel);
+
+		void SetTime(DOUBLE time);
+
+		// moves the field on by dT, once per step
+		void Advance(FLOAT dT);
+
+		DOUBLE Time() const;
+
+		// acts on the world's dynamic particles, advances after resolution
+		void Attach(World& world);
+
+		// force at position for the current time
+		VectorType Sample(const VectorType& position) const;
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_TURBULENCE
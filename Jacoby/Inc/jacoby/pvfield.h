@@ -0,0 +1,130 @@
+#ifndef PARTICLE_VECTOR_FIELD
+#define PARTICLE_VECTOR_FIELD
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pfgen.h>
+#include <vector>
+#include <string>
+
+namespace jacoby
+{
+	/*
+	* Vector field sampled on a regular 3D grid, x varies fastest.
+	* Every node is four floats - xyz and an unused fourth - so that a
+	* node is one SIMD load and trilinear interpolation runs on whole
+	* vectors. Nodes are either owned or mapped read-only from a file
+	* written by Save, which lets big fields be used without parsing.
+	* Loaders throw std::runtime_error on unreadable or malformed files.
+	*/
+	class VectorFieldGrid
+	{
+	protected:
+		UINT m_size[3];
+
+		VectorType m_origin;
+
+		VectorType m_cellSize;
+
+		VectorType m_inverseCellSize;
+
+		std::vector< FLOAT > m_owned;
+
+		// owned or mapped nodes
+		const FLOAT* m_nodes;
+
+		// mapped view and its handles, null when nothing is mapped
+		void* m_view;
+
+		size_t m_viewSize;
+
+		void* m_file;
+
+		void* m_mapping;
+
+		void SetLayout(const UINT* size, const VectorType& origin, const VectorType& cellSize);
+
+		void Unmap();
+
+	public:
+		VectorFieldGrid();
+
+		~VectorFieldGrid();
+
+		VectorFieldGrid(const VectorFieldGrid&) = delete;
+		VectorFieldGrid& operator = (const VectorFieldGrid&) = delete;
+
+		// owned grid of sizeX * sizeY * sizeZ zero nodes, every size at least 2
+		void Create(unsigned sizeX, unsigned sizeY, unsigned sizeZ, const VectorType& origin, const VectorType& cellSize);
+
+		// only for owned grids
+		void SetNode(unsigned x, unsigned y, unsigned z, const VectorType& value);
+
+		VectorType Node(unsigned x, unsigned y, unsigned z) const;
+
+		// binary little endian file, the layout Map expects
+		void Save(const std::string& path) const;
+
+		// maps a file written by Save, nodes are paged in on first use
+		void Map(const std::string& path);
+
+		// reads a file written by Save into owned storage
+		void Load(const std::string& path);
+
+		void Clear();
+
+		BOOL Empty() const;
+
+		BOOL Mapped() const;
+
+		unsigned Size(unsigned axis) const;
+
+		const VectorType& Origin() const;
+
+		const VectorType& CellSize() const;
+
+		// trilinear, positions outside the grid take the value at the border
+		VectorType Sample(const VectorType& position) const;
+	};
+
+	/*
+	* Force from a VectorFieldGrid at the position of every particle.
+	* Force - the field is a force
+	* Acceleration - the field is scaled by mass, infinite mass is skipped
+	* Flow - the field is a velocity, the particle is dragged towards it
+	*		with scale * (field - velocity)
+	* Every mode multiplies by scale. Sampling runs in parallel.
+	*/
+	class ParticleVectorField : public ParticleBatchForceGenerator
+	{
+	public:
+		enum class Mode
+		{
+			Force,
+			Acceleration,
+			Flow
+		};
+
+	protected:
+		const VectorFieldGrid* m_grid;
+
+		Mode m_mode;
+
+		FLOAT m_scale;
+
+		BOOL m_parallel;
+
+	public:
+		ParticleVectorField(const VectorFieldGrid* grid, Mode mode = Mode::Force, FLOAT scale = 1.0f, BOOL parallel = true);
+
+		void SetGrid(const VectorFieldGrid* grid);
+
+		void SetMode(Mode mode, FLOAT scale);
+
+		void SetParallel(BOOL parallel);
+
+		virtual void UpdateForces(ParticleType* particles, unsigned count, FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_VECTOR_FIELD
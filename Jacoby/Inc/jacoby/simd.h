@@ -0,0 +1,311 @@
+#pragma once
+
+#ifndef SIMD_JACOBY
+#define SIMD_JACOBY
+
+#include <Inc/jacoby/types.h>
+#include <math.h>
+
+// SSE2 is always available on x64, on x86 it depends on /arch
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JACOBY_SSE
+#include <emmintrin.h>
+#endif
+
+namespace jacoby
+{
+	/*
+	* Four floats processed together. Maps to an SSE register when
+	* available and to a plain array otherwise, so that batched
+	* kernels are written once. Comparisons return lane masks that
+	* are used with Select.
+	*/
+	struct Float4
+	{
+#ifdef JACOBY_SSE
+		__m128 v;
+
+		Float4() : v(_mm_setzero_ps()) {}
+		Float4(__m128 v_) : v(v_) {}
+		explicit Float4(FLOAT s) : v(_mm_set1_ps(s)) {}
+		Float4(FLOAT a, FLOAT b, FLOAT c, FLOAT d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+		static Float4 Load(const FLOAT* p) { return Float4(_mm_loadu_ps(p)); }
+		void Store(FLOAT* p) const { _mm_storeu_ps(p, v); }
+
+		Float4 operator + (const Float4& r) const { return Float4(_mm_add_ps(v, r.v)); }
+		Float4 operator - (const Float4& r) const { return Float4(_mm_sub_ps(v, r.v)); }
+		Float4 operator * (const Float4& r) const { return Float4(_mm_mul_ps(v, r.v)); }
+		Float4 operator / (const Float4& r) const { return Float4(_mm_div_ps(v, r.v)); }
+		Float4 operator - () const { return Float4(_mm_sub_ps(_mm_setzero_ps(), v)); }
+
+		Float4 operator < (const Float4& r) const { return Float4(_mm_cmplt_ps(v, r.v)); }
+		Float4 operator <= (const Float4& r) const { return Float4(_mm_cmple_ps(v, r.v)); }
+		Float4 operator > (const Float4& r) const { return Float4(_mm_cmpgt_ps(v, r.v)); }
+		Float4 operator >= (const Float4& r) const { return Float4(_mm_cmpge_ps(v, r.v)); }
+		Float4 operator & (const Float4& r) const { return Float4(_mm_and_ps(v, r.v)); }
+		Float4 operator | (const Float4& r) const { return Float4(_mm_or_ps(v, r.v)); }
+		Float4 operator == (const Float4& r) const { return Float4(_mm_cmpeq_ps(v, r.v)); }
+
+		friend Float4 Min(const Float4& a, const Float4& b) { return Float4(_mm_min_ps(a.v, b.v)); }
+		friend Float4 Max(const Float4& a, const Float4& b) { return Float4(_mm_max_ps(a.v, b.v)); }
+		friend Float4 Sqrt(const Float4& a) { return Float4(_mm_sqrt_ps(a.v)); }
+
+		// 1 / sqrt(a) for positive a, the estimate is refined by one Newton step to about 22 bits
+		friend Float4 RSqrt(const Float4& a)
+		{
+			__m128 y = _mm_rsqrt_ps(a.v);
+			__m128 ayy = _mm_mul_ps(_mm_mul_ps(a.v, y), y);
+			return Float4(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), y), _mm_sub_ps(_mm_set1_ps(3.0f), ayy)));
+		}
+
+		// nearest integer, ties to even, |a| below 2^31
+		friend Float4 Round(const Float4& a) { return Float4(_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))); }
+
+		// a * 2^n, n integral in [-126, 127]
+		friend Float4 Ldexp(const Float4& a, const Float4& n)
+		{
+			__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.v), _mm_set1_epi32(127)), 23);
+			return Float4(_mm_mul_ps(a.v, _mm_castsi128_ps(bits)));
+		}
+
+		// positive normal a = mantissa * 2^exponent, mantissa in [0.5, 1)
+		friend Float4 Frexp(const Float4& a, Float4& exponent)
+		{
+			__m128i bits = _mm_castps_si128(a.v);
+			exponent = Float4(_mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126))));
+			return Float4(_mm_or_ps(_mm_and_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(0x807fffff))), _mm_set1_ps(0.5f)));
+		}
+
+		// mask lanes take a, the others b
+		friend Float4 Select(const Float4& mask, const Float4& a, const Float4& b)
+		{
+			return Float4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+		}
+
+		friend BOOL Any(const Float4& mask) { return _mm_movemask_ps(mask.v) != 0; }
+
+		// one bit per set lane, lane 0 in the lowest bit
+		friend unsigned MoveMask(const Float4& mask) { return unsigned(_mm_movemask_ps(mask.v)); }
+
+		friend FLOAT HorizontalSum(const Float4& a)
+		{
+			__m128 shuf = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 sums = _mm_add_ps(a.v, shuf);
+			shuf = _mm_movehl_ps(shuf, sums);
+			return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+		}
+#else
+		FLOAT v[4];
+
+		Float4() { v[0] = v[1] = v[2] = v[3] = 0.0f; }
+		explicit Float4(FLOAT s) { v[0] = v[1] = v[2] = v[3] = s; }
+		Float4(FLOAT a, FLOAT b, FLOAT c, FLOAT d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+
+		static Float4 Load(const FLOAT* p) { return Float4(p[0], p[1], p[2], p[3]); }
+		void Store(FLOAT* p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+
+		template< typename Op >
+		static Float4 Apply(const Float4& a, const Float4& b, Op op)
+		{
+			return Float4(op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3]));
+		}
+
+		// masks are all-ones or all-zeros bit patterns, as with SSE
+		static FLOAT Mask(BOOL set)
+		{
+			union { unsigned u; FLOAT f; } m;
+			m.u = set ? ~0u : 0u;
+			return m.f;
+		}
+
+		static unsigned Bits(FLOAT f)
+		{
+			union { unsigned u; FLOAT f; } m;
+			m.f = f;
+			return m.u;
+		}
+
+		Float4 operator + (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return a + b; }); }
+		Float4 operator - (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return a - b; }); }
+		Float4 operator * (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return a * b; }); }
+		Float4 operator / (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return a / b; }); }
+		Float4 operator - () const { return Float4(-v[0], -v[1], -v[2], -v[3]); }
+
+		Float4 operator < (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(a < b); }); }
+		Float4 operator <= (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(a <= b); }); }
+		Float4 operator > (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(a > b); }); }
+		Float4 operator >= (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(a >= b); }); }
+		Float4 operator & (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(Bits(a) & Bits(b)); }); }
+		Float4 operator | (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(Bits(a) | Bits(b)); }); }
+		Float4 operator == (const Float4& r) const { return Apply(*this, r, [](FLOAT a, FLOAT b) { return Mask(a == b); }); }
+
+		friend Float4 Min(const Float4& a, const Float4& b) { return Apply(a, b, [](FLOAT x, FLOAT y) { return x < y ? x : y; }); }
+		friend Float4 Max(const Float4& a, const Float4& b) { return Apply(a, b, [](FLOAT x, FLOAT y) { return x > y ? x : y; }); }
+		friend Float4 Sqrt(const Float4& a) { return Float4(sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3])); }
+
+		friend Float4 RSqrt(const Float4& a)
+		{
+			return Float4(1.0f / sqrtf(a.v[0]), 1.0f / sqrtf(a.v[1]), 1.0f / sqrtf(a.v[2]), 1.0f / sqrtf(a.v[3]));
+		}
+
+		friend Float4 Round(const Float4& a) { return Float4(nearbyintf(a.v[0]), nearbyintf(a.v[1]), nearbyintf(a.v[2]), nearbyintf(a.v[3])); }
+
+		friend Float4 Ldexp(const Float4& a, const Float4& n)
+		{
+			return Apply(a, n, [](FLOAT x, FLOAT e) { return ldexpf(x, int(e)); });
+		}
+
+		friend Float4 Frexp(const Float4& a, Float4& exponent)
+		{
+			Float4 mantissa;
+			for (unsigned i = 0; i < 4; ++i)
+			{
+				int e;
+				mantissa.v[i] = frexpf(a.v[i], &e);
+				exponent.v[i] = FLOAT(e);
+			}
+			return mantissa;
+		}
+
+		friend Float4 Select(const Float4& mask, const Float4& a, const Float4& b)
+		{
+			Float4 out;
+			for (unsigned i = 0; i < 4; ++i)
+				out.v[i] = Bits(mask.v[i]) ? a.v[i] : b.v[i];
+			return out;
+		}
+
+		friend BOOL Any(const Float4& mask)
+		{
+			return (Bits(mask.v[0]) | Bits(mask.v[1]) | Bits(mask.v[2]) | Bits(mask.v[3])) != 0;
+		}
+
+		friend unsigned MoveMask(const Float4& mask)
+		{
+			unsigned bits = 0;
+			for (unsigned i = 0; i < 4; ++i)
+				bits |= (Bits(mask.v[i]) >> 31) << i;
+			return bits;
+		}
+
+		friend FLOAT HorizontalSum(const Float4& a) { return (a.v[0] + a.v[1]) + (a.v[2] + a.v[3]); }
+#endif
+	};
+
+	/*
+	* Scalar counterpart of RSqrt. A lone rsqrtss with its Newton step is no
+	* faster than sqrtss and divss on current cores, so this one stays exact.
+	*/
+	inline FLOAT InverseSqrt(FLOAT a)
+	{
+		return 1.0f / sqrtf(a);
+	}
+
+	/*
+	* Transcendental kernels for batches that would otherwise call libm per
+	* element, Cephes polynomials on top of the Float4 operations so that
+	* both paths share them. Errors measured against double precision:
+	* Exp within 1 ulp on [-87, 88]
+	* Log within 1 ulp for positive normal inputs
+	* Sin and Cos within 2 ulp (absolute 6e-8 around their zeros) for |x| < 8192
+	* Pow within 2 ulp while |y log x| < 1, as for damping factors, the error
+	* grows with |y log x| beyond that
+	* Out of range inputs are not checked.
+	*/
+	inline Float4 Exp(const Float4& x)
+	{
+		Float4 a = Min(Max(x, Float4(-87.3f)), Float4(88.3f));
+		Float4 n = Round(a * Float4(1.44269504088896341f));
+
+		// x - n ln 2 in two parts, the first one is exact
+		Float4 r = a - n * Float4(0.693359375f) - n * Float4(-2.12194440e-4f);
+		Float4 p = Float4(1.9875691500e-4f);
+		p = p * r + Float4(1.3981999507e-3f);
+		p = p * r + Float4(8.3334519073e-3f);
+		p = p * r + Float4(4.1665795894e-2f);
+		p = p * r + Float4(1.6666665459e-1f);
+		p = p * r + Float4(5.0000001201e-1f);
+		p = p * r * r + r + Float4(1.0f);
+		return Ldexp(p, n);
+	}
+
+	inline Float4 Log(const Float4& x)
+	{
+		Float4 e;
+		Float4 m = Frexp(x, e);
+
+		// mantissa in [sqrt(1/2), sqrt(2)), minus one
+		Float4 low = m < Float4(0.707106781186547524f);
+		e = e - Select(low, Float4(1.0f), Float4());
+		m = m + Select(low, m, Float4()) - Float4(1.0f);
+
+		Float4 z = m * m;
+		Float4 y = Float4(7.0376836292e-2f);
+		y = y * m + Float4(-1.1514610310e-1f);
+		y = y * m + Float4(1.1676998740e-1f);
+		y = y * m + Float4(-1.2420140846e-1f);
+		y = y * m + Float4(1.4249322787e-1f);
+		y = y * m + Float4(-1.6668057665e-1f);
+		y = y * m + Float4(2.0000714765e-1f);
+		y = y * m + Float4(-2.4999993993e-1f);
+		y = y * m + Float4(3.3333331174e-1f);
+		y = y * m * z;
+		y = y + e * Float4(-2.12194440e-4f);
+		y = y - z * Float4(0.5f);
+		return m + y + e * Float4(0.693359375f);
+	}
+
+	// positive bases only
+	inline Float4 Pow(const Float4& x, const Float4& y)
+	{
+		return Exp(y * Log(x));
+	}
+
+	inline void SinCos(const Float4& x, Float4& sine, Float4& cosine)
+	{
+		Float4 a = Max(x, -x);
+
+		// quadrant and remainder in [-pi/4, pi/4], pi/2 in three parts
+		Float4 q = Round(a * Float4(0.636619772367581343f));
+		Float4 r = a - q * Float4(1.5703125f);
+		r = r - q * Float4(4.837512969970703125e-4f);
+		r = r - q * Float4(7.54978995489188216e-8f);
+		Float4 quadrant = q - Round(q * Float4(0.25f) - Float4(0.375f)) * Float4(4.0f);
+
+		Float4 z = r * r;
+		Float4 s = Float4(-1.9515295891e-4f);
+		s = s * z + Float4(8.3321608736e-3f);
+		s = s * z + Float4(-1.6666654611e-1f);
+		s = s * z * r + r;
+		Float4 c = Float4(2.443315711809948e-5f);
+		c = c * z + Float4(-1.388731625493765e-3f);
+		c = c * z + Float4(4.166664568298827e-2f);
+		c = c * z * z - z * Float4(0.5f) + Float4(1.0f);
+
+		Float4 odd = (quadrant == Float4(1.0f)) | (quadrant == Float4(3.0f));
+		Float4 sineNegative = quadrant >= Float4(2.0f);
+		Float4 cosineNegative = (quadrant == Float4(1.0f)) | (quadrant == Float4(2.0f));
+		sine = Select(odd, c, s);
+		cosine = Select(odd, s, c);
+		sine = Select(sineNegative, -sine, sine);
+		sine = Select(x < Float4(0.0f), -sine, sine);
+		cosine = Select(cosineNegative, -cosine, cosine);
+	}
+
+	inline Float4 Sin(const Float4& x)
+	{
+		Float4 sine, cosine;
+		SinCos(x, sine, cosine);
+		return sine;
+	}
+
+	inline Float4 Cos(const Float4& x)
+	{
+		Float4 sine, cosine;
+		SinCos(x, sine, cosine);
+		return cosine;
+	}
+}
+
+#endif //SIMD_JACOBY
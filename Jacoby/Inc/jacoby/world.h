@@ -0,0 +1,142 @@
+#ifndef PARTICLE_WORLD
+#define PARTICLE_WORLD
+
+#include <Inc/jacoby/types.h>
+#include <Inc/jacoby/particle.h>
+#include <Inc/jacoby/pset.h>
+#include <Inc/jacoby/pfgen.h>
+#include <Inc/jacoby/pfields.h>
+#include <Inc/jacoby/pcontacts.h>
+#include <Inc/jacoby/pcache.h>
+#include <Inc/jacoby/pmultirate.h>
+#include <Inc/jacoby/pintegrator.h>
+#include <vector>
+#include <functional>
+
+namespace jacoby
+{
+	/*
+	* Owner of a simulation: particles, forces acting on them,
+	* contact generators and the resolver.
+	* Step() is the canonical frame, every stage runs exactly once:
+	*	forces -> integration -> contact generation -> contact resolution
+	* Hooks let additional stages run at fixed points of the step.
+	*/
+	class World
+	{
+	public:
+		typedef ParticleSet< FLOAT > ParticleSetType;
+
+		// points of the step where hooks are called, with multi-rate
+		// stepping AfterForces only follows the batch generators
+		enum class Stage
+		{
+			BeforeForces,
+			AfterForces,
+			AfterIntegration,
+			AfterContacts,
+			AfterResolution,
+			Count
+		};
+
+		typedef std::function< void(World&, FLOAT) > StageHook;
+
+	protected:
+		ParticleSetType m_particles;
+
+		ParticleForceManager m_forces;
+
+		// registered as a batch generator on the dynamic partition
+		ParticleForceFields m_fields;
+
+		std::vector< ParticleContactGenerator* > m_contactGenerators;
+
+		std::vector< ParticleContact > m_contacts;
+
+		unsigned m_contactCount;
+
+		ParticleContactResolver m_resolver;
+
+		// with no fixed iteration count the resolver gets two per contact
+		BOOL m_calculateIterations;
+
+		ParticleContactCache m_contactCache;
+
+		BOOL m_warmStarting;
+
+		// steps the dynamic partition in place of forces and integration
+		ParticleMultiRateStepper m_multiRate;
+
+		BOOL m_multiRateEnabled;
+
+		// nullptr integrates every particle on its own
+		ParticleIntegrator* m_integrator;
+
+		std::vector< StageHook > m_hooks[unsigned(Stage::Count)];
+
+		void RunHooks(Stage stage, FLOAT dT);
+
+	public:
+		// iterations == 0 means twice the number of contacts in every step
+		World(unsigned maxContacts, unsigned iterations = 0);
+
+		World(const World&) = delete;
+		World& operator = (const World&) = delete;
+
+		ParticleSetType& Particles();
+
+		ParticleForceManager& Forces();
+
+		/*
+		* Uniform gravity, drag and wind on all dynamic particles, cheaper
+		* than per particle registrations. With multi-rate stepping on they
+		* are updated once per step like other batch generators.
+		*/
+		ParticleForceFields& Fields();
+
+		ParticleContactResolver& Resolver();
+
+		ParticleContactCache& ContactCache();
+
+		// carries contact impulses over to the next step, on by default
+		void SetWarmStarting(BOOL warmStarting);
+
+		/*
+		* Dynamic particles get forces and integration on their own
+		* power-of-two fraction of the step, see ParticleMultiRateStepper.
+		* Hooks after forces then run after the batch generators, registry
+		* forces are evaluated per substep later. Forces hooks add before
+		* or after forces are held over the step like batch forces.
+		* maxLevel 0 turns it off.
+		*/
+		void SetMultiRate(unsigned maxLevel, FLOAT maxDisplacement = 0.1f);
+
+		ParticleMultiRateStepper& MultiRate();
+
+		/*
+		* Scheme for the dynamic partition, nullptr for Particle::Integrate.
+		* Extra force evaluations go through the whole force manager.
+		* Not used while multi-rate stepping is on.
+		*/
+		void SetIntegrator(ParticleIntegrator* integrator);
+
+		void AddContactGenerator(ParticleContactGenerator* generator);
+
+		void RemoveContactGenerator(ParticleContactGenerator* generator);
+
+		void AddHook(Stage stage, const StageHook& hook);
+
+		// fills the contact array from all generators, returns number of contacts
+		unsigned GenerateContacts();
+
+		ParticleContact* Contacts();
+
+		unsigned ContactCount() const;
+
+		unsigned MaxContacts() const;
+
+		void Step(FLOAT dT);
+	};
+}
+
+#endif //PARTICLE_WORLD
@@ -0,0 +1,255 @@
+#include <Inc/jacoby/fixed.h>
+
+namespace jacoby
+{
+	namespace
+	{
+		// constants in Q2.61, tables are generated in that format
+		const LLONG PI_Q61 = 7244019458077122842ll;
+		const LLONG LN2_Q61 = 1598288580650331957ll;
+		const LLONG INV_LN2_Q61 = 3326628274461080623ll;
+		const LLONG ONE_Q61 = 1ll << 61;
+
+		// constants of the Q32.32 kernels
+		const LLONG LOG2E_Q32 = 6196328019ll;
+		const LLONG INV_TWO_PI_Q32 = 683565276ll;
+
+		const unsigned SINE_BITS = 12;
+		const unsigned EXP2_BITS = 10;
+		const unsigned LOG2_BITS = 10;
+
+		/*
+		* Tables are filled from integer Taylor and atanh series on first
+		* use instead of the C library, whose last bits differ between
+		* platforms. One extra entry at the end saves the wrap in the
+		* interpolation.
+		*/
+		struct FixedTables
+		{
+			// sine over a full turn, Q2.30
+			INT sine[(1 << SINE_BITS) + 1];
+
+			// 2^(i / 1024), Q2.61
+			LLONG exp2[(1 << EXP2_BITS) + 1];
+
+			// log2(1 + i / 1024), Q2.61
+			LLONG log2[(1 << LOG2_BITS) + 1];
+
+			FixedTables()
+			{
+				const unsigned quarter = 1 << (SINE_BITS - 2);
+				for (unsigned i = 0; i <= quarter; ++i)
+				{
+					// angle = pi / 2 * i / quarter
+					LLONG angle = FixedMulShift(PI_Q61, LLONG(i) << (61 - SINE_BITS + 1), 61);
+					LLONG angle2 = FixedMulShift(angle, angle, 61);
+					LLONG sum = angle;
+					LLONG term = angle;
+					for (LLONG n = 1; term != 0; ++n)
+					{
+						term = -FixedMulShift(term, angle2, 61) / ((2 * n) * (2 * n + 1));
+						sum += term;
+					}
+					INT value = INT((sum + (1ll << 30)) >> 31);
+					sine[i] = value;
+					sine[2 * quarter - i] = value;
+					sine[2 * quarter + i] = -value;
+					sine[4 * quarter - i] = -value;
+				}
+
+				for (unsigned i = 0; i <= (1u << EXP2_BITS); ++i)
+				{
+					LLONG x = FixedMulShift(LN2_Q61, LLONG(i) << (61 - EXP2_BITS), 61);
+					LLONG sum = ONE_Q61;
+					LLONG term = ONE_Q61;
+					for (LLONG n = 1; term != 0; ++n)
+					{
+						term = FixedMulShift(term, x, 61) / n;
+						sum += term;
+					}
+					exp2[i] = sum;
+				}
+
+				// ln(m) = 2 atanh((m - 1) / (m + 1)), the argument stays below 1/3
+				for (unsigned i = 0; i <= (1u << LOG2_BITS); ++i)
+				{
+					LLONG z = FixedDivShift(LLONG(i), LLONG(i + (2u << LOG2_BITS)), 61);
+					LLONG z2 = FixedMulShift(z, z, 61);
+					LLONG sum = 0;
+					LLONG power = z;
+					for (LLONG n = 1; power != 0; n += 2)
+					{
+						sum += power / n;
+						power = FixedMulShift(power, z2, 61);
+					}
+					log2[i] = FixedMulShift(2 * sum, INV_LN2_Q61, 61);
+				}
+			}
+		};
+
+		const FixedTables& Tables()
+		{
+			static const FixedTables tables;
+			return tables;
+		}
+
+		// sine of a phase in turns, 2^32 per turn, Q32.32 result
+		LLONG SinePhase(UINT phase)
+		{
+			const INT* table = Tables().sine;
+			const unsigned fractionBits = 32 - SINE_BITS;
+			UINT index = phase >> fractionBits;
+			LLONG fraction = phase & ((1u << fractionBits) - 1);
+			LLONG value = table[index] + (((table[index + 1] - LLONG(table[index])) * fraction) >> fractionBits);
+			return value * 4;
+		}
+
+		UINT Phase(LLONG angle)
+		{
+			return UINT(ULLONG(FixedMulShift(angle, INV_TWO_PI_Q32, 32)));
+		}
+	}
+
+	LLONG FixedDivShift(LLONG a, LLONG b, unsigned shift)
+	{
+		const LLONG high = std::numeric_limits< LLONG >::max();
+		const LLONG low = std::numeric_limits< LLONG >::min();
+		if (b == 0)
+			return a < 0 ? low : high;
+#if defined(__SIZEOF_INT128__)
+		__int128 quotient = (__int128(a) * (__int128(1) << shift)) / b;
+		return quotient > high ? high : quotient < low ? low : LLONG(quotient);
+#else
+		BOOL negative = (a < 0) != (b < 0);
+		ULLONG ua = a < 0 ? 0 - ULLONG(a) : ULLONG(a);
+		ULLONG ub = b < 0 ? 0 - ULLONG(b) : ULLONG(b);
+
+		// restoring division of the 128 bit ua * 2^shift
+		ULLONG hi = shift == 0 ? 0 : ua >> (64 - shift);
+		ULLONG lo = ua << shift;
+		ULLONG quotient = 0;
+		ULLONG remainder = 0;
+		BOOL overflow = false;
+		for (int bit = 127; bit >= 0; --bit)
+		{
+			ULLONG next = bit >= 64 ? (hi >> (bit - 64)) & 1 : (lo >> bit) & 1;
+			BOOL carry = (remainder >> 63) != 0;
+			remainder = (remainder << 1) | next;
+			if (carry || remainder >= ub)
+			{
+				remainder -= ub;
+				if (bit < 64)
+					quotient |= 1ull << bit;
+				else
+					overflow = true;
+			}
+		}
+		if (negative)
+			return overflow || quotient > ULLONG(high) + 1 ? low : LLONG(0 - quotient);
+		return overflow || quotient > ULLONG(high) ? high : LLONG(quotient);
+#endif
+	}
+
+	ULLONG FixedSqrtShift(ULLONG value, unsigned shift)
+	{
+		// digit by digit, two bits of value * 2^shift at a time
+		ULLONG root = 0;
+		ULLONG remainder = 0;
+		for (int pair = int((64 + shift) / 2) - 1; pair >= 0; --pair)
+		{
+			int bit = 2 * pair - int(shift);
+			ULLONG bits = bit >= 0 ? (value >> bit) & 3 : 0;
+			remainder = (remainder << 2) | bits;
+			ULLONG trial = (root << 2) | 1;
+			root <<= 1;
+			if (remainder >= trial)
+			{
+				remainder -= trial;
+				root |= 1;
+			}
+		}
+		return root;
+	}
+
+	LLONG FixedSinQ32(LLONG angle)
+	{
+		return SinePhase(Phase(angle));
+	}
+
+	LLONG FixedCosQ32(LLONG angle)
+	{
+		return SinePhase(Phase(angle) + (1u << 30));
+	}
+
+	LLONG FixedExp2Q32(LLONG value)
+	{
+		const LLONG* table = Tables().exp2;
+		const unsigned fractionBits = 32 - EXP2_BITS;
+		LLONG whole = value >> 32;
+		UINT phase = UINT(ULLONG(value));
+		UINT index = phase >> fractionBits;
+		LLONG fraction = phase & ((1u << fractionBits) - 1);
+		LLONG mantissa = table[index] + FixedMulShift(table[index + 1] - table[index], fraction, fractionBits);
+
+		// mantissa * 2^whole in Q32.32
+		LLONG shift = 29 - whole;
+		if (shift >= 63)
+			return 0;
+		if (shift >= 0)
+			return mantissa >> shift;
+		if (shift < -1)
+			return std::numeric_limits< LLONG >::max();
+		return mantissa > (std::numeric_limits< LLONG >::max() >> 1) ? std::numeric_limits< LLONG >::max() : mantissa << 1;
+	}
+
+	LLONG FixedExpQ32(LLONG value)
+	{
+		// exp(x) = 2^(x log2 e), the product saturates instead of wrapping
+		const LLONG limit = 32ll << 32;
+		LLONG scaled = value > limit ? limit : value < -limit ? -limit : value;
+		return FixedExp2Q32(FixedMulShift(scaled, LOG2E_Q32, 32));
+	}
+
+	LLONG FixedLog2Q32(LLONG value)
+	{
+		if (value <= 0)
+			return std::numeric_limits< LLONG >::min();
+
+		int top = 62;
+		while ((value >> top) == 0)
+			--top;
+
+		// value = 2^(top - 32) * m, m in [1, 2) as Q2.61
+		LLONG mantissa = top <= 61 ? value << (61 - top) : value >> (top - 61);
+		LLONG offset = mantissa - ONE_Q61;
+		const unsigned fractionBits = 61 - LOG2_BITS;
+		LLONG index = offset >> fractionBits;
+		LLONG fraction = offset & ((1ll << fractionBits) - 1);
+		const LLONG* table = Tables().log2;
+		LLONG log = table[index] + FixedMulShift(table[index + 1] - table[index], fraction, fractionBits);
+
+		return LLONG(top - 32) * (1ll << 32) + (log >> 29);
+	}
+
+	void IntegrateFixed(Fixed32* position, Fixed32* velocity, const Fixed32* acceleration, unsigned count,
+		Fixed32 dT, Fixed32 damping)
+	{
+		unsigned i = 0;
+		Fixed32x4 dT4(dT);
+		Fixed32x4 damping4(damping);
+		for (; i + 4 <= count; i += 4)
+		{
+			Fixed32x4 v = Fixed32x4::Load(velocity + i);
+			Fixed32x4 aT = Fixed32x4::Load(acceleration + i) * dT4;
+			Fixed32x4 x = Fixed32x4::Load(position + i) + (v * dT4 + (aT * dT4).Half());
+			x.Store(position + i);
+			((v + aT) * damping4).Store(velocity + i);
+		}
+		for (; i < count; ++i)
+		{
+			Fixed32 aT = acceleration[i] * dT;
+			position[i] += velocity[i] * dT + aT * dT / Fixed32(2);
+			velocity[i] = (velocity[i] + aT) * damping;
+		}
+	}
+}
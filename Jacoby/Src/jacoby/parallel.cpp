@@ -0,0 +1,127 @@
+#include <Inc/jacoby/parallel.h>
+#include <algorithm>
+
+namespace jacoby
+{
+	// set while a thread executes a chunk, nested jobs then run serially
+	static thread_local BOOL t_insideJob = false;
+
+	ThreadPool::ThreadPool(unsigned threadCount) :
+		m_body(nullptr),
+		m_next(0),
+		m_end(0),
+		m_grain(1),
+		m_generation(0),
+		m_busy(0),
+		m_stop(false)
+	{
+		Start(threadCount > 1 ? threadCount - 1 : 0);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		Stop();
+	}
+
+	ThreadPool& ThreadPool::Instance()
+	{
+		static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+		return pool;
+	}
+
+	unsigned ThreadPool::ThreadCount() const
+	{
+		return unsigned(m_workers.size()) + 1;
+	}
+
+	void ThreadPool::SetThreadCount(unsigned threadCount)
+	{
+		std::lock_guard< std::mutex > runLock(m_runMutex);
+		Stop();
+		Start(threadCount > 1 ? threadCount - 1 : 0);
+	}
+
+	void ThreadPool::Start(unsigned workerCount)
+	{
+		// no job runs here, so workers may start from the current generation
+		m_stop = false;
+		for (unsigned i = 0; i < workerCount; ++i)
+			m_workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, m_generation));
+	}
+
+	void ThreadPool::Stop()
+	{
+		{
+			std::lock_guard< std::mutex > lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (std::thread& worker : m_workers)
+			worker.join();
+		m_workers.clear();
+	}
+
+	void ThreadPool::Work()
+	{
+		t_insideJob = true;
+		for (;;)
+		{
+			unsigned chunkBegin = m_next.fetch_add(m_grain);
+			if (chunkBegin >= m_end)
+				break;
+			(*m_body)(chunkBegin, std::min(chunkBegin + m_grain, m_end));
+		}
+		t_insideJob = false;
+	}
+
+	void ThreadPool::WorkerLoop(unsigned seenGeneration)
+	{
+		std::unique_lock< std::mutex > lock(m_mutex);
+		for (;;)
+		{
+			m_wake.wait(lock, [&]() { return m_stop || m_generation != seenGeneration; });
+			if (m_stop)
+				return;
+			seenGeneration = m_generation;
+
+			lock.unlock();
+			Work();
+			lock.lock();
+
+			if (--m_busy == 0)
+				m_done.notify_all();
+		}
+	}
+
+	void ThreadPool::Run(unsigned begin, unsigned end, unsigned grain, const RangeFunction& body)
+	{
+		if (end <= begin)
+			return;
+		grain = std::max(grain, 1u);
+
+		if (m_workers.empty() || end - begin <= grain || t_insideJob)
+		{
+			body(begin, end);
+			return;
+		}
+
+		// one job at a time, callers from other threads wait here
+		std::lock_guard< std::mutex > runLock(m_runMutex);
+		{
+			std::lock_guard< std::mutex > lock(m_mutex);
+			m_body = &body;
+			m_next = begin;
+			m_end = end;
+			m_grain = grain;
+			m_busy = unsigned(m_workers.size());
+			++m_generation;
+		}
+		m_wake.notify_all();
+
+		Work();
+
+		std::unique_lock< std::mutex > lock(m_mutex);
+		m_done.wait(lock, [&]() { return m_busy == 0; });
+		m_body = nullptr;
+	}
+}
@@ -0,0 +1,119 @@
+#include <Inc/jacoby/pcache.h>
+#include <algorithm>
+
+namespace jacoby
+{
+	ParticleContactCache::ParticleContactCache(FLOAT warmFactor, FLOAT normalTolerance) :
+		m_warmFactor(warmFactor),
+		m_normalTolerance(normalTolerance),
+		m_hits(0)
+	{}
+
+	BOOL ParticleContactCache::Less(const Entry& lhs, const Entry& rhs)
+	{
+		if (lhs.p_particle[0] != rhs.p_particle[0])
+			return lhs.p_particle[0] < rhs.p_particle[0];
+		if (lhs.p_particle[1] != rhs.p_particle[1])
+			return lhs.p_particle[1] < rhs.p_particle[1];
+		if (lhs.generator != rhs.generator)
+			return lhs.generator < rhs.generator;
+		return lhs.feature < rhs.feature;
+	}
+
+	void ParticleContactCache::SetWarmFactor(FLOAT warmFactor)
+	{
+		m_warmFactor = warmFactor;
+	}
+
+	unsigned ParticleContactCache::WarmStart(ParticleContact* contacts, unsigned count)
+	{
+		m_hits = 0;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleContact& contact = contacts[i];
+			contact.m_warmImpulse = 0.0f;
+			if (m_entries.empty())
+				continue;
+
+			Entry key;
+			key.p_particle[0] = contact.m_particle[0];
+			key.p_particle[1] = contact.m_particle[1] ? contact.m_particle[1] : ParticleContact::Immovable();
+			key.generator = contact.m_generator;
+			key.feature = contact.m_feature;
+
+			auto it = std::lower_bound(m_entries.begin(), m_entries.end(), key, Less);
+			if (it == m_entries.end() || Less(key, *it))
+				continue;
+
+			// the pair may touch on a different side than before
+			if (it->normal * contact.m_contactNormal < m_normalTolerance)
+				continue;
+
+			contact.m_warmImpulse = it->impulse * m_warmFactor;
+			++m_hits;
+		}
+		return m_hits;
+	}
+
+	void ParticleContactCache::Store(const ParticleContact* contacts, unsigned count)
+	{
+		m_entries.clear();
+		for (unsigned i = 0; i < count; ++i)
+		{
+			const ParticleContact& contact = contacts[i];
+			if (contact.m_accumulatedImpulse <= 0.0f)
+				continue;
+
+			Entry entry;
+			entry.p_particle[0] = contact.m_particle[0];
+			entry.p_particle[1] = contact.m_particle[1] ? contact.m_particle[1] : ParticleContact::Immovable();
+			entry.generator = contact.m_generator;
+			entry.feature = contact.m_feature;
+			entry.impulse = contact.m_accumulatedImpulse;
+			entry.normal = contact.m_contactNormal;
+			m_entries.push_back(entry);
+		}
+		std::sort(m_entries.begin(), m_entries.end(), Less);
+	}
+
+	void ParticleContactCache::Relocate(const ParticleRelocationMap< FLOAT >& relocations)
+	{
+		if (relocations.Empty())
+			return;
+
+		unsigned kept = 0;
+		for (Entry& entry : m_entries)
+		{
+			BOOL alive = true;
+			for (unsigned k = 0; k < 2; ++k)
+			{
+				ParticleType* newAddress;
+				if (relocations.Lookup(entry.p_particle[k], newAddress))
+				{
+					entry.p_particle[k] = newAddress;
+					alive = alive && newAddress != nullptr;
+				}
+			}
+			if (alive)
+				m_entries[kept++] = entry;
+		}
+		m_entries.resize(kept);
+		std::sort(m_entries.begin(), m_entries.end(), Less);
+	}
+
+	void ParticleContactCache::Clear()
+	{
+		m_entries.clear();
+		m_hits = 0;
+	}
+
+	unsigned ParticleContactCache::Size() const
+	{
+		return unsigned(m_entries.size());
+	}
+
+	unsigned ParticleContactCache::Hits() const
+	{
+		return m_hits;
+	}
+}
@@ -0,0 +1,161 @@
+#include <Inc/jacoby/pccd.h>
+#include <algorithm>
+#include <math.h>
+
+namespace jacoby
+{
+	ParticleSweptContacts::ParticleSweptContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT threshold) :
+		m_particles(particles),
+		m_radius(radius),
+		m_maxIterations(32),
+		m_swept(0)
+	{
+		SetThreshold(threshold);
+	}
+
+	void ParticleSweptContacts::AddShapes(ParticleStaticContacts* shapes)
+	{
+		m_shapes.push_back(shapes);
+	}
+
+	void ParticleSweptContacts::RemoveShapes(ParticleStaticContacts* shapes)
+	{
+		m_shapes.erase(std::remove(m_shapes.begin(), m_shapes.end(), shapes), m_shapes.end());
+	}
+
+	void ParticleSweptContacts::SetThreshold(FLOAT threshold)
+	{
+		if (threshold <= 0.0f)
+			threshold = m_radius;
+		m_threshold2 = threshold * threshold;
+	}
+
+	void ParticleSweptContacts::SetMaxIterations(unsigned iterations)
+	{
+		m_maxIterations = iterations;
+	}
+
+	void ParticleSweptContacts::Record()
+	{
+		m_previous.resize(m_particles->size());
+		for (unsigned i = 0; i < m_previous.size(); ++i)
+			m_previous[i] = (*m_particles)[i].GetPosition();
+	}
+
+	BOOL ParticleSweptContacts::Sweep(const VectorType& from, const VectorType& to, FLOAT& toi, Hit& hit)
+	{
+		VectorType path = to - from;
+		const FLOAT length = path.Magnitude();
+		if (length <= 0.0f || m_maxIterations == 0)
+			return false;
+
+		SweepQuery query;
+		query.start = from;
+		query.direction = path * (1.0f / length);
+		query.radius = m_radius;
+		query.tolerance = m_radius * 0.01f;
+
+		FLOAT travelled = 0.0f;
+		for (unsigned iteration = 0; iteration < m_maxIterations; ++iteration)
+		{
+			query.point = from + query.direction * travelled;
+
+			// nothing beyond the rest of the path matters
+			SweepResult result(length - travelled);
+			for (ParticleStaticContacts* shapes : m_shapes)
+			{
+				const FLOAT step = result.step;
+				shapes->SweepStep(query, result);
+				if (result.step < step)
+				{
+					hit.restitution = shapes->GetRestitution();
+					hit.generator = shapes->GeneratorId();
+				}
+			}
+
+			if (!result.limited)
+				return false;
+
+			hit.normal = result.normal;
+			hit.feature = result.feature;
+			if (result.gap <= query.tolerance)
+			{
+				toi = travelled / length;
+				hit.penetration = result.gap < 0.0f ? -result.gap : 0.0f;
+				return true;
+			}
+
+			travelled += result.step;
+		}
+
+		// out of steps short of a touch, stopping here beats tunnelling
+		toi = travelled / length;
+		hit.penetration = 0.0f;
+		return true;
+	}
+
+	void ParticleSweptContacts::SweepAll()
+	{
+		m_hits.clear();
+		m_swept = 0;
+		if (m_shapes.empty())
+			return;
+
+		const unsigned count = unsigned(std::min(m_previous.size(), m_particles->size()));
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleType& particle = (*m_particles)[i];
+			if (particle.GetInverseMass() <= 0.0f)
+				continue;
+
+			VectorType displacement = particle.GetPosition() - m_previous[i];
+			if (displacement * displacement <= m_threshold2)
+				continue;
+
+			++m_swept;
+			FLOAT toi;
+			Hit hit;
+			if (Sweep(m_previous[i], particle.GetPosition(), toi, hit))
+			{
+				particle.SetPosition(m_previous[i] + displacement * toi);
+				hit.particle = i;
+				m_hits.push_back(hit);
+			}
+		}
+	}
+
+	void ParticleSweptContacts::Attach(World& world)
+	{
+		world.AddHook(World::Stage::AfterForces, [this](World&, FLOAT) { Record(); });
+		world.AddHook(World::Stage::AfterIntegration, [this](World&, FLOAT) { SweepAll(); });
+		world.AddContactGenerator(this);
+	}
+
+	unsigned ParticleSweptContacts::AddContact(ParticleContact* contact, unsigned limit)
+	{
+		unsigned used = 0;
+		for (unsigned h = 0; h < m_hits.size() && used < limit; ++h)
+		{
+			Hit& hit = m_hits[h];
+			ParticleContact& c = contact[used++];
+			c.m_particle[0] = &(*m_particles)[hit.particle];
+			c.m_particle[1] = ParticleContact::Immovable();
+			c.m_contactNormal = hit.normal;
+			c.m_penetration = hit.penetration;
+			c.m_restitution = hit.restitution;
+			c.m_generator = hit.generator;
+			c.m_feature = hit.feature;
+		}
+		return used;
+	}
+
+	unsigned ParticleSweptContacts::SweptCount() const
+	{
+		return m_swept;
+	}
+
+	unsigned ParticleSweptContacts::HitCount() const
+	{
+		return unsigned(m_hits.size());
+	}
+}
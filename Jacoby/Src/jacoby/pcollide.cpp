@@ -0,0 +1,360 @@
+#include <Inc/jacoby/pcollide.h>
+#include <Inc/jacoby/simd.h>
+#include <limits>
+#include <math.h>
+
+namespace jacoby
+{
+	ParticleStaticContacts::ParticleStaticContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT restitution) :
+		m_particles(particles),
+		m_radius(radius),
+		m_restitution(restitution)
+	{}
+
+	void ParticleStaticContacts::SetRadius(FLOAT radius)
+	{
+		m_radius = radius;
+	}
+
+	void ParticleStaticContacts::SetRestitution(FLOAT restitution)
+	{
+		m_restitution = restitution;
+	}
+
+	FLOAT ParticleStaticContacts::GetRestitution() const
+	{
+		return m_restitution;
+	}
+
+	unsigned ParticleStaticContacts::Gather()
+	{
+		const unsigned count = unsigned(m_particles->size());
+		const unsigned padded = (count + 3) & ~3u;
+
+		// NaN never compares as touching, so padding and skipped particles drop out
+		const FLOAT nan = std::numeric_limits< FLOAT >::quiet_NaN();
+		m_x.assign(padded, nan);
+		m_y.assign(padded, nan);
+		m_z.assign(padded, nan);
+
+		FLOAT minX = MAX_FLOAT, minY = MAX_FLOAT, minZ = MAX_FLOAT;
+		FLOAT maxX = -MAX_FLOAT, maxY = -MAX_FLOAT, maxZ = -MAX_FLOAT;
+		BOOL any = false;
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleType& particle = (*m_particles)[i];
+			if (particle.GetInverseMass() <= 0.0f)
+				continue;
+
+			VectorType& pos = particle.GetPosition();
+			m_x[i] = pos.getX();
+			m_y[i] = pos.getY();
+			m_z[i] = pos.getZ();
+
+			minX = fminf(minX, m_x[i]); maxX = fmaxf(maxX, m_x[i]);
+			minY = fminf(minY, m_y[i]); maxY = fmaxf(maxY, m_y[i]);
+			minZ = fminf(minZ, m_z[i]); maxZ = fmaxf(maxZ, m_z[i]);
+			any = true;
+		}
+
+		m_min = VectorType(minX, minY, minZ);
+		m_max = VectorType(maxX, maxY, maxZ);
+		return any ? padded : 0;
+	}
+
+	void ParticleStaticContacts::WriteContact(ParticleContact& contact, unsigned particle, VectorType normal, FLOAT penetration, unsigned shape)
+	{
+		contact.m_particle[0] = &(*m_particles)[particle];
+		contact.m_particle[1] = ParticleContact::Immovable();
+		contact.m_contactNormal = normal;
+		contact.m_penetration = penetration;
+		contact.m_restitution = m_restitution;
+		contact.m_generator = m_generatorId;
+		contact.m_feature = shape;
+	}
+
+	ParticlePlaneContacts::ParticlePlaneContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT restitution) :
+		ParticleStaticContacts(particles, radius, restitution)
+	{}
+
+	unsigned ParticlePlaneContacts::AddPlane(const VectorType& normal, FLOAT offset)
+	{
+		Plane plane;
+		plane.normal = normal;
+		plane.offset = offset;
+		m_planes.push_back(plane);
+		return unsigned(m_planes.size() - 1);
+	}
+
+	void ParticlePlaneContacts::Clear()
+	{
+		m_planes.clear();
+	}
+
+	unsigned ParticlePlaneContacts::AddContact(ParticleContact* contact, unsigned limit)
+	{
+		if (limit == 0 || m_planes.empty())
+			return 0;
+
+		const unsigned padded = Gather();
+		if (padded == 0)
+			return 0;
+
+		unsigned used = 0;
+		for (unsigned p = 0; p < m_planes.size() && used < limit; ++p)
+		{
+			Plane& plane = m_planes[p];
+			FLOAT nx = plane.normal.getX();
+			FLOAT ny = plane.normal.getY();
+			FLOAT nz = plane.normal.getZ();
+
+			// corner of the bounds deepest along -normal decides if anything can touch
+			FLOAT deepest =
+				nx * (nx > 0.0f ? m_min.getX() : m_max.getX()) +
+				ny * (ny > 0.0f ? m_min.getY() : m_max.getY()) +
+				nz * (nz > 0.0f ? m_min.getZ() : m_max.getZ());
+			if (deepest - plane.offset >= m_radius)
+				continue;
+
+			const Float4 NX = Float4(nx), NY = Float4(ny), NZ = Float4(nz);
+			const Float4 D = Float4(plane.offset + m_radius);
+			const Float4 zero;
+			FLOAT distance[4];
+
+			for (unsigned i = 0; i < padded && used < limit; i += 4)
+			{
+				Float4 dist = Float4::Load(&m_x[i]) * NX + Float4::Load(&m_y[i]) * NY + Float4::Load(&m_z[i]) * NZ - D;
+				unsigned hits = MoveMask(dist < zero);
+				if (hits == 0)
+					continue;
+
+				dist.Store(distance);
+				for (unsigned lane = 0; lane < 4 && used < limit; ++lane)
+				{
+					if (hits & (1u << lane))
+						WriteContact(contact[used++], i + lane, plane.normal, -distance[lane], p);
+				}
+			}
+		}
+		return used;
+	}
+
+	void ParticlePlaneContacts::SweepStep(const SweepQuery& query, SweepResult& result)
+	{
+		for (unsigned i = 0; i < m_planes.size(); ++i)
+		{
+			const Plane& plane = m_planes[i];
+			FLOAT gap = plane.normal * query.point - plane.offset - query.radius;
+			FLOAT advance = SweepResult::Advance(query, gap, plane.normal);
+			if (advance < result.step && plane.normal * query.start - plane.offset - query.radius > query.tolerance)
+				result.Limit(advance, gap, plane.normal, i);
+		}
+	}
+
+	ParticleBoxContacts::ParticleBoxContacts(std::vector< ParticleType >* particles, FLOAT radius, FLOAT restitution) :
+		ParticleStaticContacts(particles, radius, restitution)
+	{}
+
+	unsigned ParticleBoxContacts::AddBox(const VectorType& center, const VectorType& halfSize)
+	{
+		return AddOrientedBox(center, halfSize,
+			VectorType(1.0f, 0.0f, 0.0f), VectorType(0.0f, 1.0f, 0.0f), VectorType(0.0f, 0.0f, 1.0f));
+	}
+
+	unsigned ParticleBoxContacts::AddOrientedBox(const VectorType& center, const VectorType& halfSize,
+		const VectorType& axisX, const VectorType& axisY, const VectorType& axisZ)
+	{
+		Box box;
+		box.center = center;
+		box.axis[0] = axisX;
+		box.axis[1] = axisY;
+		box.axis[2] = axisZ;
+
+		VectorType half = halfSize;
+		box.halfSize[0] = half.getX();
+		box.halfSize[1] = half.getY();
+		box.halfSize[2] = half.getZ();
+
+		FLOAT extent[3] = { 0.0f, 0.0f, 0.0f };
+		for (unsigned a = 0; a < 3; ++a)
+		{
+			extent[0] += fabsf(box.axis[a].getX()) * box.halfSize[a];
+			extent[1] += fabsf(box.axis[a].getY()) * box.halfSize[a];
+			extent[2] += fabsf(box.axis[a].getZ()) * box.halfSize[a];
+		}
+		box.extent = VectorType(extent[0], extent[1], extent[2]);
+
+		m_boxes.push_back(box);
+		return unsigned(m_boxes.size() - 1);
+	}
+
+	void ParticleBoxContacts::Clear()
+	{
+		m_boxes.clear();
+	}
+
+	unsigned ParticleBoxContacts::AddContact(ParticleContact* contact, unsigned limit)
+	{
+		if (limit == 0 || m_boxes.empty())
+			return 0;
+
+		const unsigned padded = Gather();
+		if (padded == 0)
+			return 0;
+
+		const FLOAT r = m_radius;
+		unsigned used = 0;
+		for (unsigned b = 0; b < m_boxes.size() && used < limit; ++b)
+		{
+			Box& box = m_boxes[b];
+
+			// bounds of the particles against bounds of the box
+			if (m_min.getX() - r > box.center.getX() + box.extent.getX() || m_max.getX() + r < box.center.getX() - box.extent.getX() ||
+				m_min.getY() - r > box.center.getY() + box.extent.getY() || m_max.getY() + r < box.center.getY() - box.extent.getY() ||
+				m_min.getZ() - r > box.center.getZ() + box.extent.getZ() || m_max.getZ() + r < box.center.getZ() - box.extent.getZ())
+				continue;
+
+			const Float4 CX = Float4(box.center.getX()), CY = Float4(box.center.getY()), CZ = Float4(box.center.getZ());
+			Float4 U[3][3];
+			Float4 H[3];
+			for (unsigned a = 0; a < 3; ++a)
+			{
+				U[a][0] = Float4(box.axis[a].getX());
+				U[a][1] = Float4(box.axis[a].getY());
+				U[a][2] = Float4(box.axis[a].getZ());
+				H[a] = Float4(box.halfSize[a]);
+			}
+			const Float4 R2 = Float4(r * r);
+			FLOAT local[3][4];
+			FLOAT distance2[4];
+			FLOAT inverseDistance[4];
+
+			for (unsigned i = 0; i < padded && used < limit; i += 4)
+			{
+				Float4 dx = Float4::Load(&m_x[i]) - CX;
+				Float4 dy = Float4::Load(&m_y[i]) - CY;
+				Float4 dz = Float4::Load(&m_z[i]) - CZ;
+
+				// centers in box space, their offset from the closest point of the box
+				Float4 l[3];
+				Float4 dist2;
+				for (unsigned a = 0; a < 3; ++a)
+				{
+					l[a] = dx * U[a][0] + dy * U[a][1] + dz * U[a][2];
+					Float4 outside = l[a] - Min(Max(l[a], -H[a]), H[a]);
+					dist2 = dist2 + outside * outside;
+				}
+
+				unsigned hits = MoveMask(dist2 < R2);
+				if (hits == 0)
+					continue;
+
+				for (unsigned a = 0; a < 3; ++a)
+					l[a].Store(local[a]);
+				dist2.Store(distance2);
+				RSqrt(Select(dist2 > Float4(0.0f), dist2, Float4(1.0f))).Store(inverseDistance);
+
+				// few lanes hit, normals are built per contact
+				for (unsigned lane = 0; lane < 4 && used < limit; ++lane)
+				{
+					if ((hits & (1u << lane)) == 0)
+						continue;
+
+					FLOAT normalLocal[3] = { 0.0f, 0.0f, 0.0f };
+					FLOAT penetration;
+					if (distance2[lane] > 0.0f)
+					{
+						FLOAT inverse = inverseDistance[lane];
+						FLOAT dist = distance2[lane] * inverse;
+						for (unsigned a = 0; a < 3; ++a)
+						{
+							FLOAT l_a = local[a][lane];
+							FLOAT h_a = box.halfSize[a];
+							FLOAT clamped = l_a < -h_a ? -h_a : (l_a > h_a ? h_a : l_a);
+							normalLocal[a] = (l_a - clamped) * inverse;
+						}
+						penetration = r - dist;
+					}
+					else
+					{
+						// center inside the box, push out through the nearest face
+						unsigned axis = 0;
+						FLOAT depth = MAX_FLOAT;
+						for (unsigned a = 0; a < 3; ++a)
+						{
+							FLOAT faceDepth = box.halfSize[a] - fabsf(local[a][lane]);
+							if (faceDepth < depth)
+							{
+								depth = faceDepth;
+								axis = a;
+							}
+						}
+						normalLocal[axis] = local[axis][lane] < 0.0f ? -1.0f : 1.0f;
+						penetration = depth + r;
+					}
+
+					VectorType normal =
+						box.axis[0] * normalLocal[0] +
+						box.axis[1] * normalLocal[1] +
+						box.axis[2] * normalLocal[2];
+					WriteContact(contact[used++], i + lane, normal, penetration, b);
+				}
+			}
+		}
+		return used;
+	}
+
+	FLOAT ParticleBoxContacts::BoxDistance(const Box& box, const VectorType& point, VectorType& normal)
+	{
+		VectorType d = point - box.center;
+
+		FLOAT local[3], outside[3];
+		FLOAT outside2 = 0.0f;
+		for (unsigned a = 0; a < 3; ++a)
+		{
+			local[a] = d * box.axis[a];
+			FLOAT h = box.halfSize[a];
+			outside[a] = local[a] - (local[a] < -h ? -h : (local[a] > h ? h : local[a]));
+			outside2 += outside[a] * outside[a];
+		}
+
+		if (outside2 > 0.0f)
+		{
+			FLOAT inverse = InverseSqrt(outside2);
+			normal = (box.axis[0] * outside[0] + box.axis[1] * outside[1] + box.axis[2] * outside[2]) * inverse;
+			return outside2 * inverse;
+		}
+
+		unsigned axis = 0;
+		FLOAT depth = MAX_FLOAT;
+		for (unsigned a = 0; a < 3; ++a)
+		{
+			FLOAT faceDepth = box.halfSize[a] - fabsf(local[a]);
+			if (faceDepth < depth)
+			{
+				depth = faceDepth;
+				axis = a;
+			}
+		}
+		normal = box.axis[axis] * (local[axis] < 0.0f ? -1.0f : 1.0f);
+		return -depth;
+	}
+
+	void ParticleBoxContacts::SweepStep(const SweepQuery& query, SweepResult& result)
+	{
+		for (unsigned b = 0; b < m_boxes.size(); ++b)
+		{
+			VectorType normal;
+			FLOAT gap = BoxDistance(m_boxes[b], query.point, normal) - query.radius;
+			FLOAT advance = SweepResult::Advance(query, gap, normal);
+			if (advance >= result.step)
+				continue;
+
+			VectorType startNormal;
+			if (BoxDistance(m_boxes[b], query.start, startNormal) - query.radius <= query.tolerance)
+				continue;
+			result.Limit(advance, gap, normal, b);
+		}
+	}
+}
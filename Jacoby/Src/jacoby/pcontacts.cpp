@@ -1,41 +1,85 @@
 #include <Inc/jacoby/pcontacts.h>
+#include <atomic>
+#include <chrono>
+#include <limits>
 
 namespace jacoby
 {
-	void ParticleContact::Resolve(FLOAT dT)
+	unsigned NextContactGeneratorId()
+	{
+		static std::atomic< unsigned > next(1);
+		return next.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	template< typename PrecType >
+	BasicParticleContact< PrecType >::BasicParticleContact() :
+		m_restitution(0.0f),
+		m_penetration(0.0f),
+		m_generator(0),
+		m_feature(0),
+		m_warmImpulse(0.0f),
+		m_accumulatedImpulse(0.0f)
+	{
+		m_particle[0] = nullptr;
+		m_particle[1] = nullptr;
+	}
+
+	template< typename PrecType >
+	typename BasicParticleContact< PrecType >::ParticleType* BasicParticleContact< PrecType >::Immovable()
+	{
+		static ParticleType immovable = []()
+		{
+			ParticleType particle;
+			particle.MakeStatic();
+			return particle;
+		}();
+		return &immovable;
+	}
+
+	template< typename PrecType >
+	void BasicParticleContact< PrecType >::Resolve(PrecType dT)
 	{
 		ResolveVelocity(dT);
 		ResolveInterpenetration(dT);
 	}
 
-	FLOAT ParticleContact::CalculateSeparatingVelocity() const
+	template< typename PrecType >
+	PrecType BasicParticleContact< PrecType >::CalculateSeparatingVelocity() const
 	{
 		VectorType relativeVel = m_particle[0]->GetVelocity();
-		if(m_particle[1]) relativeVel -= m_particle[1]->GetVelocity();
+		relativeVel -= m_particle[1]->GetVelocity();
 		return relativeVel * m_contactNormal;
 	}
 
-	void ParticleContact::ResolveVelocity(FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleContact< PrecType >::ResolveVelocity(PrecType dT)
 	{
-		FLOAT sepVel = CalculateSeparatingVelocity();
+		PrecType sepVel = CalculateSeparatingVelocity();
+
+		PrecType totalIM = m_particle[0]->GetInverseMass() + m_particle[1]->GetInverseMass();
+		if (totalIM <= 0)
+			return;
 
 		if (sepVel > 0.f)
 		{
+			// a warm start that pushes the pair apart is taken back,
+			// but never more than was put in
+			if (m_warmImpulse > 0.0f)
+			{
+				PrecType withdrawn = sepVel / totalIM;
+				if (withdrawn > m_warmImpulse)
+					withdrawn = m_warmImpulse;
+				m_warmImpulse -= withdrawn;
+				ApplyImpulse(-withdrawn);
+			}
 			return;
 		}
 
-		FLOAT totalIM = m_particle[0]->GetInverseMass();
-		if (m_particle[1]) 
-			totalIM += m_particle[1]->GetInverseMass();
-		if (totalIM <= 0)
-			return;
-
-		FLOAT newSepVel = -sepVel * m_restitution;
+		PrecType newSepVel = -sepVel * m_restitution;
 
 		VectorType accCausedVelocity = m_particle[0]->GetAcceleration();
-		if (m_particle[1])
-			accCausedVelocity -= m_particle[1]->GetAcceleration();
-		FLOAT accCausedSepVelocity = (accCausedVelocity * m_contactNormal) * dT;
+		accCausedVelocity -= m_particle[1]->GetAcceleration();
+		PrecType accCausedSepVelocity = (accCausedVelocity * m_contactNormal) * dT;
 
 		if (accCausedSepVelocity < 0.0f)
 		{
@@ -45,9 +89,16 @@ namespace jacoby
 				newSepVel = 0.0f;
 		}
 
-		FLOAT dV = newSepVel - sepVel;
+		PrecType dV = newSepVel - sepVel;
 
-		FLOAT impulse = dV / totalIM;
+		PrecType impulse = dV / totalIM;
+		ApplyImpulse(impulse);
+	}
+
+	template< typename PrecType >
+	void BasicParticleContact< PrecType >::ApplyImpulse(PrecType impulse)
+	{
+		m_accumulatedImpulse += impulse;
 
 		VectorType impulsePerMass = m_contactNormal * impulse;
 
@@ -56,74 +107,246 @@ namespace jacoby
 			impulsePerMass * m_particle[0]->GetInverseMass()
 		);
 
-		if (m_particle[1])
-		{
-			m_particle[1]->SetVelocity(
-				m_particle[1]->GetVelocity() +
-				impulsePerMass * m_particle[1]->GetInverseMass()
-			);
-		}
+		// infinite mass particles have zero inverse mass and are left intact
+		m_particle[1]->SetVelocity(
+			m_particle[1]->GetVelocity() -
+			impulsePerMass * m_particle[1]->GetInverseMass()
+		);
 	}
 
-	void ParticleContact::ResolveInterpenetration(FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleContact< PrecType >::ResolveInterpenetration(PrecType dT)
 	{
+		m_particleMovement[0] = VectorType();
+		m_particleMovement[1] = VectorType();
+
 		if (m_penetration <= 0)
 			return;
 
-		FLOAT totalIM = m_particle[0]->GetInverseMass();
-		if (m_particle[1]) 
-			totalIM += m_particle[1]->GetInverseMass();
+		PrecType totalIM = m_particle[0]->GetInverseMass() + m_particle[1]->GetInverseMass();
 		if (totalIM <= 0)
 			return;
 
 		VectorType movePerIM =
 			m_contactNormal * (m_penetration / totalIM);
 
-		VectorType particleMovement[2];
-		particleMovement[0] = movePerIM * m_particle[0]->GetInverseMass();
-		if (m_particle[1])
-			particleMovement[1] = movePerIM * m_particle[1]->GetInverseMass();
-		else
-			particleMovement[1].clear();
+		m_particleMovement[0] = movePerIM * m_particle[0]->GetInverseMass();
+		m_particleMovement[1] = movePerIM * (-m_particle[1]->GetInverseMass());
 
 		m_particle[0]->SetPosition(
-			m_particle[0]->GetPosition() + particleMovement[0]
+			m_particle[0]->GetPosition() + m_particleMovement[0]
+		);
+		m_particle[1]->SetPosition(
+			m_particle[1]->GetPosition() + m_particleMovement[1]
 		);
-		if (m_particle[1])
+
+		// set exactly, recomputing it from the movement leaves rounding noise
+		m_penetration = 0;
+	}
+
+	template< typename PrecType >
+	void BasicParticleContact< PrecType >::ApplyWarmImpulse()
+	{
+		PrecType totalIM = m_particle[0]->GetInverseMass() + m_particle[1]->GetInverseMass();
+		if (m_warmImpulse <= 0.0f || totalIM <= 0)
 		{
-			m_particle[1]->SetPosition(
-				m_particle[1]->GetPosition() + particleMovement[1]
-			);
+			m_warmImpulse = 0.0f;
+			return;
 		}
+
+		// the whole impulse is applied, even if the pair is not approaching
+		// right now - in a stack only the bottom contact is, the others are
+		// approached once the impulses below them are applied
+		ApplyImpulse(m_warmImpulse);
+	}
+
+	template< typename PrecType >
+	BasicParticleContactResolver< PrecType >::BasicParticleContactResolver(unsigned iter) :
+		m_iter(iter),
+		m_iterUsed(0),
+		m_velocityTolerance(0.0f),
+		m_penetrationTolerance(0.0f),
+		m_timeBudget(0.0f),
+		m_velocityResidual(0.0f),
+		m_penetrationResidual(0.0f),
+		m_budgetExceeded(false)
+	{}
+
+	template< typename PrecType >
+	void BasicParticleContactResolver< PrecType >::SetIterations(unsigned iter)
+	{
+		m_iter = iter;
+	}
+
+	template< typename PrecType >
+	unsigned BasicParticleContactResolver< PrecType >::IterationsUsed() const
+	{
+		return m_iterUsed;
+	}
+
+	template< typename PrecType >
+	void BasicParticleContactResolver< PrecType >::SetTolerance(PrecType velocityTolerance, PrecType penetrationTolerance)
+	{
+		m_velocityTolerance = velocityTolerance;
+		m_penetrationTolerance = penetrationTolerance;
+	}
+
+	template< typename PrecType >
+	void BasicParticleContactResolver< PrecType >::SetTimeBudget(PrecType seconds)
+	{
+		m_timeBudget = seconds;
 	}
 
-	void ParticleContactResolver::ResolveContacts(ParticleContact* contactArray,
+	template< typename PrecType >
+	PrecType BasicParticleContactResolver< PrecType >::VelocityResidual() const
+	{
+		return m_velocityResidual;
+	}
+
+	template< typename PrecType >
+	PrecType BasicParticleContactResolver< PrecType >::PenetrationResidual() const
+	{
+		return m_penetrationResidual;
+	}
+
+	template< typename PrecType >
+	BOOL BasicParticleContactResolver< PrecType >::Converged() const
+	{
+		return m_velocityResidual <= m_velocityTolerance && m_penetrationResidual <= m_penetrationTolerance;
+	}
+
+	template< typename PrecType >
+	BOOL BasicParticleContactResolver< PrecType >::BudgetExceeded() const
+	{
+		return m_budgetExceeded;
+	}
+
+	template< typename PrecType >
+	void BasicParticleContactResolver< PrecType >::MeasureResidual(ContactType* contactArray, unsigned numContacts)
+	{
+		m_velocityResidual = 0.0f;
+		m_penetrationResidual = 0.0f;
+		for (unsigned i = 0; i < numContacts; ++i)
+		{
+			PrecType sepVal = contactArray[i].CalculateSeparatingVelocity();
+			if (sepVal > 0 && contactArray[i].m_warmImpulse > 0)
+				sepVal = -sepVal;
+
+			if (-sepVal > m_velocityResidual)
+				m_velocityResidual = -sepVal;
+			if (contactArray[i].m_penetration > m_penetrationResidual)
+				m_penetrationResidual = contactArray[i].m_penetration;
+		}
+	}
+
+	template< typename PrecType >
+	void BasicParticleContactResolver< PrecType >::ResolveContacts(ContactType* contactArray,
 		unsigned numContacts,
-		FLOAT dT)
+		PrecType dT)
 	{
 		unsigned i;
 
+		// contacts with the world may come with nullptr as the second particle,
+		// after this pass resolution does not need to check for it
+		for (i = 0; i < numContacts; ++i)
+		{
+			if (!contactArray[i].m_particle[1])
+				contactArray[i].m_particle[1] = ContactType::Immovable();
+		}
+
+		// warm start - contacts resting since last step need little more than this
+		for (i = 0; i < numContacts; ++i)
+		{
+			contactArray[i].m_accumulatedImpulse = 0.0f;
+			contactArray[i].ApplyWarmImpulse();
+		}
+
+		typedef std::chrono::steady_clock clock;
+		const BOOL budgeted = m_timeBudget > 0.0f;
+		const clock::time_point deadline = clock::now() +
+			std::chrono::duration_cast< clock::duration >(std::chrono::duration< PrecType >(budgeted ? m_timeBudget : 0.0f));
+
+		BOOL converged = false;
+		m_budgetExceeded = false;
 		m_iterUsed = 0;
 		while (m_iterUsed < m_iter)
 		{
-			FLOAT max = MAX_FLOAT;
+			if (budgeted && clock::now() >= deadline)
+			{
+				m_budgetExceeded = true;
+				break;
+			}
+
+			PrecType max = std::numeric_limits< PrecType >::max();
 			unsigned maxInd = numContacts;
+			PrecType maxVelocity = 0.0f;
+			PrecType maxPenetration = 0.0f;
 			for (i = 0; i < numContacts; ++i)
 			{
-				FLOAT sepVal = contactArray[i].CalculateSeparatingVelocity();
-				if (sepVal < max && (sepVal < 0 || contactArray[i].m_penetration > 0))
+				PrecType sepVal = contactArray[i].CalculateSeparatingVelocity();
+				PrecType penetration = contactArray[i].m_penetration;
+
+				// overshooting warm start counts as much as approaching
+				if (sepVal > 0 && contactArray[i].m_warmImpulse > 0)
+					sepVal = -sepVal;
+
+				if (-sepVal > maxVelocity)
+					maxVelocity = -sepVal;
+				if (penetration > maxPenetration)
+					maxPenetration = penetration;
+
+				if (sepVal < max && (sepVal < -m_velocityTolerance || penetration > m_penetrationTolerance))
 				{
 					max = sepVal;
-					maxInd = 1;
+					maxInd = i;
 				}
 			}
 
+			// the scan already measured the state, nothing to resolve
 			if (maxInd == numContacts)
+			{
+				m_velocityResidual = maxVelocity;
+				m_penetrationResidual = maxPenetration;
+				converged = true;
 				break;
+			}
+
+			ContactType& resolved = contactArray[maxInd];
+			resolved.Resolve(dT);
 
-			contactArray[maxInd].Resolve(dT);
+			// moving particles changes penetration of every contact they take part in
+			for (i = 0; i < numContacts; ++i)
+			{
+				if (i == maxInd)
+					continue;
+
+				ContactType& contact = contactArray[i];
+				for (unsigned a = 0; a < 2; ++a)
+				{
+					for (unsigned b = 0; b < 2; ++b)
+					{
+						if (contact.m_particle[a] == resolved.m_particle[b])
+						{
+							PrecType moved = resolved.m_particleMovement[b] * contact.m_contactNormal;
+							contact.m_penetration += a == 0 ? -moved : moved;
+						}
+					}
+				}
+			}
 
 			++m_iterUsed;
 		}
+
+		if (!converged)
+			MeasureResidual(contactArray, numContacts);
+
+		// whatever was not withdrawn stays, warm impulses are consumed
+		for (i = 0; i < numContacts; ++i)
+			contactArray[i].m_warmImpulse = 0.0f;
 	}
-}
\ No newline at end of file
+
+	template class BasicParticleContact< FLOAT >;
+	template class BasicParticleContact< DOUBLE >;
+	template class BasicParticleContactResolver< FLOAT >;
+	template class BasicParticleContactResolver< DOUBLE >;
+}
@@ -0,0 +1,94 @@
+#include <Inc/jacoby/pemitter.h>
+#include <math.h>
+
+namespace jacoby
+{
+	ParticleEmitter::ParticleEmitter(ParticlePool< FLOAT >* pool, ParticleForceManager* forceManager) :
+		m_pool(pool),
+		m_forceManager(forceManager),
+		m_lifetime(1.0f),
+		m_lifetimeSpread(0.0f),
+		m_rate(0.0f),
+		m_carry(0.0f),
+		m_random(5489u)
+	{}
+
+	void ParticleEmitter::SetPrototype(const ParticleType& prototype)
+	{
+		m_prototype = prototype;
+	}
+
+	void ParticleEmitter::SetPosition(const VectorType& position, const VectorType& spread)
+	{
+		m_position = position;
+		m_positionSpread = spread;
+	}
+
+	void ParticleEmitter::SetVelocity(const VectorType& velocity, const VectorType& spread)
+	{
+		m_velocity = velocity;
+		m_velocitySpread = spread;
+	}
+
+	void ParticleEmitter::SetLifetime(FLOAT lifetime, FLOAT spread)
+	{
+		m_lifetime = lifetime;
+		m_lifetimeSpread = spread;
+	}
+
+	void ParticleEmitter::SetRate(FLOAT rate)
+	{
+		m_rate = rate;
+	}
+
+	void ParticleEmitter::AddForce(ParticleForceGenerator* fg)
+	{
+		m_generators.push_back(fg);
+	}
+
+	unsigned ParticleEmitter::Emit(unsigned count)
+	{
+		unsigned first;
+		count = m_pool->Spawn(count, m_prototype, m_lifetime, first);
+
+		std::uniform_real_distribution< FLOAT > spread(-1.0f, 1.0f);
+		VectorType offset;
+		for (unsigned i = first; i < first + count; ++i)
+		{
+			ParticleType& particle = (*m_pool)[i];
+
+			offset = VectorType(spread(m_random), spread(m_random), spread(m_random));
+			particle.SetPosition(m_position + VectorType::ComponentProduct(offset, m_positionSpread));
+
+			offset = VectorType(spread(m_random), spread(m_random), spread(m_random));
+			particle.SetVelocity(m_velocity + VectorType::ComponentProduct(offset, m_velocitySpread));
+
+			if (m_lifetimeSpread > 0.0f && m_lifetime > 0.0f)
+			{
+				const FLOAT minimum = m_lifetime * 0.01f;
+				FLOAT lifetime = m_lifetime + m_lifetimeSpread * spread(m_random);
+				m_pool->GetLifetime(i) = lifetime > minimum ? lifetime : minimum;
+			}
+		}
+
+		if (m_forceManager)
+		{
+			for (unsigned i = first; i < first + count; ++i)
+			{
+				for (ParticleForceGenerator* fg : m_generators)
+					m_forceManager->Add(&(*m_pool)[i], fg);
+			}
+		}
+
+		return count;
+	}
+
+	unsigned ParticleEmitter::Update(FLOAT dT)
+	{
+		FLOAT toEmit = m_rate * dT + m_carry;
+		FLOAT whole = floorf(toEmit);
+		m_carry = toEmit - whole;
+
+		return Emit(unsigned(whole));
+	}
+}
@@ -1,26 +1,53 @@
 #include <Inc/jacoby/pfgen.h>
+#include <Inc/jacoby/fixed.h>
 #include <algorithm>
 #include <iterator>
-#include <math.h>
+#include <cmath>
 
 namespace jacoby
 {
-	void ParticleForceManager::UpdateForces(FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::UpdateForces(PrecType dT)
 	{
-		RegistryType::iterator it = m_registry.begin();
+		typename RegistryType::iterator it = m_registry.begin();
 		for (; it != m_registry.end(); it++)
 		{
 			it->p_fg->UpdateForce(it->p_particle, dT);
 		}
+
+		UpdateBatchForces(dT);
+	}
+
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::UpdateForces(const StepFunction& stepOf)
+	{
+		for (ParticleForceRegistration& registration : m_registry)
+		{
+			PrecType dT = stepOf(registration.p_particle);
+			if (dT > 0.0f)
+				registration.p_fg->UpdateForce(registration.p_particle, dT);
+		}
 	}
 
-	void ParticleForceManager::Add(ParticleType* prt, ParticleForceGenerator* fg)
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::UpdateBatchForces(PrecType dT)
+	{
+		for (ParticleBatchRegistration& batch : m_batchRegistry)
+		{
+			if (!batch.p_particles->empty())
+				batch.p_fg->UpdateForces(batch.p_particles->data(), unsigned(batch.p_particles->size()), dT);
+		}
+	}
+
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::Add(ParticleType* prt, GeneratorType* fg)
 	{
 		ParticleForceRegistration newEntry = { prt, fg };
 		m_registry.push_back(std::move(newEntry));
 	}
 
-	void ParticleForceManager::Remove(ParticleType* prt, ParticleForceGenerator* fg)
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::Remove(ParticleType* prt, GeneratorType* fg)
 	{
 		ParticleForceRegistration toRemove{ prt , fg };
 		auto is_equal = [toRemove](ParticleForceRegistration &element)
@@ -31,19 +58,96 @@ namespace jacoby
 		m_registry.erase(searchResult);
 	}
 
-	void ParticleForceManager::Clear()
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::AddBatch(std::vector< ParticleType >* particles, BatchGeneratorType* fg)
+	{
+		ParticleBatchRegistration newEntry = { particles, fg };
+		m_batchRegistry.push_back(std::move(newEntry));
+	}
+
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::RemoveBatch(std::vector< ParticleType >* particles, BatchGeneratorType* fg)
+	{
+		auto is_equal = [particles, fg](ParticleBatchRegistration& element)
+		{
+			return particles == element.p_particles && fg == element.p_fg;
+		};
+		auto searchResult = std::find_if(m_batchRegistry.begin(), m_batchRegistry.end(), is_equal);
+		if (searchResult != m_batchRegistry.end())
+			m_batchRegistry.erase(searchResult);
+	}
+
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::Clear()
 	{
 		m_registry.clear();
+		m_batchRegistry.clear();
+	}
+
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::Relocate(const RelocationMapType& relocations)
+	{
+		if (relocations.Empty())
+			return;
+
+		auto is_dead = [&relocations](ParticleForceRegistration& element)
+		{
+			ParticleType* newAddress;
+			if (relocations.Lookup(element.p_particle, newAddress))
+			{
+				if (!newAddress)
+					return true;
+				element.p_particle = newAddress;
+			}
+			return false;
+		};
+		m_registry.erase(std::remove_if(m_registry.begin(), m_registry.end(), is_dead), m_registry.end());
+
+		// generators may be shared between registrations, but have to
+		// see every relocation batch exactly once
+		std::vector< GeneratorType* > generators;
+		generators.reserve(m_registry.size());
+		for (const ParticleForceRegistration& element : m_registry)
+			generators.push_back(element.p_fg);
+		std::sort(generators.begin(), generators.end());
+		generators.erase(std::unique(generators.begin(), generators.end()), generators.end());
+
+		std::vector< GeneratorType* > lost;
+		for (GeneratorType* fg : generators)
+		{
+			if (!fg->Relocate(relocations))
+				lost.push_back(fg);
+		}
+		if (lost.empty())
+			return;
+
+		auto is_lost = [&lost](const ParticleForceRegistration& element)
+		{
+			return std::binary_search(lost.begin(), lost.end(), element.p_fg);
+		};
+		m_registry.erase(std::remove_if(m_registry.begin(), m_registry.end(), is_lost), m_registry.end());
 	}
 
-	ParticleGravity::ParticleGravity(const VectorType& gravity)
+	template< typename PrecType >
+	void BasicParticleForceManager< PrecType >::Track(ParticlePool< PrecType >* pool)
+	{
+		pool->AddRelocationListener([this](const RelocationMapType& relocations)
+		{
+			Relocate(relocations);
+		});
+	}
+
+	template< typename PrecType >
+	BasicParticleGravity< PrecType >::BasicParticleGravity(const VectorType& gravity)
 	{
 		m_gravity = gravity;
 	}
 
-	void ParticleGravity::UpdateForce(ParticleType* particle, FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleGravity< PrecType >::UpdateForce(ParticleType* particle, PrecType dT)
 	{
-		if (particle->Mass() <= 0.f || particle->InverseMass() <= 0.f)
+		// infinite mass, also keeps Mass() from dividing by zero
+		if (particle->InverseMass() <= 0.f)
 		{
 			return;
 		}
@@ -51,64 +155,92 @@ namespace jacoby
 		particle->AddForce(m_gravity * particle->Mass());
 	}
 
-	void ParticleDrag::UpdateForce(ParticleType *particle, FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleDrag< PrecType >::UpdateForce(ParticleType *particle, PrecType dT)
 	{
 		VectorType force = particle->GetVelocity();
 		
-		FLOAT dragCoeff = force.Magnitude();
+		PrecType dragCoeff = force.Normalize();
 		dragCoeff = dragCoeff * m_k1 + dragCoeff * dragCoeff * m_k2;
 
-		force.Normalize();
 		force *= -dragCoeff;
 		particle->AddForce(force);
 	}
 
-	void ParticleSpring::UpdateForce(ParticleType* particle, FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleSpring< PrecType >::UpdateForce(ParticleType* particle, PrecType dT)
 	{
 		VectorType force = particle->GetPosition();
 		force -= m_other->GetPosition();
 
-		FLOAT magnitude = force.Magnitude();
-		magnitude = fabsf(magnitude - m_restLength);
+		using std::abs;
+		PrecType magnitude = force.Normalize();
+		magnitude = abs(magnitude - m_restLength);
 		magnitude *= m_springConstant;
 
-		force.Normalize();
 		force *= -magnitude;
 		particle->AddForce(force);
 	}
 
-	void ParticleAnchoredSpring::UpdateForce(ParticleType* particle, FLOAT dT)
+	// shared by generators that keep a single other particle
+	template< typename PrecType >
+	static BOOL RelocateOther(Particle< PrecType >*& other, const ParticleRelocationMap< PrecType >& relocations)
+	{
+		Particle< PrecType >* newAddress;
+		if (relocations.Lookup(other, newAddress))
+		{
+			if (!newAddress)
+				return false;
+			other = newAddress;
+		}
+		return true;
+	}
+
+	template< typename PrecType >
+	BOOL BasicParticleSpring< PrecType >::Relocate(const RelocationMapType& relocations)
+	{
+		return RelocateOther(m_other, relocations);
+	}
+
+	template< typename PrecType >
+	void BasicParticleAnchoredSpring< PrecType >::UpdateForce(ParticleType* particle, PrecType dT)
 	{
 		VectorType force = particle->GetPosition();
 		force -= *m_anchor;
 
-		FLOAT magnitude = force.Magnitude();
+		PrecType magnitude = force.Normalize();
 		magnitude = (m_restLength - magnitude)* m_springConstant;
 
-		force.Normalize();
 		force *= magnitude;
 		particle->AddForce(force);
 	}
 
-	void ParticleBungee::UpdateForce(ParticleType* particle, FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleBungee< PrecType >::UpdateForce(ParticleType* particle, PrecType dT)
 	{
 		VectorType force = particle->GetPosition();
 		force -= m_other->GetPosition();
 
-		FLOAT magnitude = force.Magnitude();
+		PrecType magnitude = force.Normalize();
 		if(magnitude <= m_restLength)
 			return;
 
 		magnitude = m_springConstant * (m_restLength - magnitude);
 
-		force.Normalize();
 		force *= -magnitude;
 		particle->AddForce(force);
 	}
 
-	void ParticleBuoyancy::UpdateForce(ParticleType* particle, FLOAT dT)
+	template< typename PrecType >
+	BOOL BasicParticleBungee< PrecType >::Relocate(const RelocationMapType& relocations)
 	{
-		FLOAT depth = particle->GetPosition().getY();
+		return RelocateOther(m_other, relocations);
+	}
+
+	template< typename PrecType >
+	void BasicParticleBuoyancy< PrecType >::UpdateForce(ParticleType* particle, PrecType dT)
+	{
+		PrecType depth = particle->GetPosition().getY();
 
 		if (depth >= m_waterHeight + m_maxDepth)
 			return;
@@ -126,27 +258,77 @@ namespace jacoby
 		particle->AddForce(force);
 	}
 
-	void ParticleFakeSpring::UpdateForce(ParticleType* particle, FLOAT dT)
+	template< typename PrecType >
+	void BasicParticleFakeSpring< PrecType >::UpdateCache(PrecType dT)
+	{
+		using std::sqrt;
+		using std::cos;
+		using std::sin;
+		using std::exp;
+		m_gamma = 0.5f * sqrt(4.0f * m_springConstant - m_damping * m_damping);
+		m_cosine = cos(m_gamma * dT);
+		m_sine = sin(m_gamma * dT);
+		m_decay = exp(-0.5f * dT * m_damping);
+		m_cachedStep = dT;
+	}
+
+	template< typename PrecType >
+	void BasicParticleFakeSpring< PrecType >::UpdateForce(ParticleType* particle, PrecType dT)
 	{
 		if (particle->Mass() == 0.0f || particle->InverseMass() == 0.0f)
 			return;
 
-		VectorType position = particle->GetPosition();
-		position -= *m_anchor;
+		if (dT != m_cachedStep)
+			UpdateCache(dT);
 
-		FLOAT gamma = 0.5f * sqrtf(4.0f * m_springConstant - m_damping * m_damping);
-		if (gamma == 0.0f)
+		if (m_gamma == 0.0f)
 			return;
 
-		VectorType c = position * (m_damping / (2.0f * gamma));
-		c += particle->GetVelocity() * (1.0f / gamma);
+		VectorType position = particle->GetPosition();
+		position -= *m_anchor;
+
+		VectorType c = position * (m_damping / (2.0f * m_gamma));
+		c += particle->GetVelocity() * (1.0f / m_gamma);
 
-		VectorType target = position * cosf(gamma * dT) + c * sinf(gamma * dT);
+		VectorType target = position * m_cosine + c * m_sine;
 
-		target *= expf(-0.5f * dT * m_damping);
+		target *= m_decay;
 
 		VectorType accel = (target - position) * (1.0f / (dT * dT)) - particle->GetVelocity() * dT;
 
 		particle->AddForce(accel * particle->Mass());
 	}
-}
\ No newline at end of file
+
+	template class BasicParticleForceManager< FLOAT >;
+	template class BasicParticleForceManager< DOUBLE >;
+	template class BasicParticleForceManager< Fixed32 >;
+	template class BasicParticleForceManager< Fixed64 >;
+	template class BasicParticleGravity< FLOAT >;
+	template class BasicParticleGravity< DOUBLE >;
+	template class BasicParticleGravity< Fixed32 >;
+	template class BasicParticleGravity< Fixed64 >;
+	template class BasicParticleDrag< FLOAT >;
+	template class BasicParticleDrag< DOUBLE >;
+	template class BasicParticleDrag< Fixed32 >;
+	template class BasicParticleDrag< Fixed64 >;
+	template class BasicParticleSpring< FLOAT >;
+	template class BasicParticleSpring< DOUBLE >;
+	template class BasicParticleSpring< Fixed32 >;
+	template class BasicParticleSpring< Fixed64 >;
+	template class BasicParticleAnchoredSpring< FLOAT >;
+	template class BasicParticleAnchoredSpring< DOUBLE >;
+	template class BasicParticleAnchoredSpring< Fixed32 >;
+	template class BasicParticleAnchoredSpring< Fixed64 >;
+	template class BasicParticleBungee< FLOAT >;
+	template class BasicParticleBungee< DOUBLE >;
+	template class BasicParticleBungee< Fixed32 >;
+	template class BasicParticleBungee< Fixed64 >;
+	template class BasicParticleBuoyancy< FLOAT >;
+	template class BasicParticleBuoyancy< DOUBLE >;
+	template class BasicParticleBuoyancy< Fixed32 >;
+	template class BasicParticleBuoyancy< Fixed64 >;
+	template class BasicParticleFakeSpring< FLOAT >;
+	template class BasicParticleFakeSpring< DOUBLE >;
+	template class BasicParticleFakeSpring< Fixed32 >;
+	template class BasicParticleFakeSpring< Fixed64 >;
+}
@@ -0,0 +1,82 @@
+#include <Inc/jacoby/pfields.h>
+#include <math.h>
+
+namespace jacoby
+{
+	ParticleForceFields::ParticleForceFields() :
+		m_k1(0.0f),
+		m_k2(0.0f)
+	{}
+
+	void ParticleForceFields::SetGravity(const VectorType& gravity)
+	{
+		m_gravity = gravity;
+	}
+
+	void ParticleForceFields::SetDrag(FLOAT k1, FLOAT k2)
+	{
+		m_k1 = k1;
+		m_k2 = k2;
+	}
+
+	void ParticleForceFields::SetWind(const VectorType& wind)
+	{
+		m_wind = wind;
+	}
+
+	const VectorType& ParticleForceFields::Gravity() const
+	{
+		return m_gravity;
+	}
+
+	FLOAT ParticleForceFields::LinearDrag() const
+	{
+		return m_k1;
+	}
+
+	FLOAT ParticleForceFields::QuadraticDrag() const
+	{
+		return m_k2;
+	}
+
+	const VectorType& ParticleForceFields::Wind() const
+	{
+		return m_wind;
+	}
+
+	void ParticleForceFields::UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+	{
+		const BOOL gravity = m_gravity.SquareMagnitude() > 0.0f;
+		const BOOL drag = m_k1 != 0.0f || m_k2 != 0.0f;
+		if (!gravity && !drag)
+			return;
+
+		/*
+		* One plain pass over the array. Four particle batches with Float4
+		* measured slower here: gathering lanes out of 80 byte particles
+		* costs more than the divisions and square roots they save.
+		*/
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleType& particle = particles[i];
+			const UINT optOut = particle.FieldOptOut();
+			VectorType force;
+
+			if (gravity && !(optOut & ParticleField::Gravity) && particle.InverseMass() > 0.0f)
+				force = m_gravity * particle.Mass();
+
+			if (drag && !(optOut & ParticleField::Drag))
+			{
+				VectorType relative = particle.GetVelocity();
+				if (!(optOut & ParticleField::Wind))
+					relative -= m_wind;
+
+				// v / |v| * (k1 |v| + k2 |v|^2) needs no normalization
+				const FLOAT coefficient = m_k1 + m_k2 * sqrtf(relative.SquareMagnitude());
+				force.AddScaledVector(relative, -coefficient);
+			}
+
+			particle.AddForce(force);
+		}
+	}
+}
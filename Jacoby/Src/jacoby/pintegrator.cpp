@@ -0,0 +1,267 @@
+#include <Inc/jacoby/pintegrator.h>
+#include <algorithm>
+#include <math.h>
+
+namespace jacoby
+{
+	void ParticleVelocityVerlet::Integrate(std::vector< ParticleType >& particles, const ForceEvaluation&, FLOAT dT)
+	{
+		const unsigned count = unsigned(particles.size());
+		const BOOL history = m_lastAcceleration.size() == count;
+		m_lastAcceleration.resize(count);
+		m_lastStep.resize(count);
+		m_dampingFactors.resize(count);
+		DampingFactors(particles.data(), count, dT, m_dampingFactors.data());
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleType& particle = particles[i];
+			if (particle.Category() != ParticleCategory::Dynamic || !particle.UpdateAcceleration())
+			{
+				particle.IntegrateKinematic(dT);
+				m_lastStep[i] = 0.0f;
+				continue;
+			}
+
+			VectorType& position = particle.GetPosition();
+			VectorType& velocity = particle.GetVelocity();
+			VectorType& acceleration = particle.GetAcceleration();
+
+			// second half of the last step's velocity update
+			if (history && m_lastStep[i] > 0.0f)
+				velocity += (acceleration - m_lastAcceleration[i]) * (0.5f * m_lastStep[i]);
+
+			position += velocity * dT + acceleration * (0.5f * dT * dT);
+			velocity += acceleration * dT;
+			velocity = velocity * m_dampingFactors[i];
+			particle.ClearAccumulator();
+
+			m_lastAcceleration[i] = acceleration;
+			m_lastStep[i] = dT;
+		}
+	}
+
+	unsigned ParticleVelocityVerlet::Evaluations() const
+	{
+		return 1;
+	}
+
+	void ParticleVelocityVerlet::Reset()
+	{
+		m_lastAcceleration.clear();
+		m_lastStep.clear();
+	}
+
+	ParticleRungeKutta::ParticleRungeKutta() :
+		m_evaluations(0)
+	{}
+
+	unsigned ParticleRungeKutta::Evaluations() const
+	{
+		return m_evaluations;
+	}
+
+	void ParticleRungeKutta::Begin(std::vector< ParticleType >& particles)
+	{
+		const unsigned count = unsigned(particles.size());
+		m_x0.resize(count);
+		m_v0.resize(count);
+		for (unsigned s = 0; s < MAX_STAGES; ++s)
+		{
+			m_kx[s].resize(count);
+			m_kv[s].resize(count);
+		}
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			m_x0[i] = particles[i].GetPosition();
+			m_v0[i] = particles[i].GetVelocity();
+		}
+	}
+
+	void ParticleRungeKutta::Derivative(std::vector< ParticleType >& particles, unsigned stage)
+	{
+		std::vector< VectorType >& kx = m_kx[stage];
+		std::vector< VectorType >& kv = m_kv[stage];
+		for (unsigned i = 0; i < particles.size(); ++i)
+		{
+			ParticleType& particle = particles[i];
+			kx[i] = particle.GetVelocity();
+			if (particle.Category() == ParticleCategory::Dynamic && particle.GetInverseMass() > 0.0f)
+				kv[i] = particle.GetForceAccumulator() * particle.GetInverseMass();
+			else
+				kv[i] = VectorType();
+		}
+	}
+
+	void ParticleRungeKutta::Combine(std::vector< ParticleType >& particles, FLOAT h, const FLOAT* weight, unsigned stages)
+	{
+		for (unsigned i = 0; i < particles.size(); ++i)
+		{
+			VectorType dx, dv;
+			for (unsigned s = 0; s < stages; ++s)
+			{
+				if (weight[s] == 0.0f)
+					continue;
+				dx.AddScaledVector(m_kx[s][i], weight[s]);
+				dv.AddScaledVector(m_kv[s][i], weight[s]);
+			}
+			particles[i].GetPosition() = m_x0[i] + dx * h;
+			particles[i].GetVelocity() = m_v0[i] + dv * h;
+		}
+	}
+
+	void ParticleRungeKutta::Stages(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT h,
+		const FLOAT a[][MAX_STAGES], unsigned stages)
+	{
+		for (unsigned s = 1; s < stages; ++s)
+		{
+			Combine(particles, h, a[s], s);
+			for (ParticleType& particle : particles)
+				particle.ClearAccumulator();
+			evaluate(h);
+			Derivative(particles, s);
+			++m_evaluations;
+		}
+	}
+
+	void ParticleRungeKutta::Finish(std::vector< ParticleType >& particles, FLOAT h)
+	{
+		m_dampingFactors.resize(particles.size());
+		DampingFactors(particles.data(), unsigned(particles.size()), h, m_dampingFactors.data());
+
+		for (unsigned i = 0; i < particles.size(); ++i)
+		{
+			ParticleType& particle = particles[i];
+			particle.GetAcceleration() = m_kv[0][i];
+			particle.GetVelocity() = particle.GetVelocity() * m_dampingFactors[i];
+			particle.ClearAccumulator();
+		}
+	}
+
+	void ParticleRK4::Integrate(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT dT)
+	{
+		static const FLOAT A[4][MAX_STAGES] =
+		{
+			{ 0.0f },
+			{ 0.5f },
+			{ 0.0f, 0.5f },
+			{ 0.0f, 0.0f, 1.0f }
+		};
+		static const FLOAT B[4] = { 1.0f / 6.0f, 1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 6.0f };
+
+		m_evaluations = 1;
+		Begin(particles);
+		Derivative(particles, 0);
+		Stages(particles, evaluate, dT, A, 4);
+		Combine(particles, dT, B, 4);
+		Finish(particles, dT);
+	}
+
+	// Fehlberg's coefficients
+	static const FLOAT RKF_A[6][ParticleRungeKutta::MAX_STAGES] =
+	{
+		{ 0.0f },
+		{ 1.0f / 4.0f },
+		{ 3.0f / 32.0f, 9.0f / 32.0f },
+		{ 1932.0f / 2197.0f, -7200.0f / 2197.0f, 7296.0f / 2197.0f },
+		{ 439.0f / 216.0f, -8.0f, 3680.0f / 513.0f, -845.0f / 4104.0f },
+		{ -8.0f / 27.0f, 2.0f, -3544.0f / 2565.0f, 1859.0f / 4104.0f, -11.0f / 40.0f }
+	};
+
+	static const FLOAT RKF_B5[6] = { 16.0f / 135.0f, 0.0f, 6656.0f / 12825.0f, 28561.0f / 56430.0f, -9.0f / 50.0f, 2.0f / 55.0f };
+
+	// fifth minus fourth order weights
+	static const FLOAT RKF_E[6] =
+	{
+		16.0f / 135.0f - 25.0f / 216.0f,
+		0.0f,
+		6656.0f / 12825.0f - 1408.0f / 2565.0f,
+		28561.0f / 56430.0f - 2197.0f / 4104.0f,
+		-9.0f / 50.0f + 1.0f / 5.0f,
+		2.0f / 55.0f
+	};
+
+	ParticleRKF45::ParticleRKF45(FLOAT tolerance, FLOAT minStep) :
+		m_tolerance(tolerance),
+		m_minStep(minStep),
+		m_step(0.0f),
+		m_rejected(0)
+	{}
+
+	void ParticleRKF45::SetTolerance(FLOAT tolerance)
+	{
+		m_tolerance = tolerance;
+	}
+
+	FLOAT ParticleRKF45::Error(FLOAT h) const
+	{
+		FLOAT error = 0.0f;
+		for (unsigned i = 0; i < m_x0.size(); ++i)
+		{
+			VectorType dx, dv;
+			for (unsigned s = 0; s < 6; ++s)
+			{
+				dx.AddScaledVector(m_kx[s][i], RKF_E[s]);
+				dv.AddScaledVector(m_kv[s][i], RKF_E[s]);
+			}
+			error = std::max(error, h * (dx.Magnitude() + h * dv.Magnitude()));
+		}
+		return error;
+	}
+
+	void ParticleRKF45::Integrate(std::vector< ParticleType >& particles, const ForceEvaluation& evaluate, FLOAT dT)
+	{
+		m_evaluations = 1;
+		m_rejected = 0;
+		Begin(particles);
+		Derivative(particles, 0);
+
+		FLOAT h = (m_step > 0.0f) ? m_step : dT;
+		FLOAT remaining = dT;
+		while (remaining > dT * 1e-6f)
+		{
+			const FLOAT step = std::min(h, remaining);
+			Stages(particles, evaluate, step, RKF_A, 6);
+
+			// zero error grows the step by the largest factor
+			const FLOAT ratio = Error(step) / m_tolerance;
+			const FLOAT scale = ratio > 0.0f ? 0.9f * powf(ratio, -0.2f) : 5.0f;
+
+			if (ratio > 1.0f && step > m_minStep)
+			{
+				// the first stage does not depend on the step, it is kept
+				++m_rejected;
+				h = std::max(step * std::max(scale, 0.2f), m_minStep);
+				continue;
+			}
+
+			Combine(particles, step, RKF_B5, 6);
+			Finish(particles, step);
+			remaining -= step;
+
+			// a step cut short to fit dT does not say much about the next one
+			if (step == h)
+				h = step * std::min(scale, 5.0f);
+
+			if (remaining > dT * 1e-6f)
+			{
+				Begin(particles);
+				evaluate(std::min(h, remaining));
+				Derivative(particles, 0);
+				++m_evaluations;
+			}
+		}
+		m_step = h;
+	}
+
+	FLOAT ParticleRKF45::StepSize() const
+	{
+		return m_step;
+	}
+
+	unsigned ParticleRKF45::Rejected() const
+	{
+		return m_rejected;
+	}
+}
@@ -0,0 +1,850 @@
+#include <Inc/jacoby/pmesh.h>
+#include <Inc/jacoby/parallel.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <math.h>
+
+namespace jacoby
+{
+	namespace
+	{
+		struct Point
+		{
+			FLOAT v[3];
+		};
+
+		Point ToPoint(VectorType vector)
+		{
+			Point p = { { vector.getX(), vector.getY(), vector.getZ() } };
+			return p;
+		}
+
+		FLOAT Dot(const Point& a, const Point& b)
+		{
+			return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+		}
+
+		Point Sub(const Point& a, const Point& b)
+		{
+			Point p = { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2] } };
+			return p;
+		}
+
+		Point Mad(const Point& a, const Point& b, FLOAT s)
+		{
+			Point p = { { a.v[0] + b.v[0] * s, a.v[1] + b.v[1] * s, a.v[2] + b.v[2] * s } };
+			return p;
+		}
+
+		// closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+		Point ClosestOnTriangle(const Point& p, const Point& a, const Point& b, const Point& c)
+		{
+			Point ab = Sub(b, a), ac = Sub(c, a), ap = Sub(p, a);
+			FLOAT d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+			if (d1 <= 0.0f && d2 <= 0.0f)
+				return a;
+
+			Point bp = Sub(p, b);
+			FLOAT d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+			if (d3 >= 0.0f && d4 <= d3)
+				return b;
+
+			FLOAT vc = d1 * d4 - d3 * d2;
+			if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+				return Mad(a, ab, d1 / (d1 - d3));
+
+			Point cp = Sub(p, c);
+			FLOAT d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+			if (d6 >= 0.0f && d5 <= d6)
+				return c;
+
+			FLOAT vb = d5 * d2 - d1 * d6;
+			if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+				return Mad(a, ac, d2 / (d2 - d6));
+
+			FLOAT va = d3 * d6 - d5 * d4;
+			if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+				return Mad(b, Sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+			FLOAT denom = 1.0f / (va + vb + vc);
+			return Mad(Mad(a, ab, vb * denom), ac, vc * denom);
+		}
+
+		struct Bounds
+		{
+			FLOAT min[3];
+			FLOAT max[3];
+
+			Bounds()
+			{
+				min[0] = min[1] = min[2] = MAX_FLOAT;
+				max[0] = max[1] = max[2] = -MAX_FLOAT;
+			}
+
+			void Grow(const FLOAT* p)
+			{
+				for (unsigned a = 0; a < 3; ++a)
+				{
+					min[a] = fminf(min[a], p[a]);
+					max[a] = fmaxf(max[a], p[a]);
+				}
+			}
+
+			void Grow(const Bounds& b)
+			{
+				// empty bins would drag the sentinels in
+				if (b.min[0] > b.max[0])
+					return;
+				Grow(b.min);
+				Grow(b.max);
+			}
+
+			FLOAT Area() const
+			{
+				if (min[0] > max[0])
+					return 0.0f;
+				FLOAT dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+				return 2.0f * (dx * dy + dy * dz + dz * dx);
+			}
+		};
+
+		// squared distance from p to the box, zero inside
+		FLOAT BoxDistance2(const FLOAT* p, const FLOAT* min, const FLOAT* max)
+		{
+			FLOAT d2 = 0.0f;
+			for (unsigned a = 0; a < 3; ++a)
+			{
+				FLOAT d = p[a] < min[a] ? min[a] - p[a] : (p[a] > max[a] ? p[a] - max[a] : 0.0f);
+				d2 += d * d;
+			}
+			return d2;
+		}
+
+		const unsigned SAH_BINS = 16;
+
+		// cost of visiting a node relative to testing one triangle
+		const FLOAT SAH_TRAVERSAL_COST = 1.0f;
+
+		// traversals of deeper trees fall back to a heap allocated stack
+		const unsigned STACK_SIZE = 64;
+
+		// every level leaves at most one sibling behind, so depth + 2 entries suffice
+		class TraversalStack
+		{
+			UINT m_local[STACK_SIZE];
+			std::vector< UINT > m_heap;
+			UINT* m_entries;
+			unsigned m_top;
+
+		public:
+			TraversalStack(unsigned depth) : m_entries(m_local), m_top(0)
+			{
+				if (depth + 2 > STACK_SIZE)
+				{
+					m_heap.resize(depth + 2);
+					m_entries = m_heap.data();
+				}
+			}
+
+			BOOL Empty() const { return m_top == 0; }
+
+			void Push(UINT node) { m_entries[m_top++] = node; }
+
+			UINT Pop() { return m_entries[--m_top]; }
+		};
+
+		// PLY scalar types
+		FLOAT ReadBinary(std::istream& in, const std::string& type)
+		{
+			char buffer[8];
+			if (type == "char" || type == "int8")			{ in.read(buffer, 1); return FLOAT(*(signed char*)buffer); }
+			if (type == "uchar" || type == "uint8")			{ in.read(buffer, 1); return FLOAT(*(unsigned char*)buffer); }
+			if (type == "short" || type == "int16")			{ short v; in.read(buffer, 2); memcpy(&v, buffer, 2); return FLOAT(v); }
+			if (type == "ushort" || type == "uint16")		{ unsigned short v; in.read(buffer, 2); memcpy(&v, buffer, 2); return FLOAT(v); }
+			if (type == "int" || type == "int32")			{ int v; in.read(buffer, 4); memcpy(&v, buffer, 4); return FLOAT(v); }
+			if (type == "uint" || type == "uint32")			{ unsigned v; in.read(buffer, 4); memcpy(&v, buffer, 4); return FLOAT(v); }
+			if (type == "float" || type == "float32")		{ float v; in.read(buffer, 4); memcpy(&v, buffer, 4); return FLOAT(v); }
+			if (type == "double" || type == "float64")		{ double v; in.read(buffer, 8); memcpy(&v, buffer, 8); return FLOAT(v); }
+			throw std::runtime_error("PLY: unknown property type " + type);
+		}
+
+		// integer read for list counts and indices, keeps precision floats would lose
+		ULLONG ReadBinaryIndex(std::istream& in, const std::string& type)
+		{
+			char buffer[8];
+			if (type == "char" || type == "int8" || type == "uchar" || type == "uint8")	{ in.read(buffer, 1); return ULLONG(*(unsigned char*)buffer); }
+			if (type == "short" || type == "int16" || type == "ushort" || type == "uint16")	{ unsigned short v; in.read(buffer, 2); memcpy(&v, buffer, 2); return ULLONG(v); }
+			if (type == "int" || type == "int32" || type == "uint" || type == "uint32")		{ unsigned v; in.read(buffer, 4); memcpy(&v, buffer, 4); return ULLONG(v); }
+			throw std::runtime_error("PLY: unsupported list type " + type);
+		}
+	}
+
+	// -------------------------------------------------------------
+	// TriangleMesh
+
+	unsigned TriangleMesh::AddVertex(const VectorType& vertex)
+	{
+		m_vertices.push_back(vertex);
+		return unsigned(m_vertices.size() - 1);
+	}
+
+	void TriangleMesh::AddTriangle(UINT a, UINT b, UINT c)
+	{
+		m_indices.push_back(a);
+		m_indices.push_back(b);
+		m_indices.push_back(c);
+	}
+
+	void TriangleMesh::Clear()
+	{
+		m_vertices.clear();
+		m_indices.clear();
+	}
+
+	unsigned TriangleMesh::VertexCount() const
+	{
+		return unsigned(m_vertices.size());
+	}
+
+	unsigned TriangleMesh::TriangleCount() const
+	{
+		return unsigned(m_indices.size() / 3);
+	}
+
+	const VectorType& TriangleMesh::Vertex(unsigned index) const
+	{
+		return m_vertices[index];
+	}
+
+	const UINT* TriangleMesh::Triangle(unsigned index) const
+	{
+		return &m_indices[3 * index];
+	}
+
+	void TriangleMesh::LoadOBJ(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+			throw std::runtime_error("OBJ: cannot open " + path);
+
+		Clear();
+		std::string line;
+		std::vector< long long > polygon;
+		unsigned lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			++lineNumber;
+			std::istringstream stream(line);
+			std::string tag;
+			stream >> tag;
+
+			if (tag == "v")
+			{
+				FLOAT x, y, z;
+				if (!(stream >> x >> y >> z))
+					throw std::runtime_error("OBJ: bad vertex at line " + std::to_string(lineNumber));
+				AddVertex(VectorType(x, y, z));
+			}
+			else if (tag == "f")
+			{
+				// v, v/vt, v//vn or v/vt/vn, negative indices count from the end
+				polygon.clear();
+				std::string corner;
+				while (stream >> corner)
+				{
+					// strtoll rather than stoll, whose exceptions are not runtime errors
+					const std::string number = corner.substr(0, corner.find('/'));
+					char* end = nullptr;
+					errno = 0;
+					long long index = strtoll(number.c_str(), &end, 10);
+					const BOOL parsed = !number.empty() && *end == '\0' && errno == 0;
+					index = index < 0 ? (long long)(m_vertices.size()) + index : index - 1;
+					if (!parsed || index < 0 || index >= (long long)(m_vertices.size()))
+						throw std::runtime_error("OBJ: bad face index at line " + std::to_string(lineNumber));
+					polygon.push_back(index);
+				}
+				for (size_t k = 2; k < polygon.size(); ++k)
+					AddTriangle(UINT(polygon[0]), UINT(polygon[k - 1]), UINT(polygon[k]));
+			}
+		}
+	}
+
+	void TriangleMesh::LoadPLY(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("PLY: cannot open " + path);
+
+		struct Property
+		{
+			std::string name;
+			std::string type;
+			std::string countType;	// non-empty for lists
+		};
+		struct Element
+		{
+			std::string name;
+			size_t count;
+			std::vector< Property > properties;
+		};
+
+		std::string line;
+		std::getline(file, line);
+		if (line.compare(0, 3, "ply") != 0)
+			throw std::runtime_error("PLY: missing magic in " + path);
+
+		BOOL binary = false;
+		std::vector< Element > elements;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			std::istringstream stream(line);
+			std::string keyword;
+			stream >> keyword;
+			if (keyword == "format")
+			{
+				std::string format;
+				stream >> format;
+				if (format == "binary_little_endian")
+					binary = true;
+				else if (format != "ascii")
+					throw std::runtime_error("PLY: unsupported format " + format);
+			}
+			else if (keyword == "element")
+			{
+				Element element;
+				stream >> element.name >> element.count;
+				elements.push_back(element);
+			}
+			else if (keyword == "property")
+			{
+				if (elements.empty())
+					throw std::runtime_error("PLY: property outside of element");
+				Property property;
+				stream >> property.type;
+				if (property.type == "list")
+					stream >> property.countType >> property.type;
+				stream >> property.name;
+				elements.back().properties.push_back(property);
+			}
+			else if (keyword == "end_header")
+				break;
+		}
+
+		Clear();
+		for (Element& element : elements)
+		{
+			BOOL isVertex = element.name == "vertex";
+			BOOL isFace = element.name == "face";
+			if (isVertex)
+				m_vertices.reserve(element.count);
+
+			for (size_t e = 0; e < element.count; ++e)
+			{
+				FLOAT position[3] = { 0.0f, 0.0f, 0.0f };
+				std::vector< ULLONG > polygon;
+
+				std::istringstream ascii;
+				if (!binary)
+				{
+					if (!std::getline(file, line))
+						throw std::runtime_error("PLY: unexpected end of " + path);
+					ascii.str(line);
+				}
+
+				for (Property& property : element.properties)
+				{
+					if (!property.countType.empty())
+					{
+						ULLONG count;
+						if (binary)
+							count = ReadBinaryIndex(file, property.countType);
+						else
+							ascii >> count;
+
+						for (ULLONG k = 0; k < count; ++k)
+						{
+							ULLONG index;
+							if (binary)
+								index = ReadBinaryIndex(file, property.type);
+							else
+								ascii >> index;
+							if (isFace && (property.name == "vertex_indices" || property.name == "vertex_index"))
+								polygon.push_back(index);
+						}
+						continue;
+					}
+
+					FLOAT value;
+					if (binary)
+						value = ReadBinary(file, property.type);
+					else
+						ascii >> value;
+
+					if (isVertex)
+					{
+						if (property.name == "x") position[0] = value;
+						else if (property.name == "y") position[1] = value;
+						else if (property.name == "z") position[2] = value;
+					}
+				}
+
+				if (!file || (!binary && ascii.fail()))
+					throw std::runtime_error("PLY: malformed " + element.name + " in " + path);
+
+				if (isVertex)
+					AddVertex(VectorType(position[0], position[1], position[2]));
+				if (isFace)
+				{
+					for (ULLONG index : polygon)
+					{
+						if (index >= m_vertices.size())
+							throw std::runtime_error("PLY: bad face index in " + path);
+					}
+					for (size_t k = 2; k < polygon.size(); ++k)
+						AddTriangle(UINT(polygon[0]), UINT(polygon[k - 1]), UINT(polygon[k]));
+				}
+			}
+		}
+	}
+
+	// -------------------------------------------------------------
+	// TriangleBVH
+
+	const UINT TriangleBVH::INVALID_TRIANGLE;
+
+	TriangleBVH::TriangleBVH(unsigned maxLeafSize) :
+		m_maxLeafSize(maxLeafSize > 0 ? maxLeafSize : 1),
+		m_depth(0)
+	{}
+
+	BOOL TriangleBVH::Empty() const
+	{
+		return m_nodes.empty();
+	}
+
+	unsigned TriangleBVH::NodeCount() const
+	{
+		return unsigned(m_nodes.size());
+	}
+
+	void TriangleBVH::Bounds(VectorType& min, VectorType& max) const
+	{
+		if (m_nodes.empty())
+		{
+			min = VectorType();
+			max = VectorType();
+			return;
+		}
+		const Node& root = m_nodes[0];
+		min = VectorType(root.min[0], root.min[1], root.min[2]);
+		max = VectorType(root.max[0], root.max[1], root.max[2]);
+	}
+
+	void TriangleBVH::Build(const TriangleMesh& mesh)
+	{
+		const unsigned count = mesh.TriangleCount();
+		m_nodes.clear();
+		m_triangles.clear();
+		m_sourceIndex.clear();
+		m_faceNormals.clear();
+		m_depth = 0;
+		if (count == 0)
+			return;
+
+		std::vector< Triangle > source(count);
+		std::vector< VectorType > centroids(count);
+		std::vector< UINT > order(count);
+		for (unsigned t = 0; t < count; ++t)
+		{
+			const UINT* indices = mesh.Triangle(t);
+			for (unsigned k = 0; k < 3; ++k)
+				source[t].vertex[k] = mesh.Vertex(indices[k]);
+			centroids[t] = (source[t].vertex[0] + source[t].vertex[1] + source[t].vertex[2]) * (1.0f / 3.0f);
+			order[t] = t;
+		}
+
+		// a binary tree with leaves of at least one triangle has fewer than 2n nodes
+		m_nodes.reserve(2 * count);
+		BuildNode(order, centroids, source, 0, count, 0);
+
+		m_triangles.resize(count);
+		m_sourceIndex = order;
+		for (unsigned t = 0; t < count; ++t)
+			m_triangles[t] = source[order[t]];
+
+		m_faceNormals.resize(count);
+		for (unsigned t = 0; t < count; ++t)
+		{
+			const Triangle& triangle = source[t];
+			VectorType normal = (triangle.vertex[1] - triangle.vertex[0]) % (triangle.vertex[2] - triangle.vertex[0]);
+			if (normal.SquareMagnitude() > 0.0f)
+				normal.Normalize();
+			else
+				normal = VectorType(0.0f, 1.0f, 0.0f);
+			m_faceNormals[t] = normal;
+		}
+	}
+
+	unsigned TriangleBVH::BuildNode(std::vector< UINT >& order, const std::vector< VectorType >& centroids,
+		const std::vector< Triangle >& source, unsigned first, unsigned count, unsigned depth)
+	{
+		if (depth > m_depth)
+			m_depth = depth;
+		unsigned nodeIndex = unsigned(m_nodes.size());
+		m_nodes.push_back(Node());
+
+		jacoby::Bounds bounds, centroidBounds;
+		for (unsigned i = first; i < first + count; ++i)
+		{
+			const Triangle& triangle = source[order[i]];
+			for (unsigned k = 0; k < 3; ++k)
+				bounds.Grow(ToPoint(triangle.vertex[k]).v);
+			centroidBounds.Grow(ToPoint(centroids[order[i]]).v);
+		}
+
+		Node node;
+		for (unsigned a = 0; a < 3; ++a)
+		{
+			node.min[a] = bounds.min[a];
+			node.max[a] = bounds.max[a];
+		}
+		node.rightOrFirst = first;
+		node.count = count;
+
+		// binned SAH over the axis with the widest centroid spread
+		unsigned axis = 0;
+		for (unsigned a = 1; a < 3; ++a)
+		{
+			if (centroidBounds.max[a] - centroidBounds.min[a] > centroidBounds.max[axis] - centroidBounds.min[axis])
+				axis = a;
+		}
+		FLOAT extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+
+		unsigned split = 0;
+		if (count > 1 && extent > 0.0f)
+		{
+			jacoby::Bounds binBounds[SAH_BINS];
+			unsigned binCount[SAH_BINS] = { 0 };
+			FLOAT scale = FLOAT(SAH_BINS) / extent;
+			auto binOf = [&](UINT t)
+			{
+				unsigned bin = unsigned((ToPoint(centroids[t]).v[axis] - centroidBounds.min[axis]) * scale);
+				return bin < SAH_BINS ? bin : SAH_BINS - 1;
+			};
+
+			for (unsigned i = first; i < first + count; ++i)
+			{
+				unsigned bin = binOf(order[i]);
+				++binCount[bin];
+				for (unsigned k = 0; k < 3; ++k)
+					binBounds[bin].Grow(ToPoint(source[order[i]].vertex[k]).v);
+			}
+
+			// sweep from the right, then from the left evaluating every plane
+			FLOAT rightArea[SAH_BINS];
+			unsigned rightCount[SAH_BINS];
+			jacoby::Bounds accumulated;
+			unsigned accumulatedCount = 0;
+			for (unsigned b = SAH_BINS - 1; b > 0; --b)
+			{
+				accumulated.Grow(binBounds[b]);
+				accumulatedCount += binCount[b];
+				rightArea[b] = accumulated.Area();
+				rightCount[b] = accumulatedCount;
+			}
+
+			FLOAT bestCost = MAX_FLOAT;
+			unsigned bestPlane = 0;
+			accumulated = jacoby::Bounds();
+			accumulatedCount = 0;
+			for (unsigned b = 1; b < SAH_BINS; ++b)
+			{
+				accumulated.Grow(binBounds[b - 1]);
+				accumulatedCount += binCount[b - 1];
+				if (accumulatedCount == 0 || rightCount[b] == 0)
+					continue;
+
+				FLOAT cost = accumulated.Area() * FLOAT(accumulatedCount) + rightArea[b] * FLOAT(rightCount[b]);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestPlane = b;
+				}
+			}
+
+			// split only if visiting two children beats testing every triangle,
+			// unless the leaf would be too big
+			FLOAT leafCost = bounds.Area() * FLOAT(count);
+			FLOAT splitCost = bounds.Area() * SAH_TRAVERSAL_COST + bestCost;
+			if (bestPlane > 0 && (splitCost < leafCost || count > m_maxLeafSize))
+			{
+				UINT* begin = &order[first];
+				UINT* middle = std::partition(begin, begin + count, [&](UINT t) { return binOf(t) < bestPlane; });
+				split = unsigned(middle - begin);
+			}
+		}
+		else if (count > m_maxLeafSize)
+		{
+			// all centroids coincide, any halving is as good as another
+			split = count / 2;
+		}
+
+		if (split == 0 || split == count)
+		{
+			m_nodes[nodeIndex] = node;
+			return nodeIndex;
+		}
+
+		BuildNode(order, centroids, source, first, split, depth + 1);
+		unsigned right = BuildNode(order, centroids, source, first + split, count - split, depth + 1);
+
+		node.rightOrFirst = right;
+		node.count = 0;
+		m_nodes[nodeIndex] = node;
+		return nodeIndex;
+	}
+
+	UINT TriangleBVH::Closest(const VectorType& point, FLOAT radius, VectorType& closest, FLOAT& distance2) const
+	{
+		if (m_nodes.empty())
+			return INVALID_TRIANGLE;
+
+		const Point p = ToPoint(point);
+		FLOAT best = radius * radius;
+		UINT bestTriangle = INVALID_TRIANGLE;
+		Point bestPoint = p;
+
+		TraversalStack stack(m_depth);
+		stack.Push(0);
+		while (!stack.Empty())
+		{
+			const Node& node = m_nodes[stack.Pop()];
+			if (BoxDistance2(p.v, node.min, node.max) >= best)
+				continue;
+
+			if (node.count > 0)
+			{
+				for (unsigned t = node.rightOrFirst; t < node.rightOrFirst + node.count; ++t)
+				{
+					const Triangle& triangle = m_triangles[t];
+					Point q = ClosestOnTriangle(p, ToPoint(triangle.vertex[0]), ToPoint(triangle.vertex[1]), ToPoint(triangle.vertex[2]));
+					Point d = Sub(p, q);
+					FLOAT d2 = Dot(d, d);
+					if (d2 < best)
+					{
+						best = d2;
+						bestTriangle = t;
+						bestPoint = q;
+					}
+				}
+				continue;
+			}
+
+			// visit the nearer child first, it shrinks the search radius sooner
+			UINT left = UINT(&node - m_nodes.data()) + 1;
+			UINT right = node.rightOrFirst;
+			FLOAT leftDistance = BoxDistance2(p.v, m_nodes[left].min, m_nodes[left].max);
+			FLOAT rightDistance = BoxDistance2(p.v, m_nodes[right].min, m_nodes[right].max);
+			if (leftDistance < rightDistance)
+			{
+				stack.Push(right);
+				stack.Push(left);
+			}
+			else
+			{
+				stack.Push(left);
+				stack.Push(right);
+			}
+		}
+
+		if (bestTriangle == INVALID_TRIANGLE)
+			return INVALID_TRIANGLE;
+
+		closest = VectorType(bestPoint.v[0], bestPoint.v[1], bestPoint.v[2]);
+		distance2 = best;
+		return m_sourceIndex[bestTriangle];
+	}
+
+	void TriangleBVH::SweepStep(const SweepQuery& query, SweepResult& result) const
+	{
+		if (m_nodes.empty())
+			return;
+
+		const Point p = ToPoint(query.point);
+		const Point start = ToPoint(query.start);
+
+		TraversalStack stack(m_depth);
+		stack.Push(0);
+		while (!stack.Empty())
+		{
+			// the advance to a triangle is at least its gap, which the box distance bounds
+			const Node& node = m_nodes[stack.Pop()];
+			const FLOAT reach = result.step + query.radius;
+			if (BoxDistance2(p.v, node.min, node.max) >= reach * reach)
+				continue;
+
+			if (node.count > 0)
+			{
+				for (unsigned t = node.rightOrFirst; t < node.rightOrFirst + node.count; ++t)
+				{
+					const Triangle& triangle = m_triangles[t];
+					const Point a = ToPoint(triangle.vertex[0]), b = ToPoint(triangle.vertex[1]), c = ToPoint(triangle.vertex[2]);
+					Point d = Sub(p, ClosestOnTriangle(p, a, b, c));
+					FLOAT d2 = Dot(d, d);
+
+					VectorType normal;
+					FLOAT gap;
+					if (d2 > 1e-12f)
+					{
+						FLOAT inverse = InverseSqrt(d2);
+						normal = VectorType(d.v[0], d.v[1], d.v[2]) * inverse;
+						gap = d2 * inverse - query.radius;
+					}
+					else
+					{
+						// right on the triangle, face it against the path
+						normal = m_faceNormals[m_sourceIndex[t]];
+						if (normal * query.direction > 0.0f)
+							normal = normal * -1.0f;
+						gap = -query.radius;
+					}
+
+					FLOAT advance = SweepResult::Advance(query, gap, normal);
+					if (advance >= result.step)
+						continue;
+
+					Point s = Sub(start, ClosestOnTriangle(start, a, b, c));
+					FLOAT startDistance = sqrtf(Dot(s, s));
+					if (startDistance - query.radius <= query.tolerance)
+						continue;
+
+					result.Limit(advance, gap, normal, m_sourceIndex[t]);
+				}
+				continue;
+			}
+
+			UINT left = UINT(&node - m_nodes.data()) + 1;
+			UINT right = node.rightOrFirst;
+			FLOAT leftDistance = BoxDistance2(p.v, m_nodes[left].min, m_nodes[left].max);
+			FLOAT rightDistance = BoxDistance2(p.v, m_nodes[right].min, m_nodes[right].max);
+			if (leftDistance < rightDistance)
+			{
+				stack.Push(right);
+				stack.Push(left);
+			}
+			else
+			{
+				stack.Push(left);
+				stack.Push(right);
+			}
+		}
+	}
+
+	VectorType TriangleBVH::FaceNormal(UINT sourceTriangle) const
+	{
+		return m_faceNormals[sourceTriangle];
+	}
+
+	// -------------------------------------------------------------
+	// ParticleMeshContacts
+
+	ParticleMeshContacts::ParticleMeshContacts(std::vector< ParticleType >* particles, const TriangleBVH* bvh,
+		FLOAT radius, FLOAT restitution, BOOL parallel) :
+		ParticleStaticContacts(particles, radius, restitution),
+		m_bvh(bvh),
+		m_parallel(parallel)
+	{}
+
+	void ParticleMeshContacts::SetParallel(BOOL parallel)
+	{
+		m_parallel = parallel;
+	}
+
+	unsigned ParticleMeshContacts::AddContact(ParticleContact* contact, unsigned limit)
+	{
+		if (limit == 0 || m_bvh == nullptr || m_bvh->Empty())
+			return 0;
+
+		const unsigned padded = Gather();
+		if (padded == 0)
+			return 0;
+
+		// whole mesh out of reach of all particles
+		VectorType meshMin, meshMax;
+		m_bvh->Bounds(meshMin, meshMax);
+		const FLOAT r = m_radius;
+		if (m_min.getX() - r > meshMax.getX() || m_max.getX() + r < meshMin.getX() ||
+			m_min.getY() - r > meshMax.getY() || m_max.getY() + r < meshMin.getY() ||
+			m_min.getZ() - r > meshMax.getZ() || m_max.getZ() + r < meshMin.getZ())
+			return 0;
+
+		const unsigned count = unsigned(m_particles->size());
+		m_hitTriangle.resize(count);
+		m_hitNormal.resize(count);
+		m_hitPenetration.resize(count);
+
+		auto query = [&](unsigned i)
+		{
+			m_hitTriangle[i] = TriangleBVH::INVALID_TRIANGLE;
+
+			// NaN marks particles left out by Gather
+			if (m_x[i] != m_x[i])
+				return;
+
+			VectorType position(m_x[i], m_y[i], m_z[i]);
+			VectorType closest;
+			FLOAT distance2;
+			UINT triangle = m_bvh->Closest(position, r, closest, distance2);
+			if (triangle == TriangleBVH::INVALID_TRIANGLE)
+				return;
+
+			VectorType normal;
+			FLOAT distance = 0.0f;
+			if (distance2 > 1e-12f)
+			{
+				FLOAT inverse = InverseSqrt(distance2);
+				distance = distance2 * inverse;
+				normal = (position - closest) * inverse;
+			}
+			else
+				normal = m_bvh->FaceNormal(triangle);
+
+			m_hitTriangle[i] = triangle;
+			m_hitNormal[i] = normal;
+			m_hitPenetration[i] = r - distance;
+		};
+
+		if (m_parallel)
+			ParallelFor(0, count, 256, query);
+		else
+		{
+			for (unsigned i = 0; i < count; ++i)
+				query(i);
+		}
+
+		// serial pass keeps the order deterministic
+		unsigned used = 0;
+		for (unsigned i = 0; i < count && used < limit; ++i)
+		{
+			if (m_hitTriangle[i] != TriangleBVH::INVALID_TRIANGLE)
+				WriteContact(contact[used++], i, m_hitNormal[i], m_hitPenetration[i], m_hitTriangle[i]);
+		}
+		return used;
+	}
+
+	void ParticleMeshContacts::SweepStep(const SweepQuery& query, SweepResult& result)
+	{
+		if (m_bvh == nullptr || m_bvh->Empty())
+			return;
+
+		m_bvh->SweepStep(query, result);
+	}
+}
@@ -0,0 +1,281 @@
+#include <Inc/jacoby/pmforce.h>
+#include <Inc/jacoby/parallel.h>
+#include <algorithm>
+#include <stdexcept>
+#include <math.h>
+
+namespace jacoby
+{
+	static const FLOAT PI = 3.14159265358979f;
+
+	ParticleMeshGravity::ParticleMeshGravity(FLOAT gravitationalConstant, const VectorType& origin, FLOAT boxSize, unsigned cells) :
+		m_gravitationalConstant(gravitationalConstant),
+		m_cells(cells),
+		m_boxSize(boxSize),
+		m_cellSize(boxSize / FLOAT(cells))
+	{
+		if (cells < 2 || (cells & (cells - 1)) != 0)
+			throw std::runtime_error("Particle mesh needs power of 2 cells per axis");
+
+		VectorType corner = origin;
+		m_origin[0] = corner.getX();
+		m_origin[1] = corner.getY();
+		m_origin[2] = corner.getZ();
+
+		const unsigned n = m_cells;
+		const size_t total = size_t(n) * n * n;
+		m_grid.resize(total);
+		for (unsigned d = 0; d < 3; ++d)
+			m_acc[d].resize(total);
+		m_slabStart.resize(n + 1);
+
+		m_twiddles.resize(n / 2);
+		for (unsigned k = 0; k < n / 2; ++k)
+			m_twiddles[k] = std::polar(1.0f, -2.0f * PI * FLOAT(k) / FLOAT(n));
+
+		unsigned bits = 0;
+		while ((1u << bits) < n)
+			++bits;
+		m_bitReverse.resize(n);
+		for (unsigned i = 0; i < n; ++i)
+		{
+			unsigned r = 0;
+			for (unsigned b = 0; b < bits; ++b)
+				r |= ((i >> b) & 1u) << (bits - 1 - b);
+			m_bitReverse[i] = r;
+		}
+
+		// eigenvalues of the 7-point discrete laplacian, (2 / h sin(pi k / n))^2
+		// per axis. The central difference gradient used later composes to
+		// the wider (sin(2 pi k / n) / h)^2 stencil instead, the two only
+		// agree for long wavelengths
+		std::vector< FLOAT > k2(n);
+		for (unsigned i = 0; i < n; ++i)
+		{
+			FLOAT s = 2.0f / m_cellSize * sinf(PI * FLOAT(i) / FLOAT(n));
+			k2[i] = s * s;
+		}
+		const FLOAT scale = -4.0f * PI * m_gravitationalConstant / FLOAT(total);
+		m_greens.resize(total);
+		for (unsigned z = 0; z < n; ++z)
+			for (unsigned y = 0; y < n; ++y)
+				for (unsigned x = 0; x < n; ++x)
+				{
+					FLOAT k = k2[x] + k2[y] + k2[z];
+					m_greens[x + n * (y + n * z)] = (k > 0.0f) ? scale / k : 0.0f;
+				}
+	}
+
+	unsigned ParticleMeshGravity::Cells() const
+	{
+		return m_cells;
+	}
+
+	void ParticleMeshGravity::ComputeWeights(ParticleType* particles, unsigned count)
+	{
+		const unsigned n = m_cells;
+		const FLOAT invCell = 1.0f / m_cellSize;
+		m_cellIndex.resize(3 * size_t(count));
+		m_weights.resize(3 * size_t(count));
+
+		// lower cell of the cloud and weight of the upper cell, per axis
+		ParallelFor(0, count, 4096, [&](unsigned i)
+		{
+			VectorType& pos = particles[i].GetPosition();
+			FLOAT p[3] = { pos.getX(), pos.getY(), pos.getZ() };
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				FLOAT u = (p[d] - m_origin[d]) * invCell - 0.5f;
+				FLOAT cell = floorf(u);
+				INT c = INT(cell) % INT(n);
+				if (c < 0)
+					c += INT(n);
+				m_cellIndex[3 * i + d] = UINT(c);
+				m_weights[3 * i + d] = u - cell;
+			}
+		});
+
+		std::fill(m_slabStart.begin(), m_slabStart.end(), 0u);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			if (particles[i].InverseMass() > 0.0f)
+				++m_slabStart[m_cellIndex[3 * i] + 1];
+		}
+		for (unsigned x = 0; x < n; ++x)
+			m_slabStart[x + 1] += m_slabStart[x];
+
+		std::vector< UINT > offsets(m_slabStart.begin(), m_slabStart.end() - 1);
+		m_slabParticles.resize(m_slabStart[n]);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			if (particles[i].InverseMass() > 0.0f)
+				m_slabParticles[offsets[m_cellIndex[3 * i]]++] = i;
+		}
+	}
+
+	void ParticleMeshGravity::Deposit(ParticleType* particles)
+	{
+		const unsigned n = m_cells;
+		const FLOAT invVolume = 1.0f / (m_cellSize * m_cellSize * m_cellSize);
+		std::fill(m_grid.begin(), m_grid.end(), ComplexType(0.0f, 0.0f));
+
+		// a particle in slab x writes to slabs x and x + 1,
+		// so slabs of equal parity never touch the same cells
+		for (unsigned parity = 0; parity < 2; ++parity)
+		{
+			ParallelFor(0, n / 2, 1, [&](unsigned s)
+			{
+				unsigned x = 2 * s + parity;
+				for (UINT k = m_slabStart[x]; k < m_slabStart[x + 1]; ++k)
+				{
+					UINT i = m_slabParticles[k];
+					FLOAT mass = invVolume / particles[i].InverseMass();
+					const UINT* c = &m_cellIndex[3 * i];
+					const FLOAT* w = &m_weights[3 * i];
+					for (unsigned corner = 0; corner < 8; ++corner)
+					{
+						unsigned ox = corner & 1u, oy = (corner >> 1) & 1u, oz = (corner >> 2) & 1u;
+						unsigned cx = (c[0] + ox) & (n - 1);
+						unsigned cy = (c[1] + oy) & (n - 1);
+						unsigned cz = (c[2] + oz) & (n - 1);
+						FLOAT weight = (ox ? w[0] : 1.0f - w[0])
+							* (oy ? w[1] : 1.0f - w[1])
+							* (oz ? w[2] : 1.0f - w[2]);
+						m_grid[cx + n * (cy + n * cz)] += mass * weight;
+					}
+				}
+			});
+		}
+	}
+
+	// iterative radix-2 transform, inverse is not normalized
+	void ParticleMeshGravity::TransformLine(ComplexType* line, BOOL inverse) const
+	{
+		const unsigned n = m_cells;
+		for (unsigned i = 0; i < n; ++i)
+		{
+			unsigned r = m_bitReverse[i];
+			if (r > i)
+				std::swap(line[i], line[r]);
+		}
+
+		for (unsigned len = 2; len <= n; len <<= 1)
+		{
+			const unsigned half = len / 2;
+			const unsigned step = n / len;
+			for (unsigned start = 0; start < n; start += len)
+			{
+				for (unsigned j = 0; j < half; ++j)
+				{
+					ComplexType w = m_twiddles[j * step];
+					if (inverse)
+						w = std::conj(w);
+					ComplexType u = line[start + j];
+					ComplexType v = line[start + j + half] * w;
+					line[start + j] = u + v;
+					line[start + j + half] = u - v;
+				}
+			}
+		}
+	}
+
+	void ParticleMeshGravity::Transform(BOOL inverse)
+	{
+		const unsigned n = m_cells;
+		const size_t strides[3] = { 1, n, size_t(n) * n };
+
+		for (unsigned axis = 0; axis < 3; ++axis)
+		{
+			const size_t stride = strides[axis];
+			// lines are indexed by the two remaining coordinates
+			const size_t outerStride = (axis == 2) ? n : strides[2];
+			const size_t innerStride = (axis == 0) ? n : 1;
+
+			ParallelForRange(0, n * n, 16, [&](unsigned begin, unsigned end)
+			{
+				std::vector< ComplexType > line(n);
+				for (unsigned l = begin; l < end; ++l)
+				{
+					size_t base = (l / n) * outerStride + (l % n) * innerStride;
+					for (unsigned i = 0; i < n; ++i)
+						line[i] = m_grid[base + i * stride];
+					TransformLine(line.data(), inverse);
+					for (unsigned i = 0; i < n; ++i)
+						m_grid[base + i * stride] = line[i];
+				}
+			});
+		}
+	}
+
+	void ParticleMeshGravity::SolvePoisson()
+	{
+		const unsigned total = unsigned(m_grid.size());
+		ParallelFor(0, total, 4096, [&](unsigned i)
+		{
+			m_grid[i] *= m_greens[i];
+		});
+	}
+
+	void ParticleMeshGravity::ComputeGradient()
+	{
+		const unsigned n = m_cells;
+		const FLOAT scale = -0.5f / m_cellSize;
+
+		ParallelFor(0, n * n, 16, [&](unsigned l)
+		{
+			unsigned y = l % n, z = l / n;
+			unsigned yp = (y + 1) & (n - 1), ym = (y + n - 1) & (n - 1);
+			unsigned zp = (z + 1) & (n - 1), zm = (z + n - 1) & (n - 1);
+			for (unsigned x = 0; x < n; ++x)
+			{
+				unsigned xp = (x + 1) & (n - 1), xm = (x + n - 1) & (n - 1);
+				size_t i = x + n * (y + size_t(n) * z);
+				m_acc[0][i] = scale * (m_grid[xp + n * (y + size_t(n) * z)].real() - m_grid[xm + n * (y + size_t(n) * z)].real());
+				m_acc[1][i] = scale * (m_grid[x + n * (yp + size_t(n) * z)].real() - m_grid[x + n * (ym + size_t(n) * z)].real());
+				m_acc[2][i] = scale * (m_grid[x + n * (y + size_t(n) * zp)].real() - m_grid[x + n * (y + size_t(n) * zm)].real());
+			}
+		});
+	}
+
+	void ParticleMeshGravity::Interpolate(ParticleType* particles, unsigned count)
+	{
+		const unsigned n = m_cells;
+		ParallelFor(0, count, 1024, [&](unsigned i)
+		{
+			if (particles[i].InverseMass() <= 0.0f)
+				return;
+
+			const UINT* c = &m_cellIndex[3 * i];
+			const FLOAT* w = &m_weights[3 * i];
+			FLOAT acc[3] = { 0.0f, 0.0f, 0.0f };
+			for (unsigned corner = 0; corner < 8; ++corner)
+			{
+				unsigned ox = corner & 1u, oy = (corner >> 1) & 1u, oz = (corner >> 2) & 1u;
+				unsigned cx = (c[0] + ox) & (n - 1);
+				unsigned cy = (c[1] + oy) & (n - 1);
+				unsigned cz = (c[2] + oz) & (n - 1);
+				FLOAT weight = (ox ? w[0] : 1.0f - w[0])
+					* (oy ? w[1] : 1.0f - w[1])
+					* (oz ? w[2] : 1.0f - w[2]);
+				size_t cell = cx + n * (cy + size_t(n) * cz);
+				acc[0] += weight * m_acc[0][cell];
+				acc[1] += weight * m_acc[1][cell];
+				acc[2] += weight * m_acc[2][cell];
+			}
+
+			FLOAT mass = particles[i].Mass();
+			particles[i].AddForce(VectorType(acc[0] * mass, acc[1] * mass, acc[2] * mass));
+		});
+	}
+
+	void ParticleMeshGravity::UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+	{
+		ComputeWeights(particles, count);
+		Deposit(particles);
+		Transform(false);
+		SolvePoisson();
+		Transform(true);
+		ComputeGradient();
+		Interpolate(particles, count);
+	}
+}
@@ -0,0 +1,53 @@
+#include <Inc/jacoby/pmixed.h>
+#include <algorithm>
+
+namespace jacoby
+{
+	ParticleMixedPrecisionForces::ParticleMixedPrecisionForces(ParticleBatchForceGenerator* generator) :
+		m_generator(generator)
+	{}
+
+	void ParticleMixedPrecisionForces::UpdateForces(ParticleTypeD* particles, unsigned count, DOUBLE dT)
+	{
+		if (count == 0)
+			return;
+
+		DOUBLE lo[3] = { particles[0].GetPosition().X(), particles[0].GetPosition().Y(), particles[0].GetPosition().Z() };
+		DOUBLE hi[3] = { lo[0], lo[1], lo[2] };
+		for (unsigned i = 1; i < count; ++i)
+		{
+			const VectorTypeD& position = particles[i].GetPosition();
+			lo[0] = std::min(lo[0], position.X()); hi[0] = std::max(hi[0], position.X());
+			lo[1] = std::min(lo[1], position.Y()); hi[1] = std::max(hi[1], position.Y());
+			lo[2] = std::min(lo[2], position.Z()); hi[2] = std::max(hi[2], position.Z());
+		}
+		m_origin = VectorTypeD(0.5 * (lo[0] + hi[0]), 0.5 * (lo[1] + hi[1]), 0.5 * (lo[2] + hi[2]));
+
+		m_shadow.resize(count);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleTypeD& particle = particles[i];
+			const VectorTypeD relative = particle.GetPosition() - m_origin;
+			const VectorTypeD& velocity = particle.GetVelocity();
+
+			ShadowType& shadow = m_shadow[i];
+			shadow.GetPosition() = Vector3< FLOAT >(FLOAT(relative.X()), FLOAT(relative.Y()), FLOAT(relative.Z()));
+			shadow.GetVelocity() = Vector3< FLOAT >(FLOAT(velocity.X()), FLOAT(velocity.Y()), FLOAT(velocity.Z()));
+			shadow.GetInverseMass() = FLOAT(particle.GetInverseMass());
+			shadow.ClearAccumulator();
+		}
+
+		m_generator->UpdateForces(m_shadow.data(), count, FLOAT(dT));
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			const Vector3< FLOAT >& force = m_shadow[i].GetForceAccumulator();
+			particles[i].AddForce(VectorTypeD(force.X(), force.Y(), force.Z()));
+		}
+	}
+
+	const VectorTypeD& ParticleMixedPrecisionForces::Origin() const
+	{
+		return m_origin;
+	}
+}
@@ -0,0 +1,212 @@
+#include <Inc/jacoby/pmultirate.h>
+#include <algorithm>
+#include <math.h>
+
+namespace jacoby
+{
+	static unsigned CountTrailingZeros(unsigned value)
+	{
+		unsigned zeros = 0;
+		while ((value & 1u) == 0)
+		{
+			value >>= 1;
+			++zeros;
+		}
+		return zeros;
+	}
+
+	ParticleMultiRateStepper::ParticleMultiRateStepper(std::vector< ParticleType >* particles, ParticleForceManager* forces,
+		unsigned maxLevel, FLOAT maxDisplacement, FLOAT stability) :
+		m_particles(particles),
+		m_forces(forces),
+		m_maxDisplacement(maxDisplacement),
+		m_stability(stability),
+		m_integrations(0)
+	{
+		SetMaxLevel(maxLevel);
+		std::fill(m_levelCount, m_levelCount + MAX_LEVELS, 0u);
+	}
+
+	void ParticleMultiRateStepper::SetMaxLevel(unsigned maxLevel)
+	{
+		m_maxLevel = std::min(maxLevel, MAX_LEVELS - 1);
+	}
+
+	void ParticleMultiRateStepper::SetMaxDisplacement(FLOAT maxDisplacement)
+	{
+		m_maxDisplacement = maxDisplacement;
+	}
+
+	void ParticleMultiRateStepper::SetStabilityFactor(FLOAT stability)
+	{
+		m_stability = stability;
+	}
+
+	void ParticleMultiRateStepper::Reset()
+	{
+		m_evalPosition.clear();
+		m_lastEvalPosition.clear();
+		m_lastAcceleration.clear();
+	}
+
+	void ParticleMultiRateStepper::AssignLevels(FLOAT dT)
+	{
+		const unsigned count = unsigned(m_particles->size());
+		m_level.resize(count);
+		std::fill(m_levelCount, m_levelCount + MAX_LEVELS, 0u);
+
+		// a changed array has no history to go by
+		const BOOL history = m_evalPosition.size() == count && m_lastEvalPosition.size() == count;
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			ParticleType& particle = (*m_particles)[i];
+			VectorType& velocity = particle.GetVelocity();
+			VectorType& acceleration = particle.GetAcceleration();
+
+			unsigned level = m_maxLevel;
+			if (history)
+			{
+				const FLOAT speed = velocity.Magnitude();
+				const FLOAT accel = acceleration.Magnitude();
+
+				// stable steps are h <= stability / omega, with omega^2 ~ |da| / |dx|
+				FLOAT maxStep = dT;
+				VectorType dx = m_evalPosition[i] - m_lastEvalPosition[i];
+				VectorType da = acceleration - m_lastAcceleration[i];
+				const FLOAT dx2 = dx * dx;
+				if (dx2 > 0.0f)
+				{
+					const FLOAT omega2 = sqrtf((da * da) / dx2);
+					if (omega2 * maxStep * maxStep > m_stability * m_stability)
+						maxStep = m_stability / sqrtf(omega2);
+				}
+
+				// displacement of a substep h is bounded by speed * h + accel * h^2 / 2
+				level = 0;
+				FLOAT h = dT;
+				while (level < m_maxLevel && (h > maxStep || speed * h + 0.5f * accel * h * h > m_maxDisplacement))
+				{
+					++level;
+					h *= 0.5f;
+				}
+			}
+
+			m_level[i] = (unsigned char)level;
+			++m_levelCount[level];
+		}
+
+		if (m_evalPosition.size() == count)
+		{
+			m_lastEvalPosition = m_evalPosition;
+			m_lastAcceleration.resize(count);
+			for (unsigned i = 0; i < count; ++i)
+				m_lastAcceleration[i] = (*m_particles)[i].GetAcceleration();
+		}
+		m_evalPosition.resize(count);
+
+		// counting sort, finest level first
+		unsigned start[MAX_LEVELS];
+		unsigned offset = 0;
+		for (unsigned level = m_maxLevel + 1; level-- > 0;)
+		{
+			start[level] = offset;
+			offset += m_levelCount[level];
+		}
+		m_order.resize(count);
+		for (unsigned i = 0; i < count; ++i)
+			m_order[start[m_level[i]]++] = i;
+	}
+
+	void ParticleMultiRateStepper::Step(FLOAT dT)
+	{
+		BeginStep(dT);
+		FinishStep(dT);
+	}
+
+	void ParticleMultiRateStepper::BeginStep(FLOAT dT)
+	{
+		m_integrations = 0;
+		if (m_particles->empty())
+			return;
+
+		AssignLevels(dT);
+
+		// batch forces once, at the start of the coarse step
+		m_forces->UpdateBatchForces(dT);
+	}
+
+	void ParticleMultiRateStepper::FinishStep(FLOAT dT)
+	{
+		std::vector< ParticleType >& particles = *m_particles;
+		const unsigned count = unsigned(particles.size());
+		if (count == 0)
+			return;
+
+		FLOAT step[MAX_LEVELS];
+		for (unsigned level = 0; level <= m_maxLevel; ++level)
+			step[level] = dT / FLOAT(1u << level);
+
+		// batch forces and anything added before them are held for the coarse step
+		m_heldForce.resize(count);
+		for (unsigned i = 0; i < count; ++i)
+		{
+			m_heldForce[i] = particles[i].GetForceAccumulator();
+			particles[i].ClearAccumulator();
+		}
+
+		ParticleType* first = particles.data();
+		ParticleType* last = first + count;
+		unsigned coarsestDue = 0;
+
+		// registrations of particles outside the array or not due are skipped
+		auto stepOf = [&](const ParticleType* particle) -> FLOAT
+		{
+			if (particle < first || particle >= last)
+				return 0.0f;
+			unsigned level = m_level[particle - first];
+			return level >= coarsestDue ? step[level] : 0.0f;
+		};
+
+		const unsigned ticks = 1u << m_maxLevel;
+		for (unsigned tick = 0; tick < ticks; ++tick)
+		{
+			// level L is due every 2^(maxLevel - L) ticks, level 0 only on the first
+			coarsestDue = tick == 0 ? 0 : m_maxLevel - unsigned(CountTrailingZeros(tick));
+
+			unsigned dueCount = 0;
+			for (unsigned level = coarsestDue; level <= m_maxLevel; ++level)
+				dueCount += m_levelCount[level];
+			if (dueCount == 0)
+				continue;
+
+			for (unsigned k = 0; k < dueCount; ++k)
+				particles[m_order[k]].AddForce(m_heldForce[m_order[k]]);
+
+			m_forces->UpdateForces(stepOf);
+
+			for (unsigned k = 0; k < dueCount; ++k)
+			{
+				unsigned i = m_order[k];
+				m_evalPosition[i] = particles[i].GetPosition();
+				particles[i].Integrate(step[m_level[i]]);
+			}
+			m_integrations += dueCount;
+		}
+	}
+
+	unsigned ParticleMultiRateStepper::Level(unsigned particle) const
+	{
+		return m_level[particle];
+	}
+
+	unsigned ParticleMultiRateStepper::LevelCount(unsigned level) const
+	{
+		return level < MAX_LEVELS ? m_levelCount[level] : 0;
+	}
+
+	unsigned ParticleMultiRateStepper::Integrations() const
+	{
+		return m_integrations;
+	}
+}
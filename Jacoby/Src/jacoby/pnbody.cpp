@@ -0,0 +1,394 @@
+#include <Inc/jacoby/pnbody.h>
+#include <Inc/jacoby/parallel.h>
+#include <algorithm>
+#include <math.h>
+
+namespace jacoby
+{
+	// spreads 21 bits so that there are two zero bits between each of them
+	static ULLONG SpreadBits(ULLONG v)
+	{
+		v &= 0x1fffff;
+		v = (v | v << 32) & 0x1f00000000ffffULL;
+		v = (v | v << 16) & 0x1f0000ff0000ffULL;
+		v = (v | v << 8) & 0x100f00f00f00f00fULL;
+		v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+		v = (v | v << 2) & 0x1249249249249249ULL;
+		return v;
+	}
+
+	// octant of a key at given level of the tree (root is level 0)
+	static unsigned Digit(ULLONG key, unsigned level)
+	{
+		return unsigned(key >> (3 * (21 - level))) & 7u;
+	}
+
+	ParticleNBodyGravity::ParticleNBodyGravity(FLOAT gravitationalConstant, FLOAT theta, FLOAT softening, unsigned leafSize) :
+		m_gravitationalConstant(gravitationalConstant),
+		m_theta(theta),
+		m_softening(softening),
+		m_leafSize(std::max(leafSize, 1u)),
+		m_rootSize(0.0f),
+		m_particles(nullptr),
+		m_subtrees(BUCKET_COUNT)
+	{
+		m_rootMin[0] = m_rootMin[1] = m_rootMin[2] = 0.0f;
+	}
+
+	void ParticleNBodyGravity::SetTheta(FLOAT theta)
+	{
+		m_theta = theta;
+	}
+
+	void ParticleNBodyGravity::SetSoftening(FLOAT softening)
+	{
+		m_softening = softening;
+	}
+
+	const std::vector< ParticleNBodyGravity::Node >& ParticleNBodyGravity::Nodes() const
+	{
+		return m_nodes;
+	}
+
+	void ParticleNBodyGravity::ComputeBounds(ParticleType* particles)
+	{
+		const unsigned count = unsigned(m_active.size());
+		const unsigned grain = 4096;
+		const unsigned chunks = (count + grain - 1) / grain;
+		std::vector< FLOAT > bounds(6 * chunks);
+
+		ParallelForRange(0, count, grain, [&](unsigned begin, unsigned end)
+		{
+			FLOAT* b = &bounds[6 * (begin / grain)];
+			b[0] = b[1] = b[2] = MAX_FLOAT;
+			b[3] = b[4] = b[5] = -MAX_FLOAT;
+			for (unsigned i = begin; i < end; ++i)
+			{
+				VectorType& pos = particles[m_active[i]].GetPosition();
+				FLOAT p[3] = { pos.getX(), pos.getY(), pos.getZ() };
+				for (unsigned d = 0; d < 3; ++d)
+				{
+					b[d] = std::min(b[d], p[d]);
+					b[d + 3] = std::max(b[d + 3], p[d]);
+				}
+			}
+		});
+
+		FLOAT minP[3] = { MAX_FLOAT, MAX_FLOAT, MAX_FLOAT };
+		FLOAT maxP[3] = { -MAX_FLOAT, -MAX_FLOAT, -MAX_FLOAT };
+		for (unsigned c = 0; c < chunks; ++c)
+		{
+			for (unsigned d = 0; d < 3; ++d)
+			{
+				minP[d] = std::min(minP[d], bounds[6 * c + d]);
+				maxP[d] = std::max(maxP[d], bounds[6 * c + d + 3]);
+			}
+		}
+
+		// cube slightly larger than the bounding box, so that no key overflows
+		FLOAT size = std::max(maxP[0] - minP[0], std::max(maxP[1] - minP[1], maxP[2] - minP[2]));
+		size = std::max(size * 1.001f, 1e-6f);
+		m_rootSize = size;
+		for (unsigned d = 0; d < 3; ++d)
+			m_rootMin[d] = 0.5f * (minP[d] + maxP[d]) - 0.5f * size;
+	}
+
+	void ParticleNBodyGravity::SortByKey(ParticleType* particles)
+	{
+		const unsigned count = unsigned(m_active.size());
+		const FLOAT scale = FLOAT(1u << MAX_LEVEL) / m_rootSize;
+		const ULLONG maxCell = (1u << MAX_LEVEL) - 1;
+
+		m_keys.resize(count);
+		ParallelFor(0, count, 4096, [&](unsigned i)
+		{
+			VectorType& pos = particles[m_active[i]].GetPosition();
+			ULLONG cell[3] = {
+				ULLONG(std::max(0.0f, (pos.getX() - m_rootMin[0]) * scale)),
+				ULLONG(std::max(0.0f, (pos.getY() - m_rootMin[1]) * scale)),
+				ULLONG(std::max(0.0f, (pos.getZ() - m_rootMin[2]) * scale))
+			};
+			ULLONG key = 0;
+			for (unsigned d = 0; d < 3; ++d)
+				key |= SpreadBits(std::min(cell[d], maxCell)) << (2 - d);
+			m_keys[i] = KeyType(key, m_active[i]);
+		});
+
+		// counting sort by the top two levels, buckets are sorted in BuildTree
+		UINT counts[BUCKET_COUNT] = { 0 };
+		for (const KeyType& key : m_keys)
+			++counts[key.first >> (3 * (MAX_LEVEL - 2))];
+
+		m_bucketStart[0] = 0;
+		for (unsigned b = 0; b < BUCKET_COUNT; ++b)
+			m_bucketStart[b + 1] = m_bucketStart[b] + counts[b];
+
+		UINT offsets[BUCKET_COUNT];
+		std::copy(m_bucketStart, m_bucketStart + BUCKET_COUNT, offsets);
+		m_sorted.resize(count);
+		for (const KeyType& key : m_keys)
+			m_sorted[offsets[key.first >> (3 * (MAX_LEVEL - 2))]++] = key;
+
+		m_px.resize(count);
+		m_py.resize(count);
+		m_pz.resize(count);
+		m_mass.resize(count);
+		m_fx.resize(count);
+		m_fy.resize(count);
+		m_fz.resize(count);
+	}
+
+	void ParticleNBodyGravity::SumChildren(Node& node) const
+	{
+		node.mass = 0.0f;
+		node.com[0] = node.com[1] = node.com[2] = 0.0f;
+		for (UINT c = node.firstChild; c < node.firstChild + node.childCount; ++c)
+		{
+			const Node& child = m_nodes[c];
+			node.mass += child.mass;
+			for (unsigned d = 0; d < 3; ++d)
+				node.com[d] += child.mass * child.com[d];
+		}
+		if (node.mass > 0.0f)
+		{
+			for (unsigned d = 0; d < 3; ++d)
+				node.com[d] /= node.mass;
+		}
+	}
+
+	void ParticleNBodyGravity::BuildNode(std::vector< Node >& nodes, UINT nodeIndex, UINT first, UINT count, unsigned level) const
+	{
+		Node node;
+		node.first = first;
+		node.count = count;
+		node.size = ldexpf(m_rootSize, -int(level));
+		node.firstChild = 0;
+		node.childCount = 0;
+		node.mass = 0.0f;
+		node.com[0] = node.com[1] = node.com[2] = 0.0f;
+
+		if (count <= m_leafSize || level >= MAX_LEVEL)
+		{
+			for (UINT i = first; i < first + count; ++i)
+			{
+				node.mass += m_mass[i];
+				node.com[0] += m_mass[i] * m_px[i];
+				node.com[1] += m_mass[i] * m_py[i];
+				node.com[2] += m_mass[i] * m_pz[i];
+			}
+		}
+		else
+		{
+			// keys are sorted, so children are consecutive subranges
+			UINT bounds[9];
+			bounds[0] = first;
+			UINT i = first;
+			for (unsigned octant = 0; octant < 8; ++octant)
+			{
+				while (i < first + count && Digit(m_sorted[i].first, level + 1) == octant)
+					++i;
+				bounds[octant + 1] = i;
+			}
+
+			node.firstChild = UINT(nodes.size());
+			for (unsigned octant = 0; octant < 8; ++octant)
+			{
+				if (bounds[octant + 1] > bounds[octant])
+					++node.childCount;
+			}
+			nodes.resize(nodes.size() + node.childCount);
+
+			UINT child = node.firstChild;
+			for (unsigned octant = 0; octant < 8; ++octant)
+			{
+				if (bounds[octant + 1] == bounds[octant])
+					continue;
+				BuildNode(nodes, child, bounds[octant], bounds[octant + 1] - bounds[octant], level + 1);
+				const Node& built = nodes[child];
+				node.mass += built.mass;
+				node.com[0] += built.mass * built.com[0];
+				node.com[1] += built.mass * built.com[1];
+				node.com[2] += built.mass * built.com[2];
+				++child;
+			}
+		}
+
+		if (node.mass > 0.0f)
+		{
+			node.com[0] /= node.mass;
+			node.com[1] /= node.mass;
+			node.com[2] /= node.mass;
+		}
+		nodes[nodeIndex] = node;
+	}
+
+	void ParticleNBodyGravity::BuildTree()
+	{
+		// every bucket is a level 2 subtree with its root at local index 0
+		ParallelFor(0, BUCKET_COUNT, 1, [&](unsigned b)
+		{
+			std::vector< Node >& subtree = m_subtrees[b];
+			subtree.clear();
+			UINT first = m_bucketStart[b];
+			UINT count = m_bucketStart[b + 1] - first;
+			if (count == 0)
+				return;
+
+			std::sort(m_sorted.begin() + first, m_sorted.begin() + first + count);
+			for (UINT i = first; i < first + count; ++i)
+			{
+				VectorType& pos = m_particles[m_sorted[i].second].GetPosition();
+				m_px[i] = pos.getX();
+				m_py[i] = pos.getY();
+				m_pz[i] = pos.getZ();
+				m_mass[i] = FLOAT(1.0) / m_particles[m_sorted[i].second].InverseMass();
+			}
+
+			subtree.resize(1);
+			BuildNode(subtree, 0, first, count, 2);
+		});
+
+		// root and level 1 nodes first, then level 2 roots, then subtree bodies
+		m_nodes.clear();
+		m_nodes.resize(1);
+		Node& root = m_nodes[0];
+		root.first = 0;
+		root.count = m_bucketStart[BUCKET_COUNT];
+		root.size = m_rootSize;
+		root.firstChild = 1;
+		root.childCount = 0;
+		for (unsigned octant = 0; octant < 8; ++octant)
+		{
+			if (m_bucketStart[8 * octant + 8] > m_bucketStart[8 * octant])
+				++m_nodes[0].childCount;
+		}
+		m_nodes.resize(1 + m_nodes[0].childCount);
+
+		UINT placeholder[BUCKET_COUNT];
+		UINT level1 = 1;
+		for (unsigned octant = 0; octant < 8; ++octant)
+		{
+			UINT first = m_bucketStart[8 * octant];
+			UINT last = m_bucketStart[8 * octant + 8];
+			if (last == first)
+				continue;
+
+			Node node;
+			node.first = first;
+			node.count = last - first;
+			node.size = 0.5f * m_rootSize;
+			node.firstChild = UINT(m_nodes.size());
+			node.childCount = 0;
+			for (unsigned b = 8 * octant; b < 8 * octant + 8; ++b)
+			{
+				if (!m_subtrees[b].empty())
+					placeholder[b] = node.firstChild + node.childCount++;
+			}
+			m_nodes.resize(m_nodes.size() + node.childCount);
+			m_nodes[level1++] = node;
+		}
+
+		for (unsigned b = 0; b < BUCKET_COUNT; ++b)
+		{
+			const std::vector< Node >& subtree = m_subtrees[b];
+			if (subtree.empty())
+				continue;
+
+			// local index j > 0 ends up at base + j - 1
+			UINT base = UINT(m_nodes.size());
+			m_nodes.insert(m_nodes.end(), subtree.begin() + 1, subtree.end());
+			m_nodes[placeholder[b]] = subtree[0];
+			if (subtree[0].childCount)
+				m_nodes[placeholder[b]].firstChild += base - 1;
+			for (UINT j = base; j < UINT(m_nodes.size()); ++j)
+			{
+				if (m_nodes[j].childCount)
+					m_nodes[j].firstChild += base - 1;
+			}
+		}
+
+		for (UINT n = m_nodes[0].childCount; n >= 1; --n)
+			SumChildren(m_nodes[n]);
+		SumChildren(m_nodes[0]);
+	}
+
+	void ParticleNBodyGravity::ComputeForce(UINT i)
+	{
+		const FLOAT px = m_px[i], py = m_py[i], pz = m_pz[i];
+		const FLOAT eps2 = m_softening * m_softening;
+		const FLOAT theta2 = m_theta * m_theta;
+		FLOAT ax = 0.0f, ay = 0.0f, az = 0.0f;
+
+		// depth is bounded by MAX_LEVEL and each level pushes at most 8 nodes
+		UINT stack[8 * (MAX_LEVEL + 1)];
+		unsigned top = 0;
+		stack[top++] = 0;
+		while (top)
+		{
+			const Node& node = m_nodes[stack[--top]];
+
+			FLOAT dx = node.com[0] - px, dy = node.com[1] - py, dz = node.com[2] - pz;
+			FLOAT dist2 = dx * dx + dy * dy + dz * dz + eps2;
+			BOOL containsSelf = i >= node.first && i < node.first + node.count;
+			if (!containsSelf && node.size * node.size < theta2 * dist2)
+			{
+				FLOAT invDist = InverseSqrt(dist2);
+				FLOAT f = node.mass * invDist * invDist * invDist;
+				ax += f * dx;
+				ay += f * dy;
+				az += f * dz;
+				continue;
+			}
+
+			if (node.childCount == 0)
+			{
+				for (UINT j = node.first; j < node.first + node.count; ++j)
+				{
+					if (j == i)
+						continue;
+					dx = m_px[j] - px;
+					dy = m_py[j] - py;
+					dz = m_pz[j] - pz;
+					FLOAT invDist = InverseSqrt(dx * dx + dy * dy + dz * dz + eps2);
+					FLOAT f = m_mass[j] * invDist * invDist * invDist;
+					ax += f * dx;
+					ay += f * dy;
+					az += f * dz;
+				}
+				continue;
+			}
+
+			for (UINT c = 0; c < node.childCount; ++c)
+				stack[top++] = node.firstChild + c;
+		}
+
+		FLOAT scale = m_gravitationalConstant * m_mass[i];
+		m_fx[i] = ax * scale;
+		m_fy[i] = ay * scale;
+		m_fz[i] = az * scale;
+	}
+
+	void ParticleNBodyGravity::UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+	{
+		m_active.clear();
+		for (unsigned i = 0; i < count; ++i)
+		{
+			if (particles[i].InverseMass() > 0.0f)
+				m_active.push_back(i);
+		}
+		if (m_active.size() < 2)
+			return;
+
+		m_particles = particles;
+		ComputeBounds(particles);
+		SortByKey(particles);
+		BuildTree();
+
+		const unsigned active = unsigned(m_active.size());
+		ParallelFor(0, active, 256, [&](unsigned i)
+		{
+			ComputeForce(i);
+			particles[m_sorted[i].second].AddForce(VectorType(m_fx[i], m_fy[i], m_fz[i]));
+		});
+	}
+}
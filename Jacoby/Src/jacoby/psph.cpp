@@ -0,0 +1,242 @@
+#include <Inc/jacoby/psph.h>
+#include <Inc/jacoby/parallel.h>
+#include <Inc/jacoby/simd.h>
+#include <algorithm>
+#include <math.h>
+
+namespace jacoby
+{
+	static const FLOAT PI = 3.14159265358979f;
+
+	// loads past the last particle read padding that lies far away
+	static const unsigned PADDING = 4;
+	static const FLOAT FAR_AWAY = 1e18f;
+
+	ParticleSPH::ParticleSPH(FLOAT smoothingRadius, FLOAT restDensity, FLOAT stiffness, FLOAT viscosity, BOOL parallel) :
+		m_restDensity(restDensity),
+		m_stiffness(stiffness),
+		m_viscosity(viscosity),
+		m_parallel(parallel),
+		m_tableMask(0)
+	{
+		SetSmoothingRadius(smoothingRadius);
+	}
+
+	void ParticleSPH::SetSmoothingRadius(FLOAT smoothingRadius)
+	{
+		const FLOAT h = smoothingRadius;
+		m_smoothingRadius = h;
+		m_poly6 = 315.0f / (64.0f * PI * powf(h, 9.0f));
+		m_spikyGradient = -45.0f / (PI * powf(h, 6.0f));
+		m_viscosityLaplacian = 45.0f / (PI * powf(h, 6.0f));
+	}
+
+	void ParticleSPH::SetParallel(BOOL parallel)
+	{
+		m_parallel = parallel;
+	}
+
+	FLOAT ParticleSPH::Density(unsigned particleIndex) const
+	{
+		if (particleIndex >= m_slotOfParticle.size() || m_slotOfParticle[particleIndex] == ~UINT(0))
+			return 0.0f;
+		return m_density[m_slotOfParticle[particleIndex]];
+	}
+
+	UINT ParticleSPH::HashCell(INT x, INT y, INT z) const
+	{
+		return (UINT(x) * 73856093u ^ UINT(y) * 19349663u ^ UINT(z) * 83492791u) & m_tableMask;
+	}
+
+	void ParticleSPH::BuildGrid(ParticleType* particles, unsigned count)
+	{
+		m_order.clear();
+		for (unsigned i = 0; i < count; ++i)
+		{
+			if (particles[i].InverseMass() > 0.0f)
+				m_order.push_back(i);
+		}
+		const unsigned active = unsigned(m_order.size());
+
+		// hash table with at least twice as many buckets as particles
+		UINT tableSize = 64;
+		while (tableSize < 2 * active)
+			tableSize <<= 1;
+		m_tableMask = tableSize - 1;
+
+		const FLOAT invH = 1.0f / m_smoothingRadius;
+		m_cellOfParticle.resize(active);
+		m_cellStart.assign(tableSize + 1, 0);
+		for (unsigned k = 0; k < active; ++k)
+		{
+			VectorType& pos = particles[m_order[k]].GetPosition();
+			UINT bucket = HashCell(INT(floorf(pos.getX() * invH)), INT(floorf(pos.getY() * invH)), INT(floorf(pos.getZ() * invH)));
+			m_cellOfParticle[k] = bucket;
+			++m_cellStart[bucket + 1];
+		}
+		for (UINT b = 0; b < tableSize; ++b)
+			m_cellStart[b + 1] += m_cellStart[b];
+
+		// counting sort by bucket, so that every bucket is a contiguous range
+		std::vector< UINT > offsets(m_cellStart.begin(), m_cellStart.end() - 1);
+		std::vector< UINT > sorted(active);
+		std::vector< UINT > sortedCells(active);
+		for (unsigned k = 0; k < active; ++k)
+		{
+			UINT slot = offsets[m_cellOfParticle[k]]++;
+			sorted[slot] = m_order[k];
+			sortedCells[slot] = m_cellOfParticle[k];
+		}
+		m_order.swap(sorted);
+		m_cellOfParticle.swap(sortedCells);
+
+		m_slotOfParticle.assign(count, ~UINT(0));
+		for (unsigned k = 0; k < active; ++k)
+			m_slotOfParticle[m_order[k]] = k;
+
+		const unsigned padded = active + PADDING;
+		m_px.assign(padded, FAR_AWAY);
+		m_py.assign(padded, FAR_AWAY);
+		m_pz.assign(padded, FAR_AWAY);
+		m_vx.assign(padded, 0.0f);
+		m_vy.assign(padded, 0.0f);
+		m_vz.assign(padded, 0.0f);
+		m_mass.assign(padded, 0.0f);
+		m_density.assign(padded, 1.0f);
+		m_pressure.assign(padded, 0.0f);
+		for (unsigned k = 0; k < active; ++k)
+		{
+			ParticleType& particle = particles[m_order[k]];
+			m_px[k] = particle.GetPosition().getX();
+			m_py[k] = particle.GetPosition().getY();
+			m_pz[k] = particle.GetPosition().getZ();
+			m_vx[k] = particle.GetVelocity().getX();
+			m_vy[k] = particle.GetVelocity().getY();
+			m_vz[k] = particle.GetVelocity().getZ();
+			m_mass[k] = particle.Mass();
+		}
+	}
+
+	unsigned ParticleSPH::NeighbourBuckets(UINT i, UINT* buckets) const
+	{
+		const FLOAT invH = 1.0f / m_smoothingRadius;
+		INT cx = INT(floorf(m_px[i] * invH));
+		INT cy = INT(floorf(m_py[i] * invH));
+		INT cz = INT(floorf(m_pz[i] * invH));
+
+		unsigned count = 0;
+		for (INT dz = -1; dz <= 1; ++dz)
+			for (INT dy = -1; dy <= 1; ++dy)
+				for (INT dx = -1; dx <= 1; ++dx)
+				{
+					UINT bucket = HashCell(cx + dx, cy + dy, cz + dz);
+					if (std::find(buckets, buckets + count, bucket) == buckets + count)
+						buckets[count++] = bucket;
+				}
+		return count;
+	}
+
+	void ParticleSPH::ComputeDensity(UINT i)
+	{
+		const FLOAT h2 = m_smoothingRadius * m_smoothingRadius;
+		const Float4 xi(m_px[i]), yi(m_py[i]), zi(m_pz[i]);
+		const Float4 h2v(h2);
+		const Float4 lanes(0.0f, 1.0f, 2.0f, 3.0f);
+		Float4 sum;
+
+		UINT buckets[27];
+		unsigned bucketCount = NeighbourBuckets(i, buckets);
+		for (unsigned b = 0; b < bucketCount; ++b)
+		{
+			const UINT begin = m_cellStart[buckets[b]], end = m_cellStart[buckets[b] + 1];
+			const Float4 endv = Float4(FLOAT(end));
+			for (UINT j = begin; j < end; j += 4)
+			{
+				Float4 dx = Float4::Load(&m_px[j]) - xi;
+				Float4 dy = Float4::Load(&m_py[j]) - yi;
+				Float4 dz = Float4::Load(&m_pz[j]) - zi;
+				Float4 r2 = dx * dx + dy * dy + dz * dz;
+				Float4 mask = (r2 < h2v) & ((Float4(FLOAT(j)) + lanes) < endv);
+				Float4 diff = h2v - r2;
+				Float4 w = diff * diff * diff * Float4::Load(&m_mass[j]);
+				sum = sum + Select(mask, w, Float4());
+			}
+		}
+
+		m_density[i] = m_poly6 * HorizontalSum(sum);
+		m_pressure[i] = m_stiffness * (m_density[i] - m_restDensity);
+	}
+
+	void ParticleSPH::ComputeForce(UINT i, ParticleType* particles)
+	{
+		const FLOAT h = m_smoothingRadius;
+		const Float4 xi(m_px[i]), yi(m_py[i]), zi(m_pz[i]);
+		const Float4 vxi(m_vx[i]), vyi(m_vy[i]), vzi(m_vz[i]);
+		const Float4 pi(m_pressure[i]);
+		const Float4 hv(h), h2v(h * h), zero, half(0.5f);
+		const Float4 lanes(0.0f, 1.0f, 2.0f, 3.0f);
+		const Float4 spiky(m_spikyGradient), laplacian(m_viscosityLaplacian * m_viscosity);
+		Float4 fx, fy, fz;
+
+		UINT buckets[27];
+		unsigned bucketCount = NeighbourBuckets(i, buckets);
+		for (unsigned b = 0; b < bucketCount; ++b)
+		{
+			const UINT begin = m_cellStart[buckets[b]], end = m_cellStart[buckets[b] + 1];
+			const Float4 endv = Float4(FLOAT(end));
+			for (UINT j = begin; j < end; j += 4)
+			{
+				Float4 dx = Float4::Load(&m_px[j]) - xi;
+				Float4 dy = Float4::Load(&m_py[j]) - yi;
+				Float4 dz = Float4::Load(&m_pz[j]) - zi;
+				Float4 r2 = dx * dx + dy * dy + dz * dz;
+				// zero distance excludes the particle itself
+				Float4 mask = (r2 < h2v) & (r2 > zero) & ((Float4(FLOAT(j)) + lanes) < endv);
+				if (!Any(mask))
+					continue;
+
+				Float4 r2Safe = Select(mask, r2, Float4(1.0f));
+				Float4 invR = RSqrt(r2Safe);
+				Float4 hr = hv - r2Safe * invR;
+				Float4 massOverDensity = Float4::Load(&m_mass[j]) / Float4::Load(&m_density[j]);
+
+				// spiky gradient is negative, so positive pressure pushes away from j
+				Float4 pressure = massOverDensity * (pi + Float4::Load(&m_pressure[j])) * half
+					* spiky * hr * hr * invR;
+				Float4 viscous = massOverDensity * laplacian * hr;
+
+				pressure = Select(mask, pressure, zero);
+				viscous = Select(mask, viscous, zero);
+				fx = fx + pressure * dx + viscous * (Float4::Load(&m_vx[j]) - vxi);
+				fy = fy + pressure * dy + viscous * (Float4::Load(&m_vy[j]) - vyi);
+				fz = fz + pressure * dz + viscous * (Float4::Load(&m_vz[j]) - vzi);
+			}
+		}
+
+		// accumulated values are force densities, force = m / rho * f
+		FLOAT scale = m_mass[i] / m_density[i];
+		particles[m_order[i]].AddForce(VectorType(
+			HorizontalSum(fx) * scale,
+			HorizontalSum(fy) * scale,
+			HorizontalSum(fz) * scale));
+	}
+
+	void ParticleSPH::UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+	{
+		BuildGrid(particles, count);
+		const unsigned active = unsigned(m_order.size());
+
+		if (m_parallel)
+		{
+			ParallelFor(0, active, 256, [&](unsigned i) { ComputeDensity(i); });
+			ParallelFor(0, active, 256, [&](unsigned i) { ComputeForce(i, particles); });
+		}
+		else
+		{
+			for (unsigned i = 0; i < active; ++i)
+				ComputeDensity(i);
+			for (unsigned i = 0; i < active; ++i)
+				ComputeForce(i, particles);
+		}
+	}
+}
@@ -0,0 +1,252 @@
+#include <Inc/jacoby/pturb.h>
+#include <Inc/jacoby/parallel.h>
+#include <random>
+#include <math.h>
+
+namespace jacoby
+{
+	namespace
+	{
+		const DOUBLE TWO_PI = 6.28318530717958647692;
+
+		// mt19937 output is fixed by the standard, unlike the distributions
+		FLOAT Uniform(std::mt19937& random, FLOAT low, FLOAT high)
+		{
+			return low + (high - low) * FLOAT(random() >> 8) * (1.0f / 16777216.0f);
+		}
+
+		// uniform on the sphere by rejection from the cube
+		VectorType RandomDirection(std::mt19937& random)
+		{
+			for (;;)
+			{
+				VectorType v(Uniform(random, -1.0f, 1.0f), Uniform(random, -1.0f, 1.0f), Uniform(random, -1.0f, 1.0f));
+				FLOAT length2 = v.SquareMagnitude();
+				if (length2 > 1e-4f && length2 <= 1.0f)
+					return v * InverseSqrt(length2);
+			}
+		}
+	}
+
+	ParticleTurbulence::ParticleTurbulence(FLOAT amplitude, FLOAT frequency, unsigned octaves, UINT seed, BOOL parallel) :
+		m_amplitude(amplitude),
+		m_frequency(frequency),
+		m_octaves(octaves),
+		m_lacunarity(2.0f),
+		m_gain(0.5f),
+		m_speed(0.0f),
+		m_seed(seed),
+		m_parallel(parallel),
+		m_time(0.0)
+	{
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetAmplitude(FLOAT amplitude)
+	{
+		m_amplitude = amplitude;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetFrequency(FLOAT frequency)
+	{
+		m_frequency = frequency;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetOctaves(unsigned octaves)
+	{
+		m_octaves = octaves;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetLacunarity(FLOAT lacunarity)
+	{
+		m_lacunarity = lacunarity;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetGain(FLOAT gain)
+	{
+		m_gain = gain;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetSpeed(FLOAT speed)
+	{
+		m_speed = speed;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetSeed(UINT seed)
+	{
+		m_seed = seed;
+		BuildWaves();
+	}
+
+	void ParticleTurbulence::SetParallel(BOOL parallel)
+	{
+		m_parallel = parallel;
+	}
+
+	void ParticleTurbulence::SetTime(DOUBLE time)
+	{
+		m_time = time;
+		UpdatePhases();
+	}
+
+	void ParticleTurbulence::Advance(FLOAT dT)
+	{
+		m_time += dT;
+		UpdatePhases();
+	}
+
+	DOUBLE ParticleTurbulence::Time() const
+	{
+		return m_time;
+	}
+
+	void ParticleTurbulence::Attach(World& world)
+	{
+		world.Forces().AddBatch(&world.Particles().Dynamic(), this);
+		world.AddHook(World::Stage::AfterResolution, [this](World&, FLOAT dT) { Advance(dT); });
+	}
+
+	void ParticleTurbulence::BuildWaves()
+	{
+		const unsigned count = m_octaves * WAVES_PER_OCTAVE;
+		m_kx.resize(count);
+		m_ky.resize(count);
+		m_kz.resize(count);
+		m_cx.resize(count);
+		m_cy.resize(count);
+		m_cz.resize(count);
+		m_basePhase.resize(count);
+		m_phaseRate.resize(count);
+		m_phase.resize(count);
+
+		std::mt19937 random(m_seed);
+		FLOAT frequency = FLOAT(TWO_PI) * m_frequency;
+		FLOAT rate = m_speed;
+		FLOAT weight = 1.0f;
+		FLOAT sumOfSquares = 0.0f;
+		for (unsigned octave = 0; octave < m_octaves; ++octave)
+		{
+			for (unsigned i = octave * WAVES_PER_OCTAVE; i < (octave + 1) * WAVES_PER_OCTAVE; ++i)
+			{
+				VectorType direction = RandomDirection(random);
+
+				// random direction with the part along the wave vector removed
+				VectorType transverse;
+				FLOAT length2 = 0.0f;
+				while (length2 < 1e-4f)
+				{
+					transverse = RandomDirection(random);
+					transverse.AddScaledVector(direction, -(transverse * direction));
+					length2 = transverse.SquareMagnitude();
+				}
+				transverse *= weight * InverseSqrt(length2);
+
+				m_kx[i] = direction.X() * frequency;
+				m_ky[i] = direction.Y() * frequency;
+				m_kz[i] = direction.Z() * frequency;
+				m_cx[i] = transverse.X();
+				m_cy[i] = transverse.Y();
+				m_cz[i] = transverse.Z();
+				m_basePhase[i] = Uniform(random, 0.0f, FLOAT(TWO_PI));
+
+				// phases of one octave drift apart instead of moving in lockstep
+				m_phaseRate[i] = rate * Uniform(random, 0.5f, 1.5f);
+				sumOfSquares += weight * weight;
+			}
+			frequency *= m_lacunarity;
+			rate *= m_lacunarity;
+			weight *= m_gain;
+		}
+
+		// independent phases give a mean square of half the squared weights
+		const FLOAT scale = sumOfSquares > 0.0f ? m_amplitude / sqrtf(0.5f * sumOfSquares) : 0.0f;
+		for (unsigned i = 0; i < count; ++i)
+		{
+			m_cx[i] *= scale;
+			m_cy[i] *= scale;
+			m_cz[i] *= scale;
+		}
+
+		UpdatePhases();
+	}
+
+	void ParticleTurbulence::UpdatePhases()
+	{
+		// in double, so that phases stay exact over long runs
+		for (unsigned i = 0; i < m_phase.size(); ++i)
+			m_phase[i] = FLOAT(fmod(m_basePhase[i] + m_time * m_phaseRate[i], TWO_PI));
+	}
+
+	void ParticleTurbulence::Evaluate(const Float4& x, const Float4& y, const Float4& z, Float4& fx, Float4& fy, Float4& fz) const
+	{
+		const Float4 inverseTwoPi = Float4(FLOAT(1.0 / TWO_PI));
+		const Float4 twoPi = Float4(FLOAT(TWO_PI));
+		fx = fy = fz = Float4();
+		for (unsigned i = 0; i < m_phase.size(); ++i)
+		{
+			Float4 angle = Float4(m_kx[i]) * x + Float4(m_ky[i]) * y + Float4(m_kz[i]) * z + Float4(m_phase[i]);
+
+			// keeps far away positions inside the range of Cos
+			angle = angle - Round(angle * inverseTwoPi) * twoPi;
+			Float4 wave = Cos(angle);
+			fx = fx + Float4(m_cx[i]) * wave;
+			fy = fy + Float4(m_cy[i]) * wave;
+			fz = fz + Float4(m_cz[i]) * wave;
+		}
+	}
+
+	VectorType ParticleTurbulence::Sample(const VectorType& position) const
+	{
+		Float4 fx, fy, fz;
+		Evaluate(Float4(position.X()), Float4(position.Y()), Float4(position.Z()), fx, fy, fz);
+
+		FLOAT outX[4], outY[4], outZ[4];
+		fx.Store(outX);
+		fy.Store(outY);
+		fz.Store(outZ);
+		return VectorType(outX[0], outY[0], outZ[0]);
+	}
+
+	void ParticleTurbulence::UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+	{
+		if (m_phase.empty())
+			return;
+
+		// four particles per batch, the tail is padded with the first lane
+		auto batch = [this, particles, count](unsigned b)
+		{
+			const unsigned first = b * 4;
+			const unsigned lanes = count - first < 4 ? count - first : 4;
+			const VectorType* p[4];
+			for (unsigned j = 0; j < 4; ++j)
+				p[j] = &particles[first + (j < lanes ? j : 0)].GetPosition();
+
+			Float4 fx, fy, fz;
+			Evaluate(Float4(p[0]->X(), p[1]->X(), p[2]->X(), p[3]->X()),
+				Float4(p[0]->Y(), p[1]->Y(), p[2]->Y(), p[3]->Y()),
+				Float4(p[0]->Z(), p[1]->Z(), p[2]->Z(), p[3]->Z()), fx, fy, fz);
+
+			FLOAT outX[4], outY[4], outZ[4];
+			fx.Store(outX);
+			fy.Store(outY);
+			fz.Store(outZ);
+			for (unsigned j = 0; j < lanes; ++j)
+				particles[first + j].AddForce(VectorType(outX[j], outY[j], outZ[j]));
+		};
+
+		const unsigned batches = (count + 3) / 4;
+		if (m_parallel)
+			ParallelFor(0, batches, 64, batch);
+		else
+		{
+			for (unsigned b = 0; b < batches; ++b)
+				batch(b);
+		}
+	}
+}
@@ -0,0 +1,368 @@
+#include <Inc/jacoby/pvfield.h>
+#include <Inc/jacoby/parallel.h>
+#include <Inc/jacoby/simd.h>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace jacoby
+{
+	namespace
+	{
+		const CHAR FIELD_MAGIC[4] = { 'J', 'V', 'F', '1' };
+
+		// 48 bytes, keeps the nodes behind it 16 byte aligned
+		struct FieldFileHeader
+		{
+			CHAR magic[4];
+			UINT size[3];
+			FLOAT origin[3];
+			FLOAT cellSize[3];
+			UINT reserved[2];
+		};
+
+		const unsigned NODE_FLOATS = 4;
+
+		ULLONG NodeCount(const UINT* size)
+		{
+			return ULLONG(size[0]) * size[1] * size[2];
+		}
+
+		void CheckHeader(const FieldFileHeader& header, ULLONG fileSize, const std::string& path)
+		{
+			if (memcmp(header.magic, FIELD_MAGIC, sizeof(FIELD_MAGIC)) != 0)
+				throw std::runtime_error("Vector field: missing magic in " + path);
+			for (unsigned axis = 0; axis < 3; ++axis)
+			{
+				if (header.size[axis] < 2 || !(header.cellSize[axis] > 0.0f))
+					throw std::runtime_error("Vector field: bad grid layout in " + path);
+			}
+			if (fileSize != sizeof(FieldFileHeader) + NodeCount(header.size) * NODE_FLOATS * sizeof(FLOAT))
+				throw std::runtime_error("Vector field: size does not match the grid in " + path);
+		}
+
+		Float4 Lerp(const Float4& a, const Float4& b, const Float4& t)
+		{
+			return a + (b - a) * t;
+		}
+	}
+
+	VectorFieldGrid::VectorFieldGrid() :
+		m_nodes(nullptr),
+		m_view(nullptr),
+		m_viewSize(0),
+		m_file(nullptr),
+		m_mapping(nullptr)
+	{
+		m_size[0] = m_size[1] = m_size[2] = 0;
+	}
+
+	VectorFieldGrid::~VectorFieldGrid()
+	{
+		Unmap();
+	}
+
+	void VectorFieldGrid::SetLayout(const UINT* size, const VectorType& origin, const VectorType& cellSize)
+	{
+		for (unsigned axis = 0; axis < 3; ++axis)
+			m_size[axis] = size[axis];
+		m_origin = origin;
+		m_cellSize = cellSize;
+		m_inverseCellSize = VectorType(1.0f / cellSize.X(), 1.0f / cellSize.Y(), 1.0f / cellSize.Z());
+	}
+
+	void VectorFieldGrid::Unmap()
+	{
+		if (!m_view)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(m_view);
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+#else
+		munmap(m_view, m_viewSize);
+#endif
+		m_view = nullptr;
+		m_viewSize = 0;
+		m_file = nullptr;
+		m_mapping = nullptr;
+	}
+
+	void VectorFieldGrid::Create(unsigned sizeX, unsigned sizeY, unsigned sizeZ, const VectorType& origin, const VectorType& cellSize)
+	{
+		if (sizeX < 2 || sizeY < 2 || sizeZ < 2)
+			throw std::runtime_error("Vector field needs at least 2 nodes per axis");
+
+		Clear();
+		const UINT size[3] = { sizeX, sizeY, sizeZ };
+		SetLayout(size, origin, cellSize);
+		m_owned.assign(size_t(NodeCount(size)) * NODE_FLOATS, 0.0f);
+		m_nodes = m_owned.data();
+	}
+
+	void VectorFieldGrid::SetNode(unsigned x, unsigned y, unsigned z, const VectorType& value)
+	{
+		FLOAT* node = &m_owned[(x + size_t(m_size[0]) * (y + size_t(m_size[1]) * z)) * NODE_FLOATS];
+		node[0] = value.X();
+		node[1] = value.Y();
+		node[2] = value.Z();
+	}
+
+	VectorType VectorFieldGrid::Node(unsigned x, unsigned y, unsigned z) const
+	{
+		const FLOAT* node = m_nodes + (x + size_t(m_size[0]) * (y + size_t(m_size[1]) * z)) * NODE_FLOATS;
+		return VectorType(node[0], node[1], node[2]);
+	}
+
+	void VectorFieldGrid::Save(const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			throw std::runtime_error("Vector field: cannot open " + path);
+
+		FieldFileHeader header = {};
+		memcpy(header.magic, FIELD_MAGIC, sizeof(FIELD_MAGIC));
+		for (unsigned axis = 0; axis < 3; ++axis)
+			header.size[axis] = m_size[axis];
+		header.origin[0] = m_origin.X();
+		header.origin[1] = m_origin.Y();
+		header.origin[2] = m_origin.Z();
+		header.cellSize[0] = m_cellSize.X();
+		header.cellSize[1] = m_cellSize.Y();
+		header.cellSize[2] = m_cellSize.Z();
+
+		file.write(reinterpret_cast< const char* >(&header), sizeof(header));
+		file.write(reinterpret_cast< const char* >(m_nodes), std::streamsize(NodeCount(m_size) * NODE_FLOATS * sizeof(FLOAT)));
+		if (!file)
+			throw std::runtime_error("Vector field: cannot write " + path);
+	}
+
+	void VectorFieldGrid::Map(const std::string& path)
+	{
+		Clear();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Vector field: cannot open " + path);
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = nullptr;
+		void* view = nullptr;
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= LONGLONG(sizeof(FieldFileHeader)))
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+			view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view)
+		{
+			if (mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Vector field: cannot map " + path);
+		}
+		m_file = file;
+		m_mapping = mapping;
+		const ULLONG size = ULLONG(fileSize.QuadPart);
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			throw std::runtime_error("Vector field: cannot open " + path);
+
+		// the mapping keeps the file alive, the descriptor is not needed after it
+		struct stat status;
+		void* view = MAP_FAILED;
+		if (fstat(file, &status) == 0 && status.st_size >= off_t(sizeof(FieldFileHeader)))
+			view = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (view == MAP_FAILED)
+			throw std::runtime_error("Vector field: cannot map " + path);
+		const ULLONG size = ULLONG(status.st_size);
+#endif
+		m_view = view;
+		m_viewSize = size_t(size);
+
+		const FieldFileHeader& header = *static_cast< const FieldFileHeader* >(view);
+		try
+		{
+			CheckHeader(header, size, path);
+		}
+		catch (...)
+		{
+			Unmap();
+			throw;
+		}
+
+		SetLayout(header.size, VectorType(header.origin[0], header.origin[1], header.origin[2]),
+			VectorType(header.cellSize[0], header.cellSize[1], header.cellSize[2]));
+		m_nodes = reinterpret_cast< const FLOAT* >(static_cast< const char* >(view) + sizeof(FieldFileHeader));
+	}
+
+	void VectorFieldGrid::Load(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			throw std::runtime_error("Vector field: cannot open " + path);
+
+		const ULLONG size = ULLONG(file.tellg());
+		FieldFileHeader header = {};
+		file.seekg(0);
+		if (!file.read(reinterpret_cast< char* >(&header), sizeof(header)))
+			throw std::runtime_error("Vector field: truncated header in " + path);
+		CheckHeader(header, size, path);
+
+		std::vector< FLOAT > nodes(size_t(NodeCount(header.size)) * NODE_FLOATS);
+		if (!file.read(reinterpret_cast< char* >(nodes.data()), std::streamsize(nodes.size() * sizeof(FLOAT))))
+			throw std::runtime_error("Vector field: truncated nodes in " + path);
+
+		Clear();
+		SetLayout(header.size, VectorType(header.origin[0], header.origin[1], header.origin[2]),
+			VectorType(header.cellSize[0], header.cellSize[1], header.cellSize[2]));
+		m_owned.swap(nodes);
+		m_nodes = m_owned.data();
+	}
+
+	void VectorFieldGrid::Clear()
+	{
+		Unmap();
+		std::vector< FLOAT >().swap(m_owned);
+		m_nodes = nullptr;
+		m_size[0] = m_size[1] = m_size[2] = 0;
+	}
+
+	BOOL VectorFieldGrid::Empty() const
+	{
+		return m_nodes == nullptr;
+	}
+
+	BOOL VectorFieldGrid::Mapped() const
+	{
+		return m_view != nullptr;
+	}
+
+	unsigned VectorFieldGrid::Size(unsigned axis) const
+	{
+		return m_size[axis];
+	}
+
+	const VectorType& VectorFieldGrid::Origin() const
+	{
+		return m_origin;
+	}
+
+	const VectorType& VectorFieldGrid::CellSize() const
+	{
+		return m_cellSize;
+	}
+
+	VectorType VectorFieldGrid::Sample(const VectorType& position) const
+	{
+		const FLOAT local[3] = {
+			(position.X() - m_origin.X()) * m_inverseCellSize.X(),
+			(position.Y() - m_origin.Y()) * m_inverseCellSize.Y(),
+			(position.Z() - m_origin.Z()) * m_inverseCellSize.Z()
+		};
+
+		// clamped to the grid, NaN ends up on the first node
+		size_t cell[3];
+		FLOAT weight[3];
+		for (unsigned axis = 0; axis < 3; ++axis)
+		{
+			const FLOAT last = FLOAT(m_size[axis] - 1);
+			const FLOAT t = local[axis] > 0.0f ? (local[axis] < last ? local[axis] : last) : 0.0f;
+			UINT index = UINT(t);
+			if (index > m_size[axis] - 2)
+				index = m_size[axis] - 2;
+			cell[axis] = index;
+			weight[axis] = t - FLOAT(index);
+		}
+
+		const size_t strideY = size_t(m_size[0]) * NODE_FLOATS;
+		const size_t strideZ = strideY * m_size[1];
+		const FLOAT* base = m_nodes + cell[0] * NODE_FLOATS + cell[1] * strideY + cell[2] * strideZ;
+		const FLOAT* top = base + strideZ;
+
+		// every lerp interpolates whole nodes, the fourth lane is ignored
+		const Float4 tx(weight[0]), ty(weight[1]), tz(weight[2]);
+		Float4 bottom = Lerp(
+			Lerp(Float4::Load(base), Float4::Load(base + NODE_FLOATS), tx),
+			Lerp(Float4::Load(base + strideY), Float4::Load(base + strideY + NODE_FLOATS), tx), ty);
+		Float4 upper = Lerp(
+			Lerp(Float4::Load(top), Float4::Load(top + NODE_FLOATS), tx),
+			Lerp(Float4::Load(top + strideY), Float4::Load(top + strideY + NODE_FLOATS), tx), ty);
+
+		FLOAT out[4];
+		Lerp(bottom, upper, tz).Store(out);
+		return VectorType(out[0], out[1], out[2]);
+	}
+
+	ParticleVectorField::ParticleVectorField(const VectorFieldGrid* grid, Mode mode, FLOAT scale, BOOL parallel) :
+		m_grid(grid),
+		m_mode(mode),
+		m_scale(scale),
+		m_parallel(parallel)
+	{}
+
+	void ParticleVectorField::SetGrid(const VectorFieldGrid* grid)
+	{
+		m_grid = grid;
+	}
+
+	void ParticleVectorField::SetMode(Mode mode, FLOAT scale)
+	{
+		m_mode = mode;
+		m_scale = scale;
+	}
+
+	void ParticleVectorField::SetParallel(BOOL parallel)
+	{
+		m_parallel = parallel;
+	}
+
+	void ParticleVectorField::UpdateForces(ParticleType* particles, unsigned count, FLOAT dT)
+	{
+		if (!m_grid || m_grid->Empty())
+			return;
+
+		// every particle only touches its own accumulator
+		auto apply = [this, particles](unsigned i)
+		{
+			ParticleType& particle = particles[i];
+			VectorType value = m_grid->Sample(particle.GetPosition());
+			switch (m_mode)
+			{
+			case Mode::Acceleration:
+				if (particle.InverseMass() <= 0.0f)
+					return;
+				value *= m_scale * particle.Mass();
+				break;
+			case Mode::Flow:
+				value -= particle.GetVelocity();
+				value *= m_scale;
+				break;
+			default:
+				value *= m_scale;
+				break;
+			}
+			particle.AddForce(value);
+		};
+
+		if (m_parallel)
+			ParallelFor(0, count, 256, apply);
+		else
+		{
+			for (unsigned i = 0; i < count; ++i)
+				apply(i);
+		}
+	}
+}
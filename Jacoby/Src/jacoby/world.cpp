@@ -0,0 +1,169 @@
+#include <Inc/jacoby/world.h>
+#include <algorithm>
+
+namespace jacoby
+{
+	World::World(unsigned maxContacts, unsigned iterations) :
+		m_contacts(maxContacts),
+		m_contactCount(0),
+		m_resolver(iterations),
+		m_calculateIterations(iterations == 0),
+		m_warmStarting(true),
+		m_multiRate(&m_particles.Dynamic(), &m_forces),
+		m_multiRateEnabled(false),
+		m_integrator(nullptr)
+	{
+		m_forces.AddBatch(&m_particles.Dynamic(), &m_fields);
+	}
+
+	World::ParticleSetType& World::Particles()
+	{
+		return m_particles;
+	}
+
+	ParticleForceManager& World::Forces()
+	{
+		return m_forces;
+	}
+
+	ParticleForceFields& World::Fields()
+	{
+		return m_fields;
+	}
+
+	ParticleContactResolver& World::Resolver()
+	{
+		return m_resolver;
+	}
+
+	ParticleContactCache& World::ContactCache()
+	{
+		return m_contactCache;
+	}
+
+	void World::SetWarmStarting(BOOL warmStarting)
+	{
+		m_warmStarting = warmStarting;
+		if (!warmStarting)
+			m_contactCache.Clear();
+	}
+
+	void World::SetMultiRate(unsigned maxLevel, FLOAT maxDisplacement)
+	{
+		m_multiRate.SetMaxLevel(maxLevel);
+		m_multiRate.SetMaxDisplacement(maxDisplacement);
+		m_multiRateEnabled = maxLevel > 0;
+	}
+
+	ParticleMultiRateStepper& World::MultiRate()
+	{
+		return m_multiRate;
+	}
+
+	void World::SetIntegrator(ParticleIntegrator* integrator)
+	{
+		m_integrator = integrator;
+	}
+
+	void World::AddContactGenerator(ParticleContactGenerator* generator)
+	{
+		m_contactGenerators.push_back(generator);
+	}
+
+	void World::RemoveContactGenerator(ParticleContactGenerator* generator)
+	{
+		m_contactGenerators.erase(
+			std::remove(m_contactGenerators.begin(), m_contactGenerators.end(), generator),
+			m_contactGenerators.end());
+	}
+
+	void World::AddHook(Stage stage, const StageHook& hook)
+	{
+		m_hooks[unsigned(stage)].push_back(hook);
+	}
+
+	void World::RunHooks(Stage stage, FLOAT dT)
+	{
+		for (StageHook& hook : m_hooks[unsigned(stage)])
+			hook(*this, dT);
+	}
+
+	unsigned World::GenerateContacts()
+	{
+		unsigned limit = MaxContacts();
+		ParticleContact* next = m_contacts.data();
+
+		for (ParticleContactGenerator* generator : m_contactGenerators)
+		{
+			if (limit == 0)
+				break;
+
+			unsigned used = generator->AddContact(next, limit);
+			limit -= used;
+			next += used;
+		}
+
+		m_contactCount = MaxContacts() - limit;
+		return m_contactCount;
+	}
+
+	ParticleContact* World::Contacts()
+	{
+		return m_contacts.data();
+	}
+
+	unsigned World::ContactCount() const
+	{
+		return m_contactCount;
+	}
+
+	unsigned World::MaxContacts() const
+	{
+		return unsigned(m_contacts.size());
+	}
+
+	void World::Step(FLOAT dT)
+	{
+		RunHooks(Stage::BeforeForces, dT);
+
+		if (m_multiRateEnabled)
+		{
+			m_multiRate.BeginStep(dT);
+			RunHooks(Stage::AfterForces, dT);
+			m_multiRate.FinishStep(dT);
+			m_particles.IntegrateKinematic(dT);
+		}
+		else
+		{
+			m_forces.UpdateForces(dT);
+			RunHooks(Stage::AfterForces, dT);
+
+			// integration also clears force accumulators for the next step
+			if (m_integrator)
+			{
+				m_integrator->Integrate(m_particles.Dynamic(), [this](FLOAT h) { m_forces.UpdateForces(h); }, dT);
+				m_particles.IntegrateKinematic(dT);
+			}
+			else
+			{
+				m_particles.Integrate(dT);
+			}
+		}
+		RunHooks(Stage::AfterIntegration, dT);
+
+		GenerateContacts();
+		RunHooks(Stage::AfterContacts, dT);
+
+		if (m_warmStarting)
+			m_contactCache.WarmStart(m_contacts.data(), m_contactCount);
+
+		// also without contacts, so that residuals and flags describe this step
+		if (m_calculateIterations)
+			m_resolver.SetIterations(m_contactCount * 2);
+		m_resolver.ResolveContacts(m_contacts.data(), m_contactCount, dT);
+
+		if (m_warmStarting)
+			m_contactCache.Store(m_contacts.data(), m_contactCount);
+		RunHooks(Stage::AfterResolution, dT);
+	}
+}
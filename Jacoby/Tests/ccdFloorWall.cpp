@@ -0,0 +1,106 @@
+/*
+* Regression check for continuous collision of a particle moving along
+* a floor into a thin wall. Sweeps used to be held back by the floor the
+* particle rests on, ran out of iterations and let it tunnel through.
+* Standalone, build it with the engine sources and run it, it returns
+* non-zero on failure.
+*/
+#include <Inc/jacoby/pccd.h>
+#include <Inc/jacoby/pmesh.h>
+#include <cstdio>
+
+using namespace jacoby;
+
+namespace
+{
+	const FLOAT RADIUS = 0.5f;
+	const FLOAT SPEED = 600.0f;
+
+	// the wall is 0.1 thick with its near face at x = 5
+	const FLOAT STOP = 5.0f - RADIUS;
+
+	enum class Floor
+	{
+		None,
+		Plane,
+		Box,
+		Mesh
+	};
+
+	const char* Name(Floor floor)
+	{
+		switch (floor)
+		{
+		case Floor::Plane:	return "plane";
+		case Floor::Box:	return "box";
+		case Floor::Mesh:	return "mesh";
+		default:			return "none";
+		}
+	}
+
+	// x the particle comes to rest at, starting height above the floor
+	FLOAT Run(Floor floor, FLOAT height)
+	{
+		World world(64);
+		world.Particles().Add(ParticleType(VectorType(0.0f, RADIUS + height, 0.0f), VectorType(SPEED, 0.0f, 0.0f), VectorType(), 1.0f, 1.0f));
+		std::vector< ParticleType >* particles = &world.Particles().Dynamic();
+
+		ParticleBoxContacts boxes(particles, RADIUS);
+		boxes.AddBox(VectorType(5.05f, 2.0f, 0.0f), VectorType(0.05f, 2.0f, 2.0f));
+
+		ParticlePlaneContacts planes(particles, RADIUS);
+		planes.AddPlane(VectorType(0.0f, 1.0f, 0.0f), 0.0f);
+
+		// floor box sharing the wall generator
+		if (floor == Floor::Box)
+			boxes.AddBox(VectorType(0.0f, -0.5f, 0.0f), VectorType(20.0f, 0.5f, 20.0f));
+
+		TriangleMesh mesh;
+		mesh.AddVertex(VectorType(-20.0f, 0.0f, -20.0f));
+		mesh.AddVertex(VectorType(20.0f, 0.0f, -20.0f));
+		mesh.AddVertex(VectorType(-20.0f, 0.0f, 20.0f));
+		mesh.AddVertex(VectorType(20.0f, 0.0f, 20.0f));
+		mesh.AddTriangle(0, 2, 1);
+		mesh.AddTriangle(1, 2, 3);
+		TriangleBVH bvh;
+		bvh.Build(mesh);
+		ParticleMeshContacts meshContacts(particles, &bvh, RADIUS);
+
+		ParticleSweptContacts swept(particles, RADIUS);
+		swept.AddShapes(&boxes);
+		world.AddContactGenerator(&boxes);
+		if (floor == Floor::Plane)
+		{
+			swept.AddShapes(&planes);
+			world.AddContactGenerator(&planes);
+		}
+		else if (floor == Floor::Mesh)
+		{
+			swept.AddShapes(&meshContacts);
+			world.AddContactGenerator(&meshContacts);
+		}
+		swept.Attach(world);
+
+		world.Step(1.0f / 60.0f);
+		return (*particles)[0].GetPosition().getX();
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	const Floor floors[] = { Floor::None, Floor::Plane, Floor::Box, Floor::Mesh };
+	const FLOAT heights[] = { 0.0f, 0.02f };
+	for (Floor floor : floors)
+	{
+		for (FLOAT height : heights)
+		{
+			FLOAT x = Run(floor, height);
+			BOOL passed = x <= STOP + 0.01f;
+			printf("%-5s floor, %.2f above: x = %.3f %s\n", Name(floor), height, x, passed ? "ok" : "FAILED");
+			if (!passed)
+				++failures;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 #ifndef _GLAD_
 #define _GLAD_
@@ -15,6 +18,8 @@
 #include "shader.h"
 #include "particleVis.h"
 #include "Inc/jacoby/pfgen.h"
+#include "Inc/jacoby/world.h"
+#include "Inc/jacoby/pcollide.h"
 
 #define PARTICLE_NUM 10
 
@@ -55,95 +60,115 @@ int main() {
 		return 1;
 	}
 
-	jacoby::ParticleForceManager fMan;
-
 	particleVis::InitParticleShader();
-	std::vector< particleVis > particles;
-	jacoby::ParticleGravity testPartGrav(jacoby::Vector3<FLOAT>(0.0f, -10.0f, 0.0f));
-	jacoby::ParticleDrag testPartDrag(0.05f, 0.05f);
+
+	// the world owns all particles, forces and contacts of the demo
+	jacoby::World world(64);
+	jacoby::ParticleForceManager& fMan = world.Forces();
+
+	// pointers to particles have to stay valid, so reserve before adding any
+	world.Particles().Reserve(PARTICLE_NUM + 2, 0, 3);
+	std::vector< jacoby::Particle<FLOAT>* > particles;
+	// gravity and drag are world fields, not per particle registrations
+	world.Fields().SetGravity(jacoby::Vector3<FLOAT>(0.0f, -10.0f, 0.0f));
+	world.Fields().SetDrag(0.05f, 0.05f);
 	// first create particles
 	for (int ind = 0; ind <= PARTICLE_NUM; ++ind)
 	{
-		particles.push_back(particleVis(glm::vec3(-10.0f + 2.0f * (float)ind, 0.0f, 0.0f)));
-		particles[ind].SetVelocity(jacoby::Vector3<FLOAT>(0.0f, 0.0f, 0.0f));
+		particles.push_back(world.Particles().Add(jacoby::Particle<FLOAT>(jacoby::Vector3<FLOAT>(-10.0f + 2.0f * (float)ind, 0.0f, 0.0f))));
 	}
 	// then apply forces, as pointers to said particles need to be well defined
-	// generally using vectors in here is not very safe - better use vector of pointers
+	std::vector< jacoby::ParticleSpring > springs;
+	springs.reserve(2 * PARTICLE_NUM);
 	for (int ind = 0; ind <= PARTICLE_NUM; ++ind)
 	{
 		if (ind > 0)
 		{
-			jacoby::ParticleSpring* newSpring;
-			newSpring = new jacoby::ParticleSpring((jacoby::Particle<FLOAT>*)(&(particles[ind - 1])), 20.0f, 0.0f);
-			fMan.Add((jacoby::Particle<FLOAT>*)(&(particles[ind    ])), newSpring);
-			newSpring = new jacoby::ParticleSpring((jacoby::Particle<FLOAT>*)(&(particles[ind    ])), 20.0f, 0.0f);
-			fMan.Add((jacoby::Particle<FLOAT>*)(&(particles[ind - 1])), newSpring);
+			springs.push_back(jacoby::ParticleSpring(particles[ind - 1], 20.0f, 0.0f));
+			fMan.Add(particles[ind], &springs.back());
+			springs.push_back(jacoby::ParticleSpring(particles[ind], 20.0f, 0.0f));
+			fMan.Add(particles[ind - 1], &springs.back());
 		}
-		fMan.Add((jacoby::Particle<FLOAT>*)(&(particles[ind])), &testPartGrav);
-		fMan.Add((jacoby::Particle<FLOAT>*)(&(particles[ind])), &testPartDrag);
 	}
 
+	jacoby::Particle<FLOAT>* testPart = world.Particles().Add(jacoby::Particle<FLOAT>(jacoby::Vector3<FLOAT>(0.0f, 0.0f, 0.0f)));
+	testPart->SetVelocity(jacoby::Vector3<FLOAT>(10.0f, 0.0f, 0.0f));
+	testPart->SetFieldOptOut(jacoby::ParticleField::Drag);
 
-	particleVis testPart(glm::vec3(0.0f, 0.0f, 0.0f));
-	testPart.SetVelocity(jacoby::Vector3<FLOAT>(10.0f, 0.0f, 0.0f));
-	//testPart.SetAcceleration(jacoby::Vector3<FLOAT>(0.0f, -10.0f, 0.0f));
+	// anchors are static particles - they have infinite mass and are never integrated
+	jacoby::ParticleSpring testPartAnchSpr(world.Particles().AddStatic(jacoby::Vector3<FLOAT>(0.0f, 0.0f, 0.0f)), 8.0f, 0.0f);
+	jacoby::ParticleSpring testPartAnchSpr2(world.Particles().AddStatic(jacoby::Vector3<FLOAT>(-10.0f, 0.0f, 0.0f)), 40.0f, 0.0f);
+	jacoby::ParticleSpring testPartAnchSpr3(world.Particles().AddStatic(jacoby::Vector3<FLOAT>(10.0f, 0.0f, 0.0f)), 40.0f, 0.0f);
 
-	jacoby::Vector3<FLOAT> anchor(0.0f, 0.0f, 0.0f);
-	jacoby::ParticleAnchoredSpring testPartAnchSpr(&anchor, 8.0f, 0.0f);
-	jacoby::Vector3<FLOAT> anchor2(-10.0f, 0.0f, 0.0f);
-	jacoby::ParticleAnchoredSpring testPartAnchSpr2(&anchor2, 40.0f, 0.0f);
-	jacoby::Vector3<FLOAT> anchor3(10.0f, 0.0f, 0.0f);
-	jacoby::ParticleAnchoredSpring testPartAnchSpr3(&anchor3, 40.0f, 0.0f);
+	fMan.Add(testPart, &testPartAnchSpr);
+	fMan.Add(particles[0], &testPartAnchSpr2);
+	fMan.Add(particles[PARTICLE_NUM], &testPartAnchSpr3);
 
-	fMan.Add((jacoby::Particle<FLOAT>*)(&(particles[0])), &testPartAnchSpr2);
-	fMan.Add((jacoby::Particle<FLOAT>*)(&(particles[PARTICLE_NUM])), &testPartAnchSpr3);
+	// floor below the chain, particles are drawn as cubes of half size 0.1
+	jacoby::ParticlePlaneContacts floor(&world.Particles().Dynamic(), 0.1f, 0.8f);
+	floor.AddPlane(jacoby::Vector3<FLOAT>(0.0f, 1.0f, 0.0f), -5.0f);
+	world.AddContactGenerator(&floor);
+
+	//	--------------------------------------------------------------------------------------------------------------------
+	// physics runs on its own thread with a fixed step and writes positions of
+	// every particle straight into the instance buffers, the render thread only
+	// draws the newest frame
+	std::vector< jacoby::Particle<FLOAT> >& dynamic = world.Particles().Dynamic();
+	const unsigned int drawCount = (unsigned int)dynamic.size();
+	particleVis::open_stream(drawCount);
+	std::atomic<bool> simulating(true);
+
+	auto step = [&](float deltaTime) {
+		world.Step(deltaTime);
+	};
+
+	auto publish = [&]() {
+		particleVis::stream_particles(dynamic.data(), drawCount);
+	};
+
+	std::thread simulation([&]() {
+		typedef std::chrono::steady_clock clock;
+		const float fixedStep = 1.0f / 240.0f;
+		const clock::duration stepDuration = std::chrono::duration_cast<clock::duration>(std::chrono::duration<float>(fixedStep));
+
+		clock::time_point next = clock::now();
+		publish();
+		while (simulating.load(std::memory_order_relaxed)) {
+			// catch up without spiralling when a step took too long
+			unsigned int steps = 0;
+			while (clock::now() >= next && steps < 8) {
+				step(fixedStep);
+				next += stepDuration;
+				++steps;
+			}
+			if (steps == 8)
+				next = clock::now();
+			if (steps > 0)
+				publish();
+			std::this_thread::sleep_until(next);
+		}
+	});
 
 	//	--------------------------------------------------------------------------------------------------------------------
 	// render loop - keep drawing until we want to end
-	float oldTimeVal = glfwGetTime();
-	float oldY = testPart.get_position().y;
 	while (!glfwWindowShouldClose(window)) {
 		processInput(window);	// process any input that has occured
 
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);	// set the default color to which the screen is reset
 		glClear(GL_COLOR_BUFFER_BIT);	// clear the screen
 
-		float timeVal = glfwGetTime();
-
-		testPart.prepare_to_draw();
-		testPart.draw();
-
-		for (int ind = 0; ind <= PARTICLE_NUM; ++ind)
-		{
-			particles[ind].prepare_to_draw();
-			particles[ind].draw();
-		}
-
-		float deltaTime = timeVal - oldTimeVal;
-		oldTimeVal = timeVal;
-		testPart.update_position(deltaTime);
-		testPartGrav.UpdateForce(&testPart, deltaTime);
-		testPartAnchSpr.UpdateForce(&testPart, deltaTime);
-
-		for (int ind = 0; ind <= PARTICLE_NUM; ++ind)
-		{
-			particles[ind].update_position(deltaTime);
-			fMan.UpdateForces(deltaTime);
-		}
-		/*
-		if (testPart.get_position().y <= 0.0f && oldY > 0.0f)
-		{
-			auto& velY = testPart.GetVelocity().getY();
-			velY *= -0.8f;
-		}
-		oldY = testPart.get_position().y;
-		*/
+		// the newest finished frame, the simulation may already be writing the next one
+		particleVis::draw_stream();
 
 		glfwSwapBuffers(window);	
 		glfwPollEvents();	
 	}	// end of rendering loop
 	//	--------------------------------------------------------------------------------------------------------------------
 
+	simulating.store(false, std::memory_order_relaxed);
+	simulation.join();
+	particleVis::close_stream();
+
 	//at the end we want to properly clean the resources
 	glfwTerminate();
 
@@ -9,6 +9,37 @@
 #define _GLFW3_
 #include <glfw3.h>		// API for context creation
 #endif
+
+#include <cstring>
+
+// glad is generated for OpenGL 3.3 core, buffer storage comes from GL 4.4
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRY *BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+static BufferStorageProc bufferStorage = NULL;
+
+// looks for glBufferStorage in the current context
+static BufferStorageProc load_buffer_storage() {
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool supported = major > 4 || (major == 4 && minor >= 4);
+
+	GLint extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+	for (GLint ind = 0; ind < extensions && !supported; ++ind) {
+		const char* name = (const char*)glGetStringi(GL_EXTENSIONS, GLuint(ind));
+		supported = name != NULL && strcmp(name, "GL_ARB_buffer_storage") == 0;
+	}
+
+	if (!supported)
+		return NULL;
+	return (BufferStorageProc)glfwGetProcAddress("glBufferStorage");
+}
 const float particleVis::vertices[] = {
 	//back side
 		-0.1f, -0.1f, -0.1f,
@@ -67,6 +98,33 @@ unsigned int particleVis::VAO = 0;
 unsigned int particleVis::EBO = 0;
 unsigned int particleVis::VBO = 0;
 
+// Instance offsets ring, buffers are created on the first upload
+unsigned int particleVis::ringVBO[particleVis::RING_SIZE] = { 0, 0, 0, 0 };
+void* particleVis::ringFence[particleVis::RING_SIZE] = { NULL, NULL, NULL, NULL };
+void* particleVis::ringMapped[particleVis::RING_SIZE] = { NULL, NULL, NULL, NULL };
+unsigned int particleVis::ringSlot = 0;
+unsigned int particleVis::ringCapacity = 0;
+bool particleVis::ringPersistent = false;
+particleVis::InstanceLayout particleVis::layout = particleVis::InstanceLayout::Float3;
+
+// Stream slots. The producer owns back, the render thread owns front and
+// spare, middle is exchanged atomically by both: publishing swaps back into
+// middle with STREAM_FRESH set, drawing a fresh frame swaps the idle spare
+// into middle and takes the published slot as front. The old front becomes
+// the spare and goes back to the producer only after its fence signaled.
+static const unsigned int STREAM_FRESH = 1u << 31;
+std::atomic<unsigned int> particleVis::streamMiddle(1);
+unsigned int particleVis::streamBack = 0;
+unsigned int particleVis::streamFront = 2;
+unsigned int particleVis::streamSpare = 3;
+unsigned int particleVis::streamCount[particleVis::RING_SIZE] = { 0, 0, 0, 0 };
+void* particleVis::streamData[particleVis::RING_SIZE] = { NULL, NULL, NULL, NULL };
+std::vector<unsigned char> particleVis::streamStaging[particleVis::RING_SIZE];
+
+static unsigned int instance_stride(particleVis::InstanceLayout layout) {
+	return layout == particleVis::InstanceLayout::Float3 ? 3 * sizeof(float) : 4 * sizeof(unsigned short);
+}
+
 // We keep count of the number of brick objects through count
 unsigned int particleVis::count = 0;
 
@@ -77,36 +135,47 @@ particleVis::particleVis(const glm::vec3 _pos) {
 	++count;
 
 	// set the position and state
-	set_position(_pos);
 	position = _pos;
-
-	modelMatrix = glm::mat4(1.0);
-	modelMatrix = glm::translate(modelMatrix, position);
+	set_position(_pos);
 
 	// set VAO, EBO, VBO if needed
-	if (count == 1) {
-		glGenVertexArrays(1, &VAO);
-		glBindVertexArray(VAO);
+	if (VAO == 0)
+		init_buffers();
+}
 
-		glGenBuffers(1, &EBO);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+// Creates the shared mesh and the instance buffer
+void particleVis::init_buffers() {
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
 
-		glGenBuffers(1, &VBO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glGenBuffers(1, &EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(0);
+	glGenBuffers(1, &VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	// offsets advance once per instance, not per vertex,
+	// their buffer is bound per frame from the ring
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+
+	bufferStorage = load_buffer_storage();
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void particleVis::InitParticleShader()
 {
+	if (VAO == 0)
+		init_buffers();
+
 	m_SO = Shader("./vertexShaderParticle.vert", "./fragmentShaderParticle.frag");
 	m_SO.use();
 	glm::mat4 view = glm::mat4(1.0f);
@@ -125,9 +194,7 @@ void particleVis::InitParticleShader()
 void particleVis::set_position(const glm::vec3& _position) {
 	particleBase::VectorType vec(_position.x, _position.y, _position.z);
 	SetPosition(vec);
-
-	modelMatrix = glm::mat4(1.0);
-	modelMatrix = glm::translate(modelMatrix, position);
+	position = _position;
 }
 
 // updates position based on the 
@@ -136,9 +203,6 @@ void particleVis::update_position(const float& deltaT) {
 	position.x = GetPosition().getX();
 	position.y = GetPosition().getY();
 	position.z = GetPosition().getZ();
-
-	modelMatrix = glm::mat4(1.0);
-	modelMatrix = glm::translate(modelMatrix, position);
 }
 
 // getter position
@@ -162,8 +226,258 @@ void particleVis::prepare_to_draw() {
 }
 
 // Tells OpenGL to draw object of this type
+// (single instance - prefer draw_instanced for many particles)
 void particleVis::draw() {
-	unsigned int modelID = glGetUniformLocation(m_SO.ID, "model");
-	glUniformMatrix4fv(modelID, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+	draw_instanced(&position.x, 1);
+}
+
+// -------------------------------------------------------------
+// Streaming of instance offsets
+
+void particleVis::set_instance_layout(InstanceLayout _layout) {
+	if (_layout == layout)
+		return;
+	// buffers are sized for the old stride
+	release_ring();
+	layout = _layout;
+}
+
+particleVis::InstanceLayout particleVis::get_instance_layout() {
+	return layout;
+}
+
+// IEEE 754 binary16, rounded to nearest, overflow goes to infinity
+unsigned short particleVis::to_half(float value) {
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	unsigned int sign = (bits >> 16) & 0x8000u;
+	int exponent = int((bits >> 23) & 0xffu) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffffu;
+
+	if (((bits >> 23) & 0xffu) == 0xffu)	// inf and nan
+		return (unsigned short)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+	if (exponent >= 31)
+		return (unsigned short)(sign | 0x7c00u);
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return (unsigned short)sign;
+		// subnormal, shift the implicit one in
+		mantissa |= 0x800000u;
+		unsigned int shift = unsigned(14 - exponent);
+		unsigned int half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1u)
+			++half;
+		return (unsigned short)(sign | half);
+	}
+
+	unsigned int half = sign | (unsigned(exponent) << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000u)
+		++half;	// carry into the exponent is still correct
+	return (unsigned short)half;
+}
+
+// Creates RING_SIZE buffers, each able to hold capacity offsets
+void particleVis::create_ring(unsigned int capacity) {
+	release_ring();
+
+	GLsizeiptr bytes = GLsizeiptr(instance_stride(layout)) * capacity;
+	ringPersistent = bufferStorage != NULL;
+
+	glGenBuffers(RING_SIZE, ringVBO);
+	for (unsigned int slot = 0; slot < RING_SIZE; ++slot) {
+		glBindBuffer(GL_ARRAY_BUFFER, ringVBO[slot]);
+		if (ringPersistent) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			bufferStorage(GL_ARRAY_BUFFER, bytes, NULL, flags);
+			ringMapped[slot] = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+		}
+		else
+			glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	ringCapacity = capacity;
+	ringSlot = 0;
+}
+
+void particleVis::release_ring() {
+	if (ringVBO[0] == 0)
+		return;
+
+	for (unsigned int slot = 0; slot < RING_SIZE; ++slot) {
+		wait_fence(slot);
+		if (ringMapped[slot] != NULL) {
+			glBindBuffer(GL_ARRAY_BUFFER, ringVBO[slot]);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			ringMapped[slot] = NULL;
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDeleteBuffers(RING_SIZE, ringVBO);
+
+	for (unsigned int slot = 0; slot < RING_SIZE; ++slot)
+		ringVBO[slot] = 0;
+	ringCapacity = 0;
+}
+
+// Blocks until the GPU is done with the given slot
+void particleVis::wait_fence(unsigned int slot) {
+	GLsync fence = (GLsync)ringFence[slot];
+	if (fence == NULL)
+		return;
+
+	// one second per try, flushing makes sure the fence is ever signaled
+	GLenum result;
+	do {
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+	} while (result == GL_TIMEOUT_EXPIRED);
+
+	glDeleteSync(fence);
+	ringFence[slot] = NULL;
+}
+
+void* particleVis::map_instances(unsigned int count) {
+	if (count == 0)
+		return nullptr;
+
+	if (count > ringCapacity) {
+		unsigned int capacity = ringCapacity > 0 ? ringCapacity : 64;
+		while (capacity < count)
+			capacity *= 2;
+		create_ring(capacity);
+	}
+
+	wait_fence(ringSlot);
+	if (ringPersistent)
+		return ringMapped[ringSlot];
+
+	// the fence guarantees the GPU finished reading, no need to synchronize again
+	glBindBuffer(GL_ARRAY_BUFFER, ringVBO[ringSlot]);
+	return glMapBufferRange(GL_ARRAY_BUFFER, 0, GLsizeiptr(instance_stride(layout)) * count,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void particleVis::draw_mapped(unsigned int count) {
+	if (count == 0)
+		return;
+
+	draw_ring(ringSlot, count);
+	ringSlot = (ringSlot + 1) % RING_SIZE;
+}
+
+// Draws count offsets from a slot of the ring and fences it
+void particleVis::draw_ring(unsigned int slot, unsigned int count) {
+	m_SO.use();
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, ringVBO[slot]);
+	if (!ringPersistent)
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+	// attribute 1 follows whichever buffer of the ring is current
+	if (layout == InstanceLayout::Float3)
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, instance_stride(layout), (void*)0);
+	else
+		glVertexAttribPointer(1, 3, GL_HALF_FLOAT, GL_FALSE, instance_stride(layout), (void*)0);
+
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, GLsizei(count));
+
+	// a stream draws its front slot again until a new frame comes, the newest fence covers all draws
+	if (ringFence[slot] != NULL)
+		glDeleteSync((GLsync)ringFence[slot]);
+	ringFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Copies packed xyz positions into the ring and draws every cube at once
+void particleVis::draw_instanced(const float* positions, unsigned int count) {
+	void* target = map_instances(count);
+	if (target == nullptr)
+		return;
+
+	if (layout == InstanceLayout::Float3)
+		memcpy(target, positions, 3 * sizeof(float) * count);
+	else {
+		unsigned short* out = (unsigned short*)target;
+		for (unsigned int ind = 0; ind < count; ++ind, out += 4, positions += 3) {
+			out[0] = to_half(positions[0]);
+			out[1] = to_half(positions[1]);
+			out[2] = to_half(positions[2]);
+			out[3] = 0;
+		}
+	}
+	draw_mapped(count);
+}
+
+// Creates the ring for a producer thread, slots are the mapped buffers
+// themselves or staging memory copied at draw time without persistent mapping
+void particleVis::open_stream(unsigned int capacity) {
+	if (VAO == 0)
+		init_buffers();
+
+	create_ring(capacity > 0 ? capacity : 1);
+	for (unsigned int slot = 0; slot < RING_SIZE; ++slot) {
+		if (ringPersistent)
+			streamData[slot] = ringMapped[slot];
+		else {
+			streamStaging[slot].resize(size_t(instance_stride(layout)) * ringCapacity);
+			streamData[slot] = streamStaging[slot].data();
+		}
+		streamCount[slot] = 0;
+	}
+
+	streamBack = 0;
+	streamMiddle.store(1, std::memory_order_relaxed);
+	streamFront = 2;
+	streamSpare = 3;
+}
+
+void particleVis::close_stream() {
+	release_ring();
+	for (unsigned int slot = 0; slot < RING_SIZE; ++slot) {
+		streamData[slot] = NULL;
+		std::vector<unsigned char>().swap(streamStaging[slot]);
+	}
+}
+
+void* particleVis::stream_back() {
+	return streamData[streamBack];
+}
+
+// Hands the back slot over and takes the one the render thread left in the middle
+void particleVis::stream_publish(unsigned int count) {
+	streamCount[streamBack] = count;
+	unsigned int old = streamMiddle.exchange(streamBack | STREAM_FRESH, std::memory_order_acq_rel);
+	streamBack = old & ~STREAM_FRESH;
+}
+
+// Switches to the newest published frame if there is one and draws the front slot
+void particleVis::draw_stream() {
+	if (streamMiddle.load(std::memory_order_relaxed) & STREAM_FRESH) {
+		// the producer writes the slot it gets next at once, so the GPU has to be done with it;
+		// the spare was drawn at least one frame ago, its fence has usually signaled already
+		if (ringPersistent)
+			wait_fence(streamSpare);
+		unsigned int old = streamMiddle.exchange(streamSpare, std::memory_order_acq_rel);
+		streamSpare = streamFront;
+		streamFront = old & ~STREAM_FRESH;
+	}
+
+	unsigned int count = streamCount[streamFront];
+	if (count == 0)
+		return;
+
+	if (ringPersistent) {
+		draw_ring(streamFront, count);
+		return;
+	}
+
+	// staging is already in the instance layout
+	void* target = map_instances(count);
+	if (target == nullptr)
+		return;
+	memcpy(target, streamData[streamFront], size_t(instance_stride(layout)) * count);
+	draw_mapped(count);
 }
@@ -2,6 +2,18 @@
 /*
 Class: paricleVis
 Visualization of particles.
+All particles are drawn with one instanced draw call, the cube mesh is
+shared and every instance only carries its position (vec3 offset).
+Offsets are streamed through a ring of buffers guarded by fences,
+so that writing frame N never waits for the GPU reading frame N-1.
+When glBufferStorage is available (GL 4.4 or ARB_buffer_storage) the
+buffers stay persistently mapped and particles are written straight into
+them, otherwise every frame maps its slot unsynchronized. The latter uses
+OpenGL 3.3 core only, so it also runs on software rasterizers
+(e.g. Mesa llvmpipe with LIBGL_ALWAYS_SOFTWARE=1).
+A simulation thread can write into the mapped slots itself through the
+stream functions, the render thread hands it only slots whose fence has
+signaled, so it never touches OpenGL.
 */
 #ifndef _PARTICLEVIS_
 #define _PARTICLEVIS_
@@ -13,6 +25,9 @@ Visualization of particles.
 #include <glm/glm/gtc/type_ptr.hpp>
 #endif
 
+#include <atomic>
+#include <vector>
+
 #include "shader.h"
 #include "Inc/jacoby/types.h"
 #include "Inc/jacoby/particle.h"
@@ -21,20 +36,50 @@ class particleVis : public jacoby::Particle<FLOAT> {
 public:
 	typedef jacoby::Particle<FLOAT> particleBase;
 
+	// memory layout of a single instance offset
+	enum class InstanceLayout {
+		Float3,		// 3 floats, 12 bytes
+		Half3		// 3 half floats padded to 8 bytes
+	};
+
+	// back, middle and front of a stream plus one slot waiting for its fence
+	static const unsigned int RING_SIZE = 4;
+
 private:
 	static const float vertices[];			// vertices of the model (for the VBO, OpenGL)
 	static const unsigned int indices[];	// indices of the model (for the EBO, OpenGL)
 	static unsigned int VAO;				// vertex array object id
 	static unsigned int EBO;				// element buffer object id
 	static unsigned int VBO;				// vertex buffer object id
+	static unsigned int ringVBO[RING_SIZE];	// per-instance offsets, one buffer per frame in flight
+	static void* ringFence[RING_SIZE];		// GLsync of the last draw reading each buffer
+	static void* ringMapped[RING_SIZE];		// persistent mappings (nullptr if not persistent)
+	static unsigned int ringSlot;			// buffer written this frame
+	static unsigned int ringCapacity;		// number of offsets every buffer can hold
+	static bool ringPersistent;				// glBufferStorage path is in use
+	static InstanceLayout layout;
+
+	// stream slots, indices into the ring
+	static std::atomic<unsigned int> streamMiddle;	// last published slot, STREAM_FRESH until drawn
+	static unsigned int streamBack;					// written by the producer
+	static unsigned int streamFront;				// drawn by the render thread
+	static unsigned int streamSpare;				// drawn before, handed back once its fence signaled
+	static unsigned int streamCount[RING_SIZE];		// offsets published in every slot
+	static void* streamData[RING_SIZE];				// mapped slots, or staging without persistent mapping
+	static std::vector<unsigned char> streamStaging[RING_SIZE];
 	static unsigned int count;				// number of objects
 	static Shader m_SO;
 
-	glm::mat4 modelMatrix;					// model matrix		
 	unsigned int state;						// state (how many hits to destroy)
 	glm::vec3 position;						// position of a brick
 
 	particleVis() {}; // make private
+
+	static void init_buffers();
+	static void create_ring(unsigned int capacity);
+	static void release_ring();
+	static void wait_fence(unsigned int slot);
+	static void draw_ring(unsigned int slot, unsigned int count);
 public:
 
 	particleVis(const glm::vec3 _pos);
@@ -51,6 +96,65 @@ public:
 	// other methods
 	void prepare_to_draw();
 	void draw();
+
+	// half3 halves the upload, at the cost of ~3 significant digits
+	static void set_instance_layout(InstanceLayout);
+	static InstanceLayout get_instance_layout();
+	static unsigned short to_half(float);
+
+	// streaming upload: map_instances returns writable memory for count
+	// offsets in the current layout, draw_mapped draws them and moves
+	// the ring on; every map_instances has to be followed by draw_mapped
+	static void* map_instances(unsigned int count);
+	static void draw_mapped(unsigned int count);
+
+	// draws count cubes at packed xyz positions with a single draw call
+	static void draw_instanced(const float* positions, unsigned int count);
+
+	// streaming from a producer thread: open_stream sizes the ring for
+	// capacity offsets, the producer fills stream_back in the current
+	// layout and calls stream_publish, draw_stream draws the newest
+	// published frame once per render frame. Opening, drawing and closing
+	// happen on the render thread, map_instances and draw_instanced must
+	// not be used while a stream is open.
+	static void open_stream(unsigned int capacity);
+	static void close_stream();
+	static void* stream_back();
+	static void stream_publish(unsigned int count);
+	static void draw_stream();
+
+	// producer side: writes positions of any particle type derived from
+	// jacoby::Particle<FLOAT> into the back slot and publishes them
+	template< typename ParticleT >
+	static void stream_particles(ParticleT* particles, unsigned int count)
+	{
+		if (count > ringCapacity)
+			count = ringCapacity;
+		void* target = stream_back();
+
+		if (layout == InstanceLayout::Float3) {
+			float* out = (float*)target;
+			for (unsigned int ind = 0; ind < count; ++ind, out += 3)
+			{
+				particleBase::VectorType& pos = particles[ind].GetPosition();
+				out[0] = pos.getX();
+				out[1] = pos.getY();
+				out[2] = pos.getZ();
+			}
+		}
+		else {
+			unsigned short* out = (unsigned short*)target;
+			for (unsigned int ind = 0; ind < count; ++ind, out += 4)
+			{
+				particleBase::VectorType& pos = particles[ind].GetPosition();
+				out[0] = to_half(pos.getX());
+				out[1] = to_half(pos.getY());
+				out[2] = to_half(pos.getZ());
+				out[3] = 0;
+			}
+		}
+		stream_publish(count);
+	}
 };
 
 #endif
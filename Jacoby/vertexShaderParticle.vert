@@ -1,9 +1,9 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-uniform mat4 model;
+layout (location = 1) in vec3 aOffset;
 uniform mat4 view;
 uniform mat4 proj;
 void main()
 {
-	gl_Position = proj*view*model*vec4(aPos,1.0);
+	gl_Position = proj*view*vec4(aPos + aOffset,1.0);
 }
\ No newline at end of file